@@ -1,8 +1,13 @@
 # JSON files are run through jsonproc, which is a tool that converts JSON data to an output file
 # based on an Inja template. https://github.com/pantor/inja
+# jsonproc leaves unchanged outputs alone, so a stamp records when it last ran.
+# An output that has gone missing since then makes it run again.
 
-AUTO_GEN_TARGETS += $(DATA_SRC_SUBDIR)/wild_encounters.h
-$(DATA_SRC_SUBDIR)/wild_encounters.h: $(DATA_SRC_SUBDIR)/wild_encounters.json $(DATA_SRC_SUBDIR)/wild_encounters.json.txt
-	$(JSONPROC) $^ $@
+WILD_ENCOUNTERS_H := $(DATA_SRC_SUBDIR)/wild_encounters.h
+WILD_ENCOUNTERS_STAMP := $(OBJ_DIR)/wild_encounters.h.stamp
 
-$(C_BUILDDIR)/wild_encounter.o: c_dep += $(DATA_SRC_SUBDIR)/wild_encounters.h
+AUTO_GEN_TARGETS += $(WILD_ENCOUNTERS_H)
+$(WILD_ENCOUNTERS_H): $(WILD_ENCOUNTERS_STAMP) ;
+$(WILD_ENCOUNTERS_STAMP): $(DATA_SRC_SUBDIR)/wild_encounters.json $(DATA_SRC_SUBDIR)/wild_encounters.json.txt $(if $(wildcard $(WILD_ENCOUNTERS_H)),,FORCE)
+	$(JSONPROC) $(DATA_SRC_SUBDIR)/wild_encounters.json $(DATA_SRC_SUBDIR)/wild_encounters.json.txt $(WILD_ENCOUNTERS_H)
+	@touch $@
@@ -18,17 +18,27 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 // THE SOFTWARE.
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "asset_cache.h"
 
 /* extended.c */
 void ieee754_write_extended (double, uint8_t*);
 double ieee754_read_extended (uint8_t*);
 
+/* resample.c */
+double *resample(const double *samples, unsigned long length, unsigned long loop_start, bool loop,
+                 double in_rate, double out_rate, unsigned long out_length);
+
 #ifdef _MSC_VER
 
 #define FATAL_ERROR(format, ...)           \
@@ -57,8 +67,17 @@ typedef struct {
 	unsigned long loop_offset;
 	double sample_rate;
 	unsigned long real_num_samples;
+	int sample_bytes;
 } AifData;
 
+struct ConvertOptions {
+	bool compress;
+	bool trellis;
+	double rate;     // resample to this rate, or 0 to keep the input's
+	bool normalize;  // scale the peak to full scale
+	bool dither;
+};
+
 struct Bytes {
 	unsigned long length;
 	uint8_t *data;
@@ -91,8 +110,35 @@ struct Bytes *read_bytearray(const char *filename)
 	return bytes;
 }
 
+// Set in batch mode, so that outputs that wouldn't change keep their
+// timestamps.
+static bool skip_unchanged_writes = false;
+
+static bool file_has_contents(const char *filename, struct Bytes *bytes)
+{
+	FILE *f = fopen(filename, "rb");
+	if (!f)
+	{
+		return false;
+	}
+	bool same = false;
+	uint8_t *data = malloc(bytes->length + 1);
+	if (data)
+	{
+		same = fread(data, 1, bytes->length + 1, f) == bytes->length
+			&& memcmp(data, bytes->data, bytes->length) == 0;
+		free(data);
+	}
+	fclose(f);
+	return same;
+}
+
 void write_bytearray(const char *filename, struct Bytes *bytes)
 {
+	if (skip_unchanged_writes && file_has_contents(filename, bytes))
+	{
+		return;
+	}
 	FILE *f = fopen(filename, "wb");
 	if (!f)
 	{
@@ -140,6 +186,7 @@ void read_aif(struct Bytes *aif, AifData *aif_data)
 {
 	aif_data->has_loop = false;
 	aif_data->num_samples = 0;
+	aif_data->sample_bytes = 1;
 
 	unsigned long pos = 0;
 	char chunk_name[5]; chunk_name[4] = '\0';
@@ -210,10 +257,11 @@ void read_aif(struct Bytes *aif, AifData *aif_data)
 
 			short sample_size = (aif->data[pos++] << 8);
 			sample_size |= (uint8_t)aif->data[pos++];
-			if (sample_size != 8)
+			if (sample_size < 1 || sample_size > 32)
 			{
-				FATAL_ERROR("sampleSize (%d) in the COMM Chunk must be 8!\n", sample_size);
+				FATAL_ERROR("sampleSize (%d) in the COMM Chunk must be between 1 and 32!\n", sample_size);
 			}
+			aif_data->sample_bytes = (sample_size + 7) / 8;
 
 			double sample_rate = ieee754_read_extended((uint8_t*)(aif->data + pos));
 			pos += 10;
@@ -343,6 +391,10 @@ void read_aif(struct Bytes *aif, AifData *aif_data)
 
 		free(markers);
 	}
+
+	// The SSND chunk can come before the COMM chunk, so its size is only
+	// turned into a number of samples here.
+	aif_data->real_num_samples /= aif_data->sample_bytes;
 }
 
 // This is a table of deltas between sample values in compressed PCM data.
@@ -418,27 +470,143 @@ struct Bytes *delta_decompress(struct Bytes *delta, unsigned int expected_length
 	return pcm;
 }
 
-int get_delta_index(uint8_t sample, uint8_t prev_sample)
+// The index of the delta that gets closest to each sample from each
+// previous sample, so the compressor doesn't search the table every time.
+static uint8_t delta_index_table[256][256];
+
+void init_delta_index_table(void)
 {
-	int best_error = INT_MAX;
-	int best_index = -1;
+	for (int prev_sample = 0; prev_sample < 256; prev_sample++)
+	{
+		for (int sample = 0; sample < 256; sample++)
+		{
+			int best_error = INT_MAX;
+			int best_index = -1;
+
+			for (int i = 0; i < 16; i++)
+			{
+				uint8_t new_sample = prev_sample + gDeltaEncodingTable[i];
+				int error = sample > new_sample ? sample - new_sample : new_sample - sample;
+
+				if (error < best_error)
+				{
+					best_error = error;
+					best_index = i;
+				}
+			}
+
+			delta_index_table[prev_sample][sample] = best_index;
+		}
+	}
+}
 
-	for (int i = 0; i < 16; i++)
+static inline int get_delta_index(uint8_t sample, uint8_t prev_sample)
+{
+	return delta_index_table[prev_sample][sample];
+}
+
+// The number of paths the trellis encoder keeps at each sample.
+#define TRELLIS_PATHS 8
+
+struct TrellisPath {
+	uint8_t value;
+	uint8_t delta_index;
+	uint8_t parent;
+	uint32_t error;
+};
+
+// Picks the delta indices for samples[1..count-1] of a block, whose first
+// sample is stored as is. Instead of taking the nearest delta for each
+// sample, this keeps the TRELLIS_PATHS paths with the lowest total squared
+// error so far and picks the best one at the end of the block. Samples are
+// compared as signed values, so a path never wraps around.
+static void trellis_encode_block(const uint8_t *samples, int count, uint8_t *delta_indices)
+{
+	struct TrellisPath paths[64][TRELLIS_PATHS];
+	int num_paths[64];
+	int best_path[256];
+
+	paths[0][0].value = samples[0];
+	paths[0][0].error = 0;
+	num_paths[0] = 1;
+
+	for (int i = 1; i < count; i++)
 	{
-		uint8_t new_sample = prev_sample + gDeltaEncodingTable[i];
-		int error = sample > new_sample ? sample - new_sample : new_sample - sample;
+		struct TrellisPath candidates[TRELLIS_PATHS * 16];
+		int num_candidates = 0;
+
+		for (int j = 0; j < 256; j++)
+			best_path[j] = -1;
 
-		if (error < best_error)
+		for (int p = 0; p < num_paths[i - 1]; p++)
 		{
-			best_error = error;
-			best_index = i;
+			const struct TrellisPath *path = &paths[i - 1][p];
+
+			for (int d = 0; d < 16; d++)
+			{
+				uint8_t value = path->value + gDeltaEncodingTable[d];
+				int diff = (int8_t)samples[i] - (int8_t)value;
+				uint32_t error = path->error + diff * diff;
+
+				// Only the best path to each value is worth keeping.
+				if (best_path[value] >= 0)
+				{
+					struct TrellisPath *other = &candidates[best_path[value]];
+
+					if (error < other->error)
+					{
+						other->delta_index = d;
+						other->parent = p;
+						other->error = error;
+					}
+
+					continue;
+				}
+
+				struct TrellisPath *candidate = &candidates[num_candidates];
+				candidate->value = value;
+				candidate->delta_index = d;
+				candidate->parent = p;
+				candidate->error = error;
+				best_path[value] = num_candidates++;
+			}
 		}
+
+		// Keep the candidates with the lowest error, in order.
+		int kept = 0;
+
+		for (int c = 0; c < num_candidates; c++)
+		{
+			int pos = kept < TRELLIS_PATHS ? kept++ : TRELLIS_PATHS;
+
+			if (pos == TRELLIS_PATHS && candidates[c].error >= paths[i][TRELLIS_PATHS - 1].error)
+				continue;
+
+			if (pos == TRELLIS_PATHS)
+				pos--;
+
+			while (pos > 0 && paths[i][pos - 1].error > candidates[c].error)
+			{
+				paths[i][pos] = paths[i][pos - 1];
+				pos--;
+			}
+
+			paths[i][pos] = candidates[c];
+		}
+
+		num_paths[i] = kept;
 	}
 
-	return best_index;
+	int p = 0;
+
+	for (int i = count - 1; i > 0; i--)
+	{
+		delta_indices[i] = paths[i][p].delta_index;
+		p = paths[i][p].parent;
+	}
 }
 
-struct Bytes *delta_compress(struct Bytes *pcm)
+struct Bytes *delta_compress(struct Bytes *pcm, bool trellis)
 {
 	struct Bytes *delta = malloc(sizeof(struct Bytes));
 	// estimate the length so we can malloc
@@ -468,9 +636,18 @@ struct Bytes *delta_compress(struct Bytes *pcm)
 	int k;
 	uint8_t base;
 	int delta_index;
+	uint8_t block_indices[64];
 
 	while (i < pcm->length)
 	{
+		unsigned int block_start = i;
+
+		if (trellis)
+		{
+			unsigned int block_size = pcm->length - i < 64 ? pcm->length - i : 64;
+			trellis_encode_block(&pcm->data[i], block_size, block_indices);
+		}
+
 		base = pcm->data[i++];
 		delta->data[j++] = base;
 
@@ -478,7 +655,8 @@ struct Bytes *delta_compress(struct Bytes *pcm)
 		{
 			break;
 		}
-		delta_index = get_delta_index(pcm->data[i++], base);
+		delta_index = trellis ? block_indices[i - block_start] : get_delta_index(pcm->data[i], base);
+		i++;
 		base += gDeltaEncodingTable[delta_index];
 		delta->data[j++] = delta_index;
 
@@ -488,7 +666,8 @@ struct Bytes *delta_compress(struct Bytes *pcm)
 			{
 				break;
 			}
-			delta_index = get_delta_index(pcm->data[i++], base);
+			delta_index = trellis ? block_indices[i - block_start] : get_delta_index(pcm->data[i], base);
+			i++;
 			base += gDeltaEncodingTable[delta_index];
 			delta->data[j] = (delta_index << 4);
 
@@ -496,7 +675,8 @@ struct Bytes *delta_compress(struct Bytes *pcm)
 			{
 				break;
 			}
-			delta_index = get_delta_index(pcm->data[i++], base);
+			delta_index = trellis ? block_indices[i - block_start] : get_delta_index(pcm->data[i], base);
+			i++;
 			base += gDeltaEncodingTable[delta_index];
 			delta->data[j++] |= delta_index;
 		}
@@ -523,13 +703,143 @@ do { \
 	(var) |= (*((src) + 3) << 24); \
 } while (0)
 
+// Returns a uniformly distributed number in [0, 1).
+static double next_random(uint32_t *state)
+{
+	// xorshift32
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x / 4294967296.0;
+}
+
+// Turns samples of any size into 8-bit samples, resampling and normalizing
+// them on the way if asked to. Samples are handled as doubles on the 8-bit
+// scale and rounded with triangular dither at the end, so quantization
+// error is noise instead of distortion. The dither is seeded the same way
+// every time, so the output doesn't change from one build to the next.
+static void process_samples(AifData *aif_data, const struct ConvertOptions *options)
+{
+	unsigned long length = aif_data->real_num_samples;
+	int bytes = aif_data->sample_bytes;
+	double *samples = malloc((length ? length : 1) * sizeof(double));
+	if (!samples)
+	{
+		FATAL_ERROR("Failed to allocate memory for the samples!\n");
+	}
+
+	for (unsigned long i = 0; i < length; i++)
+	{
+		const uint8_t *data = &aif_data->samples[i * bytes];
+		int64_t value = (int8_t)data[0];
+		for (int b = 1; b < bytes; b++)
+		{
+			value = value * 256 + data[b];
+		}
+		samples[i] = ldexp((double)value, -8 * (bytes - 1));
+	}
+
+	if (options->rate > 0 && options->rate != aif_data->sample_rate)
+	{
+		double ratio = options->rate / aif_data->sample_rate;
+
+		// Nothing after the loop end is ever played.
+		if (aif_data->has_loop && aif_data->num_samples < length)
+		{
+			length = aif_data->num_samples;
+		}
+
+		unsigned long out_length = (unsigned long)(length * ratio + 0.5);
+		double *resampled = resample(samples, length, aif_data->loop_offset, aif_data->has_loop,
+		                             aif_data->sample_rate, options->rate, out_length);
+		if (!resampled)
+		{
+			FATAL_ERROR("Failed to allocate memory for resampling!\n");
+		}
+		free(samples);
+		samples = resampled;
+		length = out_length;
+
+		aif_data->loop_offset = (unsigned long)(aif_data->loop_offset * ratio + 0.5);
+		aif_data->num_samples = (unsigned long)(aif_data->num_samples * ratio + 0.5);
+		if (aif_data->num_samples > length)
+		{
+			aif_data->num_samples = length;
+		}
+		aif_data->sample_rate = options->rate;
+	}
+
+	if (options->normalize)
+	{
+		double peak = 0.0;
+		for (unsigned long i = 0; i < length; i++)
+		{
+			if (fabs(samples[i]) > peak)
+			{
+				peak = fabs(samples[i]);
+			}
+		}
+		if (peak > 0.0)
+		{
+			double gain = 127.0 / peak;
+			for (unsigned long i = 0; i < length; i++)
+			{
+				samples[i] *= gain;
+			}
+		}
+	}
+
+	uint8_t *output = malloc(length ? length : 1);
+	if (!output)
+	{
+		FATAL_ERROR("Failed to allocate memory for the samples!\n");
+	}
+
+	uint32_t random_state = 0x9E3779B9;
+
+	for (unsigned long i = 0; i < length; i++)
+	{
+		double value = samples[i];
+		if (options->dither)
+		{
+			value += next_random(&random_state) - next_random(&random_state);
+		}
+		value = floor(value + 0.5);
+		if (value < -128.0)
+		{
+			value = -128.0;
+		}
+		if (value > 127.0)
+		{
+			value = 127.0;
+		}
+		output[i] = (uint8_t)(int8_t)value;
+	}
+
+	free(samples);
+	free(aif_data->samples);
+	aif_data->samples = output;
+	aif_data->real_num_samples = length;
+	aif_data->sample_bytes = 1;
+}
+
 // Reads an .aif file and produces a .pcm file containing an array of 8-bit samples.
-void aif2pcm(const char *aif_filename, const char *pcm_filename, bool compress)
+void aif2pcm(const char *aif_filename, const char *pcm_filename, const struct ConvertOptions *options)
 {
 	struct Bytes *aif = read_bytearray(aif_filename);
-	AifData aif_data = {0,0,0,0,0,0,0};
+	AifData aif_data = {0,0,0,0,0,0,0,0};
 	read_aif(aif, &aif_data);
 
+	bool compress = options->compress;
+
+	if (aif_data.sample_bytes != 1 || options->normalize
+	 || (options->rate > 0 && options->rate != aif_data.sample_rate))
+	{
+		process_samples(&aif_data, options);
+	}
+
 	int header_size = 0x10;
 	struct Bytes *pcm;
 	struct Bytes output = {0,0};
@@ -539,7 +849,7 @@ void aif2pcm(const char *aif_filename, const char *pcm_filename, bool compress)
 		struct Bytes *input = malloc(sizeof(struct Bytes));
 		input->data = aif_data.samples;
 		input->length = aif_data.real_num_samples;
-		pcm = delta_compress(input);
+		pcm = delta_compress(input, options->trellis);
 		free(input);
 	}
 	else
@@ -824,10 +1134,13 @@ void pcm2aif(const char *pcm_filename, const char *aif_filename, uint32_t base_n
 void usage(void)
 {
 	fprintf(stderr, "Usage: aif2pcm bin_file [aif_file]\n");
-	fprintf(stderr, "       aif2pcm aif_file [bin_file] [--compress]\n");
+	fprintf(stderr, "       aif2pcm aif_file [bin_file] [--compress] [--trellis]\n");
+	fprintf(stderr, "               [--rate sample_rate] [--normalize] [--no-dither]\n");
+	fprintf(stderr, "       aif2pcm --batch [-j threads] [manifest]\n");
 }
 
-int main(int argc, char **argv)
+// Runs one conversion. argv is laid out like the command line.
+void convert(int argc, char **argv)
 {
 	if (argc < 2)
 	{
@@ -838,7 +1151,7 @@ int main(int argc, char **argv)
 	char *input_file = argv[1];
 	char *extension = get_file_extension(input_file);
 	char *output_file;
-	bool compressed = false;
+	struct ConvertOptions options = {false, false, 0.0, false, true};
 
 	if (argc > 3)
 	{
@@ -846,42 +1159,303 @@ int main(int argc, char **argv)
 		{
 			if (strcmp(argv[i], "--compress") == 0)
 			{
-				compressed = true;
+				options.compress = true;
+			}
+			else if (strcmp(argv[i], "--trellis") == 0)
+			{
+				options.trellis = true;
+			}
+			else if (strcmp(argv[i], "--rate") == 0)
+			{
+				char *end = NULL;
+				if (i + 1 < argc)
+				{
+					options.rate = strtod(argv[++i], &end);
+				}
+				if (!end || *end != '\0' || options.rate <= 0)
+				{
+					FATAL_ERROR("--rate needs a sample rate in Hz\n");
+				}
+			}
+			else if (strcmp(argv[i], "--normalize") == 0)
+			{
+				options.normalize = true;
+			}
+			else if (strcmp(argv[i], "--no-dither") == 0)
+			{
+				options.dither = false;
 			}
 		}
 	}
 
-	if (strcmp(extension, "aif") == 0 || strcmp(extension, "aiff") == 0)
+	bool to_pcm = extension && (strcmp(extension, "aif") == 0 || strcmp(extension, "aiff") == 0);
+
+	if (!to_pcm && !(extension && strcmp(extension, "bin") == 0))
+	{
+		FATAL_ERROR("Input file must be .aif or .bin: '%s'\n", input_file);
+	}
+
+	if (argc >= 3)
+	{
+		output_file = argv[2];
+	}
+	else
+	{
+		output_file = new_file_extension(input_file, to_pcm ? "bin" : "aif");
+	}
+
+	struct AssetCacheKey cache_key;
+	uint8_t *cached_data = NULL;
+	size_t cached_size;
+
+	if (AssetCacheBegin(&cache_key, argc, argv))
+	{
+		AssetCacheAddInput(&cache_key, input_file);
+		cached_data = AssetCacheFetch(&cache_key, &cached_size);
+	}
+
+	if (cached_data)
 	{
-		if (argc >= 3)
+		struct Bytes cached = {cached_size, cached_data};
+		write_bytearray(output_file, &cached);
+		free(cached_data);
+	}
+	else
+	{
+		if (to_pcm)
 		{
-			output_file = argv[2];
-			aif2pcm(input_file, output_file, compressed);
+			aif2pcm(input_file, output_file, &options);
 		}
 		else
 		{
-			output_file = new_file_extension(input_file, "bin");
-			aif2pcm(input_file, output_file, compressed);
-			free(output_file);
+			pcm2aif(input_file, output_file, 60);
 		}
+		AssetCacheStoreFile(&cache_key, output_file);
 	}
-	else if (strcmp(extension, "bin") == 0)
+
+	AssetCacheEnd(&cache_key);
+
+	if (argc < 3)
 	{
-		if (argc >= 3)
+		free(output_file);
+	}
+}
+
+// Batch mode runs the conversions listed in a manifest on a pool of
+// threads, so converting every sample doesn't start a process for each
+// one. Each line holds the arguments of one conversion:
+//
+//     input_file output_file [options]
+//
+// Blank lines and lines starting with '#' are ignored. Outputs whose
+// contents wouldn't change aren't rewritten.
+
+struct BatchJob {
+	int argc;
+	char *argv[16];
+};
+
+struct Batch {
+	struct BatchJob *jobs;
+	int num_jobs;
+	int next_job;
+	pthread_mutex_t mutex;
+};
+
+char *read_manifest(const char *filename)
+{
+	FILE *f = stdin;
+	if (filename && strcmp(filename, "-") != 0)
+	{
+		f = fopen(filename, "rb");
+		if (!f)
 		{
-			output_file = argv[2];
-			pcm2aif(input_file, output_file, 60);
+			FATAL_ERROR("Failed to open '%s' for reading!\n", filename);
+		}
+	}
+
+	size_t length = 0;
+	size_t capacity = 4096;
+	char *text = malloc(capacity);
+	size_t count;
+
+	while (text && (count = fread(text + length, 1, capacity - length - 1, f)) > 0)
+	{
+		length += count;
+		if (capacity - length < 1024)
+		{
+			capacity *= 2;
+			text = realloc(text, capacity);
+		}
+	}
+
+	if (!text)
+	{
+		FATAL_ERROR("Failed to allocate memory for the batch manifest!\n");
+	}
+	if (f != stdin)
+	{
+		fclose(f);
+	}
+	text[length] = '\0';
+	return text;
+}
+
+// Splits the manifest into jobs in place.
+void parse_manifest(char *text, struct Batch *batch)
+{
+	int capacity = 256;
+	batch->jobs = malloc(capacity * sizeof(struct BatchJob));
+	batch->num_jobs = 0;
+
+	for (char *line = strtok(text, "\r\n"); line; line = strtok(NULL, "\r\n"))
+	{
+		struct BatchJob job;
+		job.argc = 1;
+		job.argv[0] = "aif2pcm";
+
+		char *arg = line;
+		while (*arg)
+		{
+			while (*arg == ' ' || *arg == '\t')
+			{
+				*arg++ = '\0';
+			}
+			if (!*arg || (job.argc == 1 && *arg == '#'))
+			{
+				break;
+			}
+			if (job.argc == 15)
+			{
+				FATAL_ERROR("Too many arguments in batch job '%s'!\n", job.argv[1]);
+			}
+			job.argv[job.argc++] = arg;
+			while (*arg && *arg != ' ' && *arg != '\t')
+			{
+				arg++;
+			}
+		}
+		job.argv[job.argc] = NULL;
+
+		if (job.argc == 1)
+		{
+			continue;
+		}
+		if (job.argc < 3)
+		{
+			FATAL_ERROR("Batch job '%s' has no output file!\n", job.argv[1]);
+		}
+
+		if (batch->num_jobs == capacity)
+		{
+			capacity *= 2;
+			batch->jobs = realloc(batch->jobs, capacity * sizeof(struct BatchJob));
+		}
+		if (!batch->jobs)
+		{
+			FATAL_ERROR("Failed to allocate memory for the batch jobs!\n");
+		}
+		batch->jobs[batch->num_jobs++] = job;
+	}
+}
+
+void *batch_worker(void *arg)
+{
+	struct Batch *batch = arg;
+
+	for (;;)
+	{
+		pthread_mutex_lock(&batch->mutex);
+		int index = batch->next_job++;
+		pthread_mutex_unlock(&batch->mutex);
+
+		if (index >= batch->num_jobs)
+		{
+			break;
+		}
+		convert(batch->jobs[index].argc, batch->jobs[index].argv);
+	}
+
+	return NULL;
+}
+
+void run_batch(int argc, char **argv)
+{
+	long num_threads = 1;
+	char *manifest_file = NULL;
+
+#ifdef _SC_NPROCESSORS_ONLN
+	num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+	for (int i = 2; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+		{
+			num_threads = strtol(argv[++i], NULL, 10);
+		}
+		else if (!manifest_file)
+		{
+			manifest_file = argv[i];
 		}
 		else
 		{
-			output_file = new_file_extension(input_file, "aif");
-			pcm2aif(input_file, output_file, 60);
-			free(output_file);
+			usage();
+			exit(1);
 		}
 	}
+
+	char *manifest = read_manifest(manifest_file);
+	struct Batch batch;
+	parse_manifest(manifest, &batch);
+	batch.next_job = 0;
+	pthread_mutex_init(&batch.mutex, NULL);
+	skip_unchanged_writes = true;
+
+	if (num_threads > batch.num_jobs)
+	{
+		num_threads = batch.num_jobs;
+	}
+	if (num_threads < 1)
+	{
+		num_threads = 1;
+	}
+
+	pthread_t *threads = malloc(num_threads * sizeof(pthread_t));
+	if (!threads)
+	{
+		FATAL_ERROR("Failed to allocate memory for the batch threads!\n");
+	}
+	for (int i = 0; i < num_threads; i++)
+	{
+		if (pthread_create(&threads[i], NULL, batch_worker, &batch) != 0)
+		{
+			FATAL_ERROR("Failed to start a batch thread!\n");
+		}
+	}
+	for (int i = 0; i < num_threads; i++)
+	{
+		pthread_join(threads[i], NULL);
+	}
+
+	pthread_mutex_destroy(&batch.mutex);
+	free(threads);
+	free(batch.jobs);
+	free(manifest);
+}
+
+int main(int argc, char **argv)
+{
+	AssetCacheInit(argv[0]);
+	init_delta_index_table();
+
+	if (argc >= 2 && strcmp(argv[1], "--batch") == 0)
+	{
+		run_batch(argc, argv);
+	}
 	else
 	{
-		FATAL_ERROR("Input file must be .aif or .bin: '%s'\n", input_file);
+		convert(argc, argv);
 	}
 
 	return 0;
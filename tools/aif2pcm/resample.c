@@ -0,0 +1,144 @@
+// Band-limited resampling with a Kaiser-windowed sinc filter.
+//
+// The filter is stored once as a table of SINC_RESOLUTION phases per zero
+// crossing, and each output sample interpolates between the two nearest
+// phases. That works for any ratio between the rates, where a plain
+// polyphase filter would need a phase for every step of the ratio.
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+// The number of zero crossings of the sinc on each side of the filter.
+#define SINC_ZERO_CROSSINGS 16
+
+// The number of table entries between two zero crossings.
+#define SINC_RESOLUTION 512
+
+// Kaiser window shape. 8 keeps the stopband well under the noise floor of
+// 8-bit samples.
+#define KAISER_BETA 8.0
+
+// The filter cuts off this far below the lower of the two Nyquist
+// frequencies, to leave room for its transition band.
+#define CUTOFF_ROLLOFF 0.95
+
+#define PI 3.14159265358979323846
+
+static double bessel_i0(double x)
+{
+	double sum = 1.0;
+	double term = 1.0;
+
+	for (int k = 1; k < 50; k++)
+	{
+		term *= (x / (2.0 * k)) * (x / (2.0 * k));
+		sum += term;
+		if (term < sum * 1e-12)
+		{
+			break;
+		}
+	}
+
+	return sum;
+}
+
+static double *make_sinc_table(void)
+{
+	int length = SINC_ZERO_CROSSINGS * SINC_RESOLUTION + 2;
+	double *table = malloc(length * sizeof(double));
+	if (!table)
+	{
+		return NULL;
+	}
+
+	double scale = 1.0 / bessel_i0(KAISER_BETA);
+
+	for (int i = 0; i < length; i++)
+	{
+		double x = (double)i / SINC_RESOLUTION;
+		if (x >= SINC_ZERO_CROSSINGS)
+		{
+			table[i] = 0.0;
+			continue;
+		}
+
+		double sinc = i == 0 ? 1.0 : sin(PI * x) / (PI * x);
+		double w = x / SINC_ZERO_CROSSINGS;
+		table[i] = sinc * bessel_i0(KAISER_BETA * sqrt(1.0 - w * w)) * scale;
+	}
+
+	return table;
+}
+
+// Reads sample i, continuing from the loop start past the loop end.
+static inline double get_sample(const double *samples, long length, long loop_start, bool loop, long i)
+{
+	if (i < 0)
+	{
+		return 0.0;
+	}
+	if (i >= length)
+	{
+		if (!loop)
+		{
+			return 0.0;
+		}
+		i = loop_start + (i - length) % (length - loop_start);
+	}
+	return samples[i];
+}
+
+// Resamples length samples from in_rate to out_rate, writing out_length
+// samples. If loop is set, the filter reads past the end of the input from
+// loop_start, so the loop stays seamless. Returns NULL if out of memory.
+double *resample(const double *samples, unsigned long length, unsigned long loop_start, bool loop,
+                 double in_rate, double out_rate, unsigned long out_length)
+{
+	double *table = make_sinc_table();
+	double *output = malloc((out_length ? out_length : 1) * sizeof(double));
+	if (!table || !output)
+	{
+		free(table);
+		free(output);
+		return NULL;
+	}
+
+	if (loop && loop_start >= length)
+	{
+		loop = false;
+	}
+
+	double step = in_rate / out_rate;
+	double cutoff = (out_rate < in_rate ? out_rate / in_rate : 1.0) * CUTOFF_ROLLOFF;
+	double reach = SINC_ZERO_CROSSINGS / cutoff;
+	double table_step = cutoff * SINC_RESOLUTION;
+
+	for (unsigned long n = 0; n < out_length; n++)
+	{
+		double t = n * step;
+		long first = (long)ceil(t - reach);
+		long last = (long)floor(t + reach);
+		double sum = 0.0;
+
+		for (long i = first; i <= last; i++)
+		{
+			double pos = fabs(t - i) * table_step;
+			long index = (long)pos;
+			double frac = pos - index;
+
+			if (index >= SINC_ZERO_CROSSINGS * SINC_RESOLUTION)
+			{
+				continue;
+			}
+
+			double h = table[index] + (table[index + 1] - table[index]) * frac;
+			sum += h * get_sample(samples, (long)length, (long)loop_start, loop, i);
+		}
+
+		output[n] = sum * cutoff;
+	}
+
+	free(table);
+	return output;
+}
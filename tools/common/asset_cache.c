@@ -0,0 +1,430 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#define getpid _getpid
+#define MAKE_DIRECTORY(path) _mkdir(path)
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#define MAKE_DIRECTORY(path) mkdir(path, 0777)
+#endif
+#include "asset_cache.h"
+
+// An entry is the magic, the number of dependencies, each dependency's path
+// length, path and content hash, and then the output. Numbers are stored
+// little-endian.
+static const char kEntryMagic[4] = { 'A', 'C', 'E', '1' };
+
+struct AssetCacheDependency
+{
+    char *path;
+    uint64_t hash;
+};
+
+static char *sCacheDir;
+static const char *sToolName;
+static uint64_t sToolHash;
+static unsigned long sHits;
+static unsigned long sMisses;
+static unsigned long sTempCounter;
+
+// 64-bit FNV-1a. Used to tell whether cached data is still valid, not for
+// anything that needs to resist deliberate collisions.
+static uint64_t HashBytes(uint64_t hash, const void *data, size_t size)
+{
+    const unsigned char *bytes = (const unsigned char *)data;
+
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001B3ULL;
+    }
+
+    return hash;
+}
+
+static const uint64_t kHashSeed = 0xCBF29CE484222325ULL;
+
+static unsigned char *ReadFile(const char *path, size_t *size)
+{
+    FILE *fp = fopen(path, "rb");
+
+    if (fp == NULL)
+        return NULL;
+
+    unsigned char *data = NULL;
+    size_t capacity = 0;
+    size_t length = 0;
+
+    for (;;)
+    {
+        if (capacity - length < 4096)
+        {
+            capacity = capacity ? capacity * 2 : 65536;
+
+            unsigned char *newData = (unsigned char *)realloc(data, capacity);
+
+            if (newData == NULL)
+                break;
+
+            data = newData;
+        }
+
+        size_t count = fread(data + length, 1, capacity - length, fp);
+
+        length += count;
+
+        if (count == 0)
+            break;
+    }
+
+    bool ok = !ferror(fp) && data != NULL && feof(fp);
+
+    fclose(fp);
+
+    if (!ok)
+    {
+        free(data);
+        return NULL;
+    }
+
+    *size = length;
+    return data;
+}
+
+// Hashes a file's size and contents. Returns false if it can't be read.
+static bool HashFile(const char *path, uint64_t *hash)
+{
+    size_t size;
+    unsigned char *data = ReadFile(path, &size);
+
+    if (data == NULL)
+        return false;
+
+    uint64_t size64 = size;
+
+    *hash = HashBytes(HashBytes(kHashSeed, &size64, sizeof(size64)), data, size);
+    free(data);
+    return true;
+}
+
+static void WriteStats(void)
+{
+    if (sHits + sMisses == 0)
+        return;
+
+    size_t length = strlen(sCacheDir) + sizeof("/stats");
+    char *path = (char *)malloc(length);
+
+    if (path == NULL)
+        return;
+
+    snprintf(path, length, "%s/stats", sCacheDir);
+
+    // A short line appended in one write doesn't get mixed up with lines
+    // from other tools running at the same time.
+    FILE *fp = fopen(path, "a");
+
+    if (fp != NULL)
+    {
+        fprintf(fp, "%s %lu %lu\n", sToolName, sHits, sMisses);
+        fclose(fp);
+    }
+
+    free(path);
+}
+
+void AssetCacheInit(const char *toolPath)
+{
+    const char *dir = getenv("ASSET_CACHE_DIR");
+
+    if (dir == NULL || dir[0] == 0)
+        return;
+
+    // The tool's own bytes stand in for its version, so rebuilding it with
+    // any change starts over with new entries.
+    if (!HashFile(toolPath, &sToolHash) && !HashFile("/proc/self/exe", &sToolHash))
+        return;
+
+    const char *name = toolPath;
+
+    for (const char *s = toolPath; *s != 0; s++)
+        if (*s == '/' || *s == '\\')
+            name = s + 1;
+
+    sToolName = name;
+    sCacheDir = (char *)malloc(strlen(dir) + 1);
+
+    if (sCacheDir == NULL)
+        return;
+
+    strcpy(sCacheDir, dir);
+    MAKE_DIRECTORY(sCacheDir);
+    atexit(WriteStats);
+}
+
+bool AssetCacheBegin(struct AssetCacheKey *key, int argc, char **argv)
+{
+    key->enabled = sCacheDir != NULL;
+    key->hash = HashBytes(kHashSeed, &sToolHash, sizeof(sToolHash));
+    key->numDependencies = 0;
+    key->dependencyCapacity = 0;
+    key->dependencies = NULL;
+
+    // argv[0] isn't hashed, since it's the tool, which is already covered.
+    for (int i = 1; i < argc; i++)
+        key->hash = HashBytes(key->hash, argv[i], strlen(argv[i]) + 1);
+
+    return key->enabled;
+}
+
+void AssetCacheAddInput(struct AssetCacheKey *key, const char *path)
+{
+    uint64_t hash;
+
+    if (!key->enabled)
+        return;
+
+    // The tool will report the error itself.
+    if (!HashFile(path, &hash))
+    {
+        key->enabled = false;
+        return;
+    }
+
+    key->hash = HashBytes(key->hash, &hash, sizeof(hash));
+}
+
+void AssetCacheAddDependency(struct AssetCacheKey *key, const char *path)
+{
+    uint64_t hash;
+
+    if (!key->enabled)
+        return;
+
+    if (!HashFile(path, &hash))
+    {
+        key->enabled = false;
+        return;
+    }
+
+    if (key->numDependencies == key->dependencyCapacity)
+    {
+        int capacity = key->dependencyCapacity ? key->dependencyCapacity * 2 : 8;
+        struct AssetCacheDependency *dependencies = (struct AssetCacheDependency *)realloc(
+            key->dependencies, capacity * sizeof(struct AssetCacheDependency));
+
+        if (dependencies == NULL)
+        {
+            key->enabled = false;
+            return;
+        }
+
+        key->dependencies = dependencies;
+        key->dependencyCapacity = capacity;
+    }
+
+    struct AssetCacheDependency *dependency = &key->dependencies[key->numDependencies];
+
+    dependency->path = (char *)malloc(strlen(path) + 1);
+
+    if (dependency->path == NULL)
+    {
+        key->enabled = false;
+        return;
+    }
+
+    strcpy(dependency->path, path);
+    dependency->hash = hash;
+    key->numDependencies++;
+}
+
+static char *GetEntryPath(struct AssetCacheKey *key)
+{
+    size_t length = strlen(sCacheDir) + 18;
+    char *path = (char *)malloc(length);
+
+    if (path != NULL)
+        snprintf(path, length, "%s/%016llx", sCacheDir, (unsigned long long)key->hash);
+
+    return path;
+}
+
+static uint64_t ReadNumber(const unsigned char *data, int size)
+{
+    uint64_t value = 0;
+
+    for (int i = size - 1; i >= 0; i--)
+        value = (value << 8) | data[i];
+
+    return value;
+}
+
+static void AppendNumber(unsigned char **out, uint64_t value, int size)
+{
+    for (int i = 0; i < size; i++)
+        *(*out)++ = (value >> (8 * i)) & 0xFF;
+}
+
+unsigned char *AssetCacheFetch(struct AssetCacheKey *key, size_t *size)
+{
+    if (!key->enabled)
+        return NULL;
+
+    char *path = GetEntryPath(key);
+    size_t entrySize = 0;
+    unsigned char *entry = path ? ReadFile(path, &entrySize) : NULL;
+    unsigned char *output = NULL;
+
+    free(path);
+
+    if (entry != NULL && entrySize >= 8 && memcmp(entry, kEntryMagic, 4) == 0)
+    {
+        size_t pos = 8;
+        uint64_t numDependencies = ReadNumber(entry + 4, 4);
+        bool valid = true;
+
+        for (uint64_t i = 0; valid && i < numDependencies; i++)
+        {
+            if (entrySize - pos < 4)
+            {
+                valid = false;
+                break;
+            }
+
+            size_t pathLength = ReadNumber(entry + pos, 4);
+
+            pos += 4;
+
+            if (entrySize - pos < pathLength + 8)
+            {
+                valid = false;
+                break;
+            }
+
+            // The path is followed by its hash, so there's room to
+            // terminate it in place after reading the hash.
+            uint64_t hash = ReadNumber(entry + pos + pathLength, 8);
+            uint64_t currentHash;
+
+            entry[pos + pathLength] = 0;
+            valid = HashFile((char *)entry + pos, &currentHash) && currentHash == hash;
+            pos += pathLength + 8;
+        }
+
+        if (valid && entrySize - pos >= 8 && ReadNumber(entry + pos, 8) == entrySize - pos - 8)
+        {
+            *size = entrySize - pos - 8;
+            output = (unsigned char *)malloc(*size ? *size : 1);
+
+            if (output != NULL)
+                memcpy(output, entry + pos + 8, *size);
+        }
+    }
+
+    free(entry);
+
+    __atomic_fetch_add(output ? &sHits : &sMisses, 1, __ATOMIC_RELAXED);
+
+    return output;
+}
+
+void AssetCacheStore(struct AssetCacheKey *key, const void *data, size_t size)
+{
+    if (!key->enabled)
+        return;
+
+    size_t entrySize = 8 + size + 8;
+
+    for (int i = 0; i < key->numDependencies; i++)
+        entrySize += 4 + strlen(key->dependencies[i].path) + 8;
+
+    unsigned char *entry = (unsigned char *)malloc(entrySize);
+    char *path = GetEntryPath(key);
+    char *tempPath = path ? (char *)malloc(strlen(path) + 32) : NULL;
+
+    if (entry == NULL || tempPath == NULL)
+    {
+        free(entry);
+        free(path);
+        free(tempPath);
+        return;
+    }
+
+    unsigned char *out = entry;
+
+    memcpy(out, kEntryMagic, 4);
+    out += 4;
+    AppendNumber(&out, key->numDependencies, 4);
+
+    for (int i = 0; i < key->numDependencies; i++)
+    {
+        size_t pathLength = strlen(key->dependencies[i].path);
+
+        AppendNumber(&out, pathLength, 4);
+        memcpy(out, key->dependencies[i].path, pathLength);
+        out += pathLength;
+        AppendNumber(&out, key->dependencies[i].hash, 8);
+    }
+
+    AppendNumber(&out, size, 8);
+
+    if (size != 0)
+        memcpy(out, data, size);
+
+    // Several processes, or threads of one batch, may store the same entry
+    // at once, so it's written under a unique name and moved into place.
+    unsigned long counter = __atomic_fetch_add(&sTempCounter, 1, __ATOMIC_RELAXED);
+
+    sprintf(tempPath, "%s.%ld.%lu", path, (long)getpid(), counter);
+
+    FILE *fp = fopen(tempPath, "wb");
+
+    if (fp != NULL)
+    {
+        bool ok = fwrite(entry, entrySize, 1, fp) == 1;
+
+        ok = fclose(fp) == 0 && ok;
+
+        if (ok && rename(tempPath, path) != 0)
+        {
+            // Windows won't rename over an existing file.
+            remove(path);
+            ok = rename(tempPath, path) == 0;
+        }
+
+        if (!ok)
+            remove(tempPath);
+    }
+
+    free(entry);
+    free(path);
+    free(tempPath);
+}
+
+void AssetCacheStoreFile(struct AssetCacheKey *key, const char *path)
+{
+    size_t size;
+    unsigned char *data;
+
+    if (!key->enabled || (data = ReadFile(path, &size)) == NULL)
+        return;
+
+    AssetCacheStore(key, data, size);
+    free(data);
+}
+
+void AssetCacheEnd(struct AssetCacheKey *key)
+{
+    for (int i = 0; i < key->numDependencies; i++)
+        free(key->dependencies[i].path);
+
+    free(key->dependencies);
+    key->dependencies = NULL;
+    key->numDependencies = 0;
+    key->dependencyCapacity = 0;
+    key->enabled = false;
+}
@@ -0,0 +1,54 @@
+#ifndef ASSET_CACHE_H
+#define ASSET_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// A cache of tool outputs shared by gbagfx, aif2pcm, mid2agb and preproc.
+// It's off unless the ASSET_CACHE_DIR environment variable names a
+// directory. Entries are keyed by a hash of the tool's executable, its
+// arguments and the contents of its inputs, so a fresh clone or a branch
+// switch reuses outputs that the same tool made from the same bytes.
+//
+// Files a tool only finds while it runs, like the files an assembly file
+// includes, are recorded in the entry as dependencies, and the entry is
+// only used if they haven't changed.
+//
+// The C++ tools build asset_cache.c as C++, so it has to stay valid as both.
+
+struct AssetCacheDependency;
+
+struct AssetCacheKey
+{
+    bool enabled;
+    uint64_t hash;
+    int numDependencies;
+    int dependencyCapacity;
+    struct AssetCacheDependency *dependencies;
+};
+
+// Reads ASSET_CACHE_DIR and hashes the tool's executable. Call once from
+// main, before starting any threads.
+void AssetCacheInit(const char *toolPath);
+
+// Starts a key from the arguments of one conversion. Returns false if the
+// cache is off.
+bool AssetCacheBegin(struct AssetCacheKey *key, int argc, char **argv);
+
+// Adds the contents of an input file to the key.
+void AssetCacheAddInput(struct AssetCacheKey *key, const char *path);
+
+// Records a file the conversion read, to be checked when the entry is used.
+void AssetCacheAddDependency(struct AssetCacheKey *key, const char *path);
+
+// Returns the cached output, which the caller frees, or NULL on a miss.
+unsigned char *AssetCacheFetch(struct AssetCacheKey *key, size_t *size);
+
+// Saves the output of a conversion that missed.
+void AssetCacheStore(struct AssetCacheKey *key, const void *data, size_t size);
+void AssetCacheStoreFile(struct AssetCacheKey *key, const char *path);
+
+void AssetCacheEnd(struct AssetCacheKey *key);
+
+#endif // ASSET_CACHE_H
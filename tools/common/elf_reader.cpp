@@ -0,0 +1,154 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "elf_reader.h"
+
+#ifdef _MSC_VER
+
+#define FATAL_ERROR(format, ...)               \
+do                                             \
+{                                              \
+    std::fprintf(stderr, format, __VA_ARGS__); \
+    std::exit(1);                              \
+} while (0)
+
+#else
+
+#define FATAL_ERROR(format, ...)                 \
+do                                               \
+{                                                \
+    std::fprintf(stderr, format, ##__VA_ARGS__); \
+    std::exit(1);                                \
+} while (0)
+
+#endif // _MSC_VER
+
+class ElfReader
+{
+public:
+    ElfReader(const unsigned char *data, std::size_t size, const std::string& path)
+        : m_data(data), m_size(size), m_path(path) {}
+
+    void Read(std::vector<ElfSectionHeader>& sections, std::vector<ElfSymbolEntry>& symbols)
+    {
+        VerifyElfIdent();
+
+        std::uint32_t sectionHeaderOffset = ReadInt32(0x20);
+        std::uint32_t sectionHeaderEntrySize = ReadInt16(0x2E);
+        std::uint32_t sectionCount = ReadInt16(0x30);
+        std::uint32_t shstrtabIndex = ReadInt16(0x32);
+
+        std::uint32_t shstrtabOffset = ReadInt32(sectionHeaderOffset + sectionHeaderEntrySize * shstrtabIndex + 0x10);
+        std::uint32_t symtabHeader = 0;
+
+        for (std::uint32_t i = 0; i < sectionCount; i++)
+        {
+            std::uint32_t header = sectionHeaderOffset + sectionHeaderEntrySize * i;
+            ElfSectionHeader section;
+
+            section.name = ReadString(shstrtabOffset + ReadInt32(header));
+            section.type = ReadInt32(header + 0x04);
+            section.flags = ReadInt32(header + 0x08);
+            section.address = ReadInt32(header + 0x0C);
+            section.fileOffset = ReadInt32(header + 0x10);
+            section.size = ReadInt32(header + 0x14);
+
+            if (section.type != SHT_NOBITS && (section.flags & SHF_ALLOC))
+                CheckBounds(section.fileOffset, section.size);
+
+            if (section.name == ".symtab")
+            {
+                if (symtabHeader)
+                    FATAL_ERROR("error: multiple .symtab sections found in \"%s\"\n", m_path.c_str());
+                symtabHeader = header;
+            }
+
+            sections.push_back(section);
+        }
+
+        if (!symtabHeader)
+            FATAL_ERROR("error: couldn't find .symtab section in \"%s\"\n", m_path.c_str());
+
+        std::uint32_t symtabOffset = ReadInt32(symtabHeader + 0x10);
+        std::uint32_t symbolCount = ReadInt32(symtabHeader + 0x14) / 16;
+        std::uint32_t strtabIndex = ReadInt32(symtabHeader + 0x18);
+
+        if (strtabIndex >= sectionCount)
+            FATAL_ERROR("error: couldn't find .strtab section in \"%s\"\n", m_path.c_str());
+
+        std::uint32_t strtabOffset = sections[strtabIndex].fileOffset;
+
+        symbols.reserve(symbols.size() + symbolCount);
+
+        for (std::uint32_t i = 0; i < symbolCount; i++)
+        {
+            std::uint32_t symbol = symtabOffset + 16 * i;
+            ElfSymbolEntry entry;
+
+            entry.name = ReadString(strtabOffset + ReadInt32(symbol));
+            entry.value = ReadInt32(symbol + 4);
+            entry.size = ReadInt32(symbol + 8);
+            entry.type = ReadInt16(symbol + 12) & 0xF;
+            entry.sectionIndex = ReadInt16(symbol + 14);
+
+            symbols.push_back(entry);
+        }
+    }
+
+private:
+    const unsigned char *m_data;
+    std::size_t m_size;
+    const std::string& m_path;
+
+    void CheckBounds(std::size_t offset, std::size_t length)
+    {
+        if (offset > m_size || length > m_size - offset)
+            FATAL_ERROR("error: unexpected EOF when reading ELF file \"%s\"\n", m_path.c_str());
+    }
+
+    std::uint32_t ReadInt16(std::size_t offset)
+    {
+        CheckBounds(offset, 2);
+        return m_data[offset] | (m_data[offset + 1] << 8);
+    }
+
+    std::uint32_t ReadInt32(std::size_t offset)
+    {
+        CheckBounds(offset, 4);
+        return m_data[offset] | (m_data[offset + 1] << 8) | (m_data[offset + 2] << 16) | ((std::uint32_t)m_data[offset + 3] << 24);
+    }
+
+    const char *ReadString(std::size_t offset)
+    {
+        CheckBounds(offset, 1);
+
+        if (std::memchr(m_data + offset, 0, m_size - offset) == nullptr)
+            FATAL_ERROR("error: unexpected EOF when reading ELF file \"%s\"\n", m_path.c_str());
+
+        return reinterpret_cast<const char *>(m_data + offset);
+    }
+
+    void VerifyElfIdent()
+    {
+        unsigned char expectedMagic[4] = { 0x7F, 'E', 'L', 'F' };
+
+        if (m_size < 0x34)
+            FATAL_ERROR("error: failed to read ELF header from \"%s\"\n", m_path.c_str());
+
+        if (std::memcmp(m_data, expectedMagic, 4) != 0)
+            FATAL_ERROR("error: ELF magic did not match in \"%s\"\n", m_path.c_str());
+
+        if (m_data[4] != 1)
+            FATAL_ERROR("error: \"%s\" not 32-bit ELF\n", m_path.c_str());
+
+        if (m_data[5] != 1)
+            FATAL_ERROR("error: \"%s\" not little-endian ELF\n", m_path.c_str());
+    }
+};
+
+void ReadElfTables(const unsigned char *data, std::size_t size, const std::string& path,
+                   std::vector<ElfSectionHeader>& sections, std::vector<ElfSymbolEntry>& symbols)
+{
+    ElfReader reader(data, size, path);
+    reader.Read(sections, symbols);
+}
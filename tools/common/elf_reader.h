@@ -0,0 +1,44 @@
+#ifndef ELF_READER_H
+#define ELF_READER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Reads the section headers and symbol table of a 32-bit little-endian ELF
+// file that is already in memory. Every offset is checked against the
+// buffer's size, so a truncated or corrupt file is reported instead of read
+// past. Shared by ramscrgen and romsize.
+
+#define SHT_NOBITS 8
+#define SHF_ALLOC 0x2
+#define SHF_EXECINSTR 0x4
+#define STT_OBJECT 1
+#define STT_FUNC 2
+#define SHN_LORESERVE 0xFF00
+#define SHN_COMMON 0xFFF2
+
+struct ElfSectionHeader
+{
+    std::string name;
+    std::uint32_t type;
+    std::uint32_t flags;
+    std::uint32_t address;
+    std::uint32_t fileOffset;
+    std::uint32_t size;
+};
+
+struct ElfSymbolEntry
+{
+    std::string name;
+    std::uint32_t value;    // the alignment, for COMMON symbols
+    std::uint32_t size;
+    int type;
+    std::uint32_t sectionIndex;    // an index into the headers, or SHN_*
+};
+
+void ReadElfTables(const unsigned char *data, std::size_t size, const std::string& path,
+                   std::vector<ElfSectionHeader>& sections, std::vector<ElfSymbolEntry>& symbols);
+
+#endif // ELF_READER_H
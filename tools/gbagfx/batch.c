@@ -0,0 +1,297 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "global.h"
+#include "util.h"
+#include "batch.h"
+
+// Batch mode runs the conversions listed in a manifest on a pool of threads,
+// so that a build converting thousands of files doesn't start a process for
+// each one. Each manifest line holds the arguments of one gbagfx invocation:
+//
+//     INPUT_PATH OUTPUT_PATH [options...]
+//
+// Arguments are separated by whitespace. Blank lines and lines starting with
+// '#' are ignored. A job whose input is the output of an earlier job (e.g. a
+// .4bpp that is then compressed to .4bpp.lz) waits for that job to finish.
+//
+// Outputs whose contents wouldn't change aren't rewritten.
+
+struct BatchJob
+{
+    int argc;
+    char **argv;
+    int dependency; // index of the job that writes our input, or -1
+    bool done;
+};
+
+struct Batch
+{
+    struct BatchJob *jobs;
+    int numJobs;
+    int nextJob;
+    ConvertFunction convert;
+    pthread_mutex_t mutex;
+    pthread_cond_t jobDone;
+};
+
+static char *ReadManifest(char *path)
+{
+    FILE *fp = stdin;
+
+    if (path != NULL && strcmp(path, "-") != 0)
+    {
+        fp = fopen(path, "rb");
+
+        if (fp == NULL)
+            FATAL_ERROR("Failed to open \"%s\" for reading.\n", path);
+    }
+
+    size_t size = 0;
+    size_t capacity = 4096;
+    char *text = malloc(capacity);
+
+    if (text == NULL)
+        FATAL_ERROR("Failed to allocate memory for the batch manifest.\n");
+
+    for (;;)
+    {
+        if (capacity - size < 4096)
+        {
+            capacity *= 2;
+            text = realloc(text, capacity);
+
+            if (text == NULL)
+                FATAL_ERROR("Failed to allocate memory for the batch manifest.\n");
+        }
+
+        size_t count = fread(text + size, 1, capacity - size - 1, fp);
+
+        if (count == 0)
+            break;
+
+        size += count;
+    }
+
+    if (ferror(fp))
+        FATAL_ERROR("Failed to read the batch manifest.\n");
+
+    if (fp != stdin)
+        fclose(fp);
+
+    text[size] = 0;
+    return text;
+}
+
+// Splits the manifest into jobs in place.
+static void ParseManifest(char *text, struct Batch *batch)
+{
+    int capacity = 256;
+
+    batch->jobs = malloc(capacity * sizeof(struct BatchJob));
+    batch->numJobs = 0;
+
+    if (batch->jobs == NULL)
+        FATAL_ERROR("Failed to allocate memory for the batch jobs.\n");
+
+    while (*text != 0)
+    {
+        char *line = text;
+        char *lineEnd = strchr(text, '\n');
+
+        if (lineEnd != NULL)
+        {
+            *lineEnd = 0;
+            text = lineEnd + 1;
+        }
+        else
+        {
+            text += strlen(text);
+        }
+
+        while (isspace((unsigned char)*line))
+            line++;
+
+        if (*line == 0 || *line == '#')
+            continue;
+
+        // The first element stands in for the program name, so the job's
+        // arguments are laid out exactly like a command line.
+        int argCapacity = 8;
+        int argc = 1;
+        char **argv = malloc(argCapacity * sizeof(char *));
+
+        if (argv == NULL)
+            FATAL_ERROR("Failed to allocate memory for the batch jobs.\n");
+
+        argv[0] = "gbagfx";
+
+        while (*line != 0)
+        {
+            if (argc + 1 >= argCapacity)
+            {
+                argCapacity *= 2;
+                argv = realloc(argv, argCapacity * sizeof(char *));
+
+                if (argv == NULL)
+                    FATAL_ERROR("Failed to allocate memory for the batch jobs.\n");
+            }
+
+            argv[argc++] = line;
+
+            while (*line != 0 && !isspace((unsigned char)*line))
+                line++;
+
+            while (isspace((unsigned char)*line))
+                *line++ = 0;
+        }
+
+        argv[argc] = NULL;
+
+        if (argc < 3)
+            FATAL_ERROR("Batch job \"%s\" has no output path.\n", argv[1]);
+
+        if (batch->numJobs == capacity)
+        {
+            capacity *= 2;
+            batch->jobs = realloc(batch->jobs, capacity * sizeof(struct BatchJob));
+
+            if (batch->jobs == NULL)
+                FATAL_ERROR("Failed to allocate memory for the batch jobs.\n");
+        }
+
+        struct BatchJob *job = &batch->jobs[batch->numJobs];
+
+        job->argc = argc;
+        job->argv = argv;
+        job->dependency = -1;
+        job->done = false;
+
+        for (int i = batch->numJobs - 1; i >= 0; i--)
+        {
+            if (strcmp(batch->jobs[i].argv[2], argv[1]) == 0)
+            {
+                job->dependency = i;
+                break;
+            }
+        }
+
+        batch->numJobs++;
+    }
+}
+
+static void *BatchWorker(void *arg)
+{
+    struct Batch *batch = arg;
+
+    pthread_mutex_lock(&batch->mutex);
+
+    while (batch->nextJob < batch->numJobs)
+    {
+        struct BatchJob *job = &batch->jobs[batch->nextJob++];
+
+        // Jobs are handed out in order, so a dependency has already been
+        // taken by some thread and will finish without our help.
+        while (job->dependency >= 0 && !batch->jobs[job->dependency].done)
+            pthread_cond_wait(&batch->jobDone, &batch->mutex);
+
+        pthread_mutex_unlock(&batch->mutex);
+        batch->convert(job->argc, job->argv);
+        pthread_mutex_lock(&batch->mutex);
+
+        job->done = true;
+        pthread_cond_broadcast(&batch->jobDone);
+    }
+
+    pthread_mutex_unlock(&batch->mutex);
+
+    return NULL;
+}
+
+static int GetDefaultThreadCount(void)
+{
+#ifdef _SC_NPROCESSORS_ONLN
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (count > 0)
+        return count;
+#endif
+    return 1;
+}
+
+int RunBatch(int argc, char **argv, ConvertFunction convert)
+{
+    int numThreads = GetDefaultThreadCount();
+    char *manifestPath = NULL;
+
+    for (int i = 2; i < argc; i++)
+    {
+        char *option = argv[i];
+
+        if (strcmp(option, "-j") == 0)
+        {
+            if (i + 1 >= argc)
+                FATAL_ERROR("No thread count following \"-j\".\n");
+
+            i++;
+
+            if (!ParseNumber(argv[i], NULL, 10, &numThreads))
+                FATAL_ERROR("Failed to parse thread count.\n");
+
+            if (numThreads < 1)
+                FATAL_ERROR("Thread count must be positive.\n");
+        }
+        else if (manifestPath == NULL)
+        {
+            manifestPath = option;
+        }
+        else
+        {
+            FATAL_ERROR("Unrecognized option \"%s\".\n", option);
+        }
+    }
+
+    struct Batch batch;
+    char *manifest = ReadManifest(manifestPath);
+
+    ParseManifest(manifest, &batch);
+    batch.nextJob = 0;
+    batch.convert = convert;
+    pthread_mutex_init(&batch.mutex, NULL);
+    pthread_cond_init(&batch.jobDone, NULL);
+
+    gSkipUnchangedWrites = true;
+
+    if (numThreads > batch.numJobs)
+        numThreads = batch.numJobs;
+
+    pthread_t *threads = malloc(numThreads * sizeof(pthread_t));
+
+    if (threads == NULL && numThreads != 0)
+        FATAL_ERROR("Failed to allocate memory for the batch threads.\n");
+
+    for (int i = 0; i < numThreads; i++)
+        if (pthread_create(&threads[i], NULL, BatchWorker, &batch) != 0)
+            FATAL_ERROR("Failed to start a batch thread.\n");
+
+    for (int i = 0; i < numThreads; i++)
+        pthread_join(threads[i], NULL);
+
+    pthread_cond_destroy(&batch.jobDone);
+    pthread_mutex_destroy(&batch.mutex);
+
+    for (int i = 0; i < batch.numJobs; i++)
+        free(batch.jobs[i].argv);
+
+    free(batch.jobs);
+    free(threads);
+    free(manifest);
+
+    return 0;
+}
@@ -1,6 +1,7 @@
 // Copyright (c) 2015 YamaArashi
 
 #include <stdio.h>
+#include <string.h>
 #include <setjmp.h>
 #include <png.h>
 #include "global.h"
@@ -137,6 +138,90 @@ void ReadPng(char *path, struct Image *image)
     }
 }
 
+// Reads any PNG as 8-bit RGBA. In an indexed image, color 0 is transparent,
+// as it is on the GBA. Otherwise, only the image's own alpha is used.
+unsigned char *ReadPngRgba(char *path, int *width, int *height)
+{
+    png_structp png_ptr;
+    png_infop info_ptr;
+
+    FILE *fp = PngReadOpen(path, &png_ptr, &info_ptr);
+
+    int color_type = png_get_color_type(png_ptr, info_ptr);
+    png_colorp colors = NULL;
+    int numColors = 0;
+
+    if (color_type == PNG_COLOR_TYPE_PALETTE)
+    {
+        if (png_get_PLTE(png_ptr, info_ptr, &colors, &numColors) != PNG_INFO_PLTE)
+            FATAL_ERROR("Failed to retrieve palette from \"%s\".\n", path);
+
+        // Keep the indices, one per byte, to look them up below.
+        png_set_packing(png_ptr);
+    }
+    else
+    {
+        png_set_expand(png_ptr);
+        png_set_strip_16(png_ptr);
+        png_set_gray_to_rgb(png_ptr);
+        png_set_add_alpha(png_ptr, 0xFF, PNG_FILLER_AFTER);
+    }
+
+    png_read_update_info(png_ptr, info_ptr);
+
+    *width = png_get_image_width(png_ptr, info_ptr);
+    *height = png_get_image_height(png_ptr, info_ptr);
+
+    int rowbytes = png_get_rowbytes(png_ptr, info_ptr);
+    unsigned char *data = malloc(*height * rowbytes);
+    unsigned char *pixels = malloc(*width * *height * 4);
+    png_bytepp row_pointers = malloc(*height * sizeof(png_bytep));
+
+    if (data == NULL || pixels == NULL || row_pointers == NULL)
+        FATAL_ERROR("Failed to allocate pixel buffer.\n");
+
+    for (int i = 0; i < *height; i++)
+        row_pointers[i] = (png_bytep)(data + (i * rowbytes));
+
+    if (setjmp(png_jmpbuf(png_ptr)))
+        FATAL_ERROR("Error reading from \"%s\".\n", path);
+
+    png_read_image(png_ptr, row_pointers);
+
+    if (color_type == PNG_COLOR_TYPE_PALETTE)
+    {
+        for (int y = 0; y < *height; y++)
+        {
+            for (int x = 0; x < *width; x++)
+            {
+                int index = data[y * rowbytes + x];
+                unsigned char *pixel = &pixels[(y * *width + x) * 4];
+
+                if (index >= numColors)
+                    FATAL_ERROR("\"%s\" uses color %d, which isn't in its palette.\n", path, index);
+
+                pixel[0] = colors[index].red;
+                pixel[1] = colors[index].green;
+                pixel[2] = colors[index].blue;
+                pixel[3] = index == 0 ? 0 : 0xFF;
+            }
+        }
+    }
+    else
+    {
+        for (int y = 0; y < *height; y++)
+            memcpy(&pixels[y * *width * 4], &data[y * rowbytes], *width * 4);
+    }
+
+    png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+
+    free(row_pointers);
+    free(data);
+    fclose(fp);
+
+    return pixels;
+}
+
 void ReadPngPalette(char *path, struct Palette *palette)
 {
     png_structp png_ptr;
@@ -7,6 +7,7 @@
 
 void ReadPng(char *path, struct Image *image);
 void WritePng(char *path, struct Image *image);
+unsigned char *ReadPngRgba(char *path, int *width, int *height);
 void ReadPngPalette(char *path, struct Palette *palette);
 
 #endif // CONVERT_PNG_H
@@ -345,6 +345,219 @@ static unsigned char *DecodeTilemap(unsigned char *tiles, struct Tilemap *tilema
     return decoded;
 }
 
+static unsigned int HashTile(unsigned char *tile, int tileSize)
+{
+    unsigned int hash = 2166136261u;
+
+    for (int i = 0; i < tileSize; i++)
+    {
+        hash ^= tile[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+// Looks tile up in a table of the unique tiles found so far, which is an
+// open-addressed hash table of indices into uniqueTiles, with -1 for empty
+// slots. Returns the tile's index, or -1 if it isn't there.
+static int FindTile(unsigned char *tile, unsigned char *uniqueTiles, int *table, int tableMask, int tileSize, unsigned int hash)
+{
+    for (int slot = hash & tableMask; table[slot] != -1; slot = (slot + 1) & tableMask)
+    {
+        if (memcmp(&uniqueTiles[table[slot] * tileSize], tile, tileSize) == 0)
+            return table[slot];
+    }
+
+    return -1;
+}
+
+// Replaces repeated tiles with references to a single copy, producing the
+// tilemap that puts them back in their original order. Unless the map is
+// affine, a tile also matches an earlier tile that's a horizontal or vertical
+// mirror image of it, and its map entry sets the flip bits. paletteNumbers,
+// if not NULL, gives the palette for each map entry. Takes ownership of tiles
+// and returns the unique tiles.
+unsigned char *DeduplicateTiles(unsigned char *tiles, int numTiles, int bitDepth, bool isAffine, unsigned char *paletteNumbers, struct Tilemap *tilemap, int *numUniqueTiles_p)
+{
+    int tileSize = bitDepth * 8;
+    int maxUniqueTiles = isAffine ? 256 : 1024;
+    int tableSize = 1;
+
+    while (tableSize < numTiles * 2)
+        tableSize *= 2;
+
+    int *table = malloc(tableSize * sizeof(int));
+    unsigned char *uniqueTiles = malloc(numTiles * tileSize);
+    int mapTileSize = isAffine ? 1 : 2;
+
+    tilemap->size = numTiles * mapTileSize;
+    tilemap->data.affine = calloc(numTiles, mapTileSize);
+
+    if (table == NULL || uniqueTiles == NULL || tilemap->data.affine == NULL)
+        FATAL_ERROR("Failed to allocate memory for tile deduplication.\n");
+
+    memset(table, -1, tableSize * sizeof(int));
+
+    int numUniqueTiles = 0;
+
+    for (int i = 0; i < numTiles; i++)
+    {
+        unsigned char *tile = &tiles[i * tileSize];
+        unsigned char flipped[64];
+        int index = -1;
+        int flips;
+
+        // Tries the tile as it is, then flipped horizontally, vertically and
+        // both ways. Each flip undoes itself, so if a flipped copy of this
+        // tile matches, flipping the match the same way gives back the tile.
+        memcpy(flipped, tile, tileSize);
+
+        for (flips = 0; flips < (isAffine ? 1 : 4); flips++)
+        {
+            if (flips == 1 || flips == 3)
+                HflipTile(flipped, bitDepth);
+            else if (flips == 2)
+            {
+                HflipTile(flipped, bitDepth);
+                VflipTile(flipped, bitDepth);
+            }
+
+            index = FindTile(flipped, uniqueTiles, table, tableSize - 1, tileSize, HashTile(flipped, tileSize));
+
+            if (index != -1)
+                break;
+        }
+
+        if (index == -1)
+        {
+            unsigned int hash = HashTile(tile, tileSize);
+            int slot = hash & (tableSize - 1);
+
+            if (numUniqueTiles == maxUniqueTiles)
+                FATAL_ERROR("There are more than %d unique tiles, which is more than a%s tilemap can refer to.\n",
+                    maxUniqueTiles, isAffine ? "n affine" : "");
+
+            while (table[slot] != -1)
+                slot = (slot + 1) & (tableSize - 1);
+
+            index = numUniqueTiles++;
+            table[slot] = index;
+            memcpy(&uniqueTiles[index * tileSize], tile, tileSize);
+            flips = 0;
+        }
+
+        if (isAffine)
+        {
+            tilemap->data.affine[i] = index;
+        }
+        else
+        {
+            tilemap->data.non_affine[i].index = index;
+            tilemap->data.non_affine[i].hflip = flips & 1;
+            tilemap->data.non_affine[i].vflip = flips >> 1;
+            tilemap->data.non_affine[i].palno = paletteNumbers ? paletteNumbers[i] : 0;
+        }
+    }
+
+    free(table);
+    free(tiles);
+    *numUniqueTiles_p = numUniqueTiles;
+    return realloc(uniqueTiles, numUniqueTiles ? numUniqueTiles * tileSize : 1);
+}
+
+// Writes a frame of frameWidth x frameHeight tiles mirrored horizontally
+// and/or vertically. The tiles of a frame are stored in rows.
+static void FlipFrame(unsigned char *frame, unsigned char *flipped, int frameWidth, int frameHeight, int bitDepth, bool hflip, bool vflip)
+{
+    int tileSize = bitDepth * 8;
+
+    for (int y = 0; y < frameHeight; y++)
+    {
+        for (int x = 0; x < frameWidth; x++)
+        {
+            int srcX = hflip ? frameWidth - 1 - x : x;
+            int srcY = vflip ? frameHeight - 1 - y : y;
+            unsigned char *tile = &flipped[(y * frameWidth + x) * tileSize];
+
+            memcpy(tile, &frame[(srcY * frameWidth + srcX) * tileSize], tileSize);
+
+            if (hflip)
+                HflipTile(tile, bitDepth);
+            if (vflip)
+                VflipTile(tile, bitDepth);
+        }
+    }
+}
+
+// Removes animation frames that repeat an earlier frame exactly, filling in
+// frames[] with where each frame's data ends up. A frame that's a mirror
+// image of an earlier one is kept, since a frame table can't flip it, but
+// is noted in frames[] so the animation could use the flip bits instead.
+// Takes ownership of tiles and returns the remaining frames.
+unsigned char *DeduplicateFrames(unsigned char *tiles, int numFrames, int frameWidth, int frameHeight, int bitDepth, struct FrameInfo *frames, int *numUniqueFrames_p)
+{
+    int frameSize = frameWidth * frameHeight * bitDepth * 8;
+    unsigned char *uniqueFrames = malloc(numFrames ? numFrames * frameSize : 1);
+    unsigned char *flipped = malloc(frameSize);
+    int *uniqueFrameNumbers = malloc((numFrames ? numFrames : 1) * sizeof(int));
+
+    if (uniqueFrames == NULL || flipped == NULL || uniqueFrameNumbers == NULL)
+        FATAL_ERROR("Failed to allocate memory for frame deduplication.\n");
+
+    int numUniqueFrames = 0;
+
+    for (int i = 0; i < numFrames; i++)
+    {
+        unsigned char *frame = &tiles[i * frameSize];
+
+        frames[i].duplicateOf = -1;
+        frames[i].mirrorOf = -1;
+        frames[i].hflip = false;
+        frames[i].vflip = false;
+
+        for (int j = 0; j < numUniqueFrames; j++)
+        {
+            if (memcmp(&uniqueFrames[j * frameSize], frame, frameSize) == 0)
+            {
+                frames[i].duplicateOf = uniqueFrameNumbers[j];
+                frames[i].offset = j * frameSize;
+                break;
+            }
+        }
+
+        if (frames[i].duplicateOf != -1)
+            continue;
+
+        for (int flips = 1; flips < 4 && frames[i].mirrorOf == -1; flips++)
+        {
+            FlipFrame(frame, flipped, frameWidth, frameHeight, bitDepth, flips & 1, flips >> 1);
+
+            for (int j = 0; j < numUniqueFrames; j++)
+            {
+                if (memcmp(&uniqueFrames[j * frameSize], flipped, frameSize) == 0)
+                {
+                    frames[i].mirrorOf = uniqueFrameNumbers[j];
+                    frames[i].hflip = flips & 1;
+                    frames[i].vflip = flips >> 1;
+                    break;
+                }
+            }
+        }
+
+        frames[i].offset = numUniqueFrames * frameSize;
+        uniqueFrameNumbers[numUniqueFrames] = i;
+        memcpy(&uniqueFrames[numUniqueFrames * frameSize], frame, frameSize);
+        numUniqueFrames++;
+    }
+
+    free(flipped);
+    free(uniqueFrameNumbers);
+    free(tiles);
+    *numUniqueFrames_p = numUniqueFrames;
+    return uniqueFrames;
+}
+
 void ReadImage(char *path, int tilesWidth, int bitDepth, int metatileWidth, int metatileHeight, struct Image *image, bool invertColors)
 {
 	int tileSize = bitDepth * 8;
@@ -397,7 +610,7 @@ void ReadImage(char *path, int tilesWidth, int bitDepth, int metatileWidth, int
 	free(buffer);
 }
 
-void WriteImage(char *path, int numTiles, int bitDepth, int metatileWidth, int metatileHeight, struct Image *image, bool invertColors)
+unsigned char *ConvertImageToTiles(int numTiles, int bitDepth, int metatileWidth, int metatileHeight, struct Image *image, bool invertColors, int *bufferSize_p)
 {
 	int tileSize = bitDepth * 8;
 
@@ -443,6 +656,15 @@ void WriteImage(char *path, int numTiles, int bitDepth, int metatileWidth, int m
 		break;
 	}
 
+	*bufferSize_p = bufferSize;
+	return buffer;
+}
+
+void WriteImage(char *path, int numTiles, int bitDepth, int metatileWidth, int metatileHeight, struct Image *image, bool invertColors)
+{
+	int bufferSize;
+	unsigned char *buffer = ConvertImageToTiles(numTiles, bitDepth, metatileWidth, metatileHeight, image, invertColors, &bufferSize);
+
 	WriteWholeFile(path, buffer, bufferSize);
 
 	free(buffer);
@@ -487,10 +709,7 @@ void ReadGbaPalette(char *path, struct Palette *palette)
 
 void WriteGbaPalette(char *path, struct Palette *palette)
 {
-	FILE *fp = fopen(path, "wb");
-
-	if (fp == NULL)
-		FATAL_ERROR("Failed to open \"%s\" for writing.\n", path);
+	unsigned char data[256 * 2];
 
 	for (int i = 0; i < palette->numColors; i++) {
 		unsigned char red = DOWNCONVERT_BIT_DEPTH(palette->colors[i].red);
@@ -499,9 +718,9 @@ void WriteGbaPalette(char *path, struct Palette *palette)
 
 		uint16_t paletteEntry = SET_GBA_PAL(red, green, blue);
 
-		fputc(paletteEntry & 0xFF, fp);
-		fputc(paletteEntry >> 8, fp);
+		data[i * 2] = paletteEntry & 0xFF;
+		data[i * 2 + 1] = paletteEntry >> 8;
 	}
 
-	fclose(fp);
+	WriteWholeFile(path, data, palette->numColors * 2);
 }
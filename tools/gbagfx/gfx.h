@@ -32,6 +32,14 @@ struct Tilemap {
     int size;
 };
 
+struct FrameInfo {
+    int offset;      // where the frame's data is, in bytes
+    int duplicateOf; // the earlier frame with the same data, or -1
+    int mirrorOf;    // an earlier frame that this one mirrors, or -1
+    bool hflip;
+    bool vflip;
+};
+
 struct Image {
 	int width;
 	int height;
@@ -45,6 +53,9 @@ struct Image {
 };
 
 void ReadImage(char *path, int tilesWidth, int bitDepth, int metatileWidth, int metatileHeight, struct Image *image, bool invertColors);
+unsigned char *ConvertImageToTiles(int numTiles, int bitDepth, int metatileWidth, int metatileHeight, struct Image *image, bool invertColors, int *bufferSize_p);
+unsigned char *DeduplicateTiles(unsigned char *tiles, int numTiles, int bitDepth, bool isAffine, unsigned char *paletteNumbers, struct Tilemap *tilemap, int *numUniqueTiles_p);
+unsigned char *DeduplicateFrames(unsigned char *tiles, int numFrames, int frameWidth, int frameHeight, int bitDepth, struct FrameInfo *frames, int *numUniqueFrames_p);
 void WriteImage(char *path, int numTiles, int bitDepth, int metatileWidth, int metatileHeight, struct Image *image, bool invertColors);
 void FreeImage(struct Image *image);
 void ReadGbaPalette(char *path, struct Palette *palette);
@@ -342,6 +342,56 @@ fail:
     FATAL_ERROR("Fatal error while compressing Huff file.\n");
 }
 
+// Returns the size HuffCompress would produce, without building the encoded
+// tree, so it can't fail on trees that HuffCompress is unable to encode.
+// Every Huffman tree for the same frequencies has the same encoded length.
+int HuffCompressedSize(unsigned char * src, int srcSize, int bitDepth) {
+    int nitems = 1 << bitDepth;
+    long long freqs[256] = {0};
+    long long totalBits = 0;
+    int used = 0;
+
+    for (int i = 0; i < srcSize; i++) {
+        if (bitDepth == 8) {
+            freqs[src[i]]++;
+        } else {
+            freqs[src[i] >> 4]++;
+            freqs[src[i] & 0xF]++;
+        }
+    }
+
+    // Pack the used symbols together, then repeatedly merge the two least
+    // frequent. Each merge adds one bit to every symbol below it, which
+    // totals the merged frequency.
+    for (int i = 0; i < nitems; i++)
+        if (freqs[i] != 0)
+            freqs[used++] = freqs[i];
+
+    for (int count = used; count > 1; count--) {
+        int a = 0, b = 1;
+
+        if (freqs[b] < freqs[a]) {
+            a = 1;
+            b = 0;
+        }
+
+        for (int i = 2; i < count; i++) {
+            if (freqs[i] < freqs[a]) {
+                b = a;
+                a = i;
+            } else if (freqs[i] < freqs[b]) {
+                b = i;
+            }
+        }
+
+        freqs[a] += freqs[b];
+        totalBits += freqs[a];
+        freqs[b] = freqs[count - 1];
+    }
+
+    return ((4 + used * 2 + 3) & ~3) + (int)((totalBits + 31) / 32) * 4;
+}
+
 unsigned char * HuffDecompress(unsigned char * src, int srcSize, int * uncompressedSize_p) {
     if (srcSize < 4)
         goto fail;
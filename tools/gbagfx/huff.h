@@ -33,6 +33,7 @@ struct BitEncoding {
 };
 
 unsigned char * HuffCompress(unsigned char * buffer, int srcSize, int * compressedSize_p, int bitDepth);
+int HuffCompressedSize(unsigned char * buffer, int srcSize, int bitDepth);
 unsigned char * HuffDecompress(unsigned char * buffer, int srcSize, int * uncompressedSize_p);
 
 #endif //HUFF_H
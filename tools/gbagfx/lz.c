@@ -69,85 +69,251 @@ fail:
 	FATAL_ERROR("Fatal error while decompressing LZ file.\n");
 }
 
-unsigned char *LZCompress(unsigned char *src, int srcSize, int *compressedSize, const int minDistance)
+#define LZ_MIN_MATCH 3
+#define LZ_MAX_MATCH 18
+#define LZ_MAX_DISTANCE 0x1000
+#define LZ_HASH_BITS 14
+
+// Finds matches using hash chains of the positions that start with the same
+// three bytes. The chains are ordered from the nearest position to the
+// farthest, so the first longest match found has the smallest distance, just
+// like a brute-force scan from the minimum distance upwards.
+struct LZMatchFinder {
+	unsigned char *src;
+	int srcSize;
+	int minDistance;
+	int *head;
+	int *prev;
+	int insertPos;
+};
+
+static int LZHash(unsigned char *p)
 {
-	if (srcSize <= 0)
-		goto fail;
+	unsigned int key = (p[0] << 16) | (p[1] << 8) | p[2];
+	return (key * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+static void LZInitMatchFinder(struct LZMatchFinder *finder, unsigned char *src, int srcSize, int minDistance)
+{
+	finder->src = src;
+	finder->srcSize = srcSize;
+	finder->minDistance = minDistance;
+	finder->head = malloc(sizeof(int) << LZ_HASH_BITS);
+	finder->prev = malloc(sizeof(int) * srcSize);
+	finder->insertPos = 0;
+
+	if (finder->head == NULL || finder->prev == NULL)
+		FATAL_ERROR("Failed to allocate memory for LZ match finder.\n");
+
+	for (int i = 0; i < (1 << LZ_HASH_BITS); i++)
+		finder->head[i] = -1;
+}
+
+static void LZFreeMatchFinder(struct LZMatchFinder *finder)
+{
+	free(finder->head);
+	free(finder->prev);
+}
+
+// Returns the length of the longest match for the data at srcPos, and its
+// distance through bestDistance. Must be called with increasing positions.
+static int LZFindMatch(struct LZMatchFinder *finder, int srcPos, int *bestDistance)
+{
+	unsigned char *src = finder->src;
+	int maxSize = finder->srcSize - srcPos;
+	int bestSize = 0;
+
+	if (maxSize < LZ_MIN_MATCH)
+		return 0;
+
+	if (maxSize > LZ_MAX_MATCH)
+		maxSize = LZ_MAX_MATCH;
+
+	while (finder->insertPos < srcPos) {
+		int hash = LZHash(&src[finder->insertPos]);
+		finder->prev[finder->insertPos] = finder->head[hash];
+		finder->head[hash] = finder->insertPos;
+		finder->insertPos++;
+	}
+
+	for (int blockStart = finder->head[LZHash(&src[srcPos])];
+	     blockStart >= 0 && srcPos - blockStart <= LZ_MAX_DISTANCE;
+	     blockStart = finder->prev[blockStart]) {
+		if (srcPos - blockStart < finder->minDistance)
+			continue;
+
+		int blockSize = 0;
+
+		while (blockSize < maxSize && src[blockStart + blockSize] == src[srcPos + blockSize])
+			blockSize++;
 
+		if (blockSize > bestSize) {
+			*bestDistance = srcPos - blockStart;
+			bestSize = blockSize;
+
+			if (blockSize == maxSize)
+				break;
+		}
+	}
+
+	return bestSize;
+}
+
+struct LZWriter {
+	unsigned char *dest;
+	int destPos;
+	int flagsPos;
+	int blockCount;
+};
+
+static void LZInitWriter(struct LZWriter *writer, int srcSize)
+{
 	int worstCaseDestSize = 4 + srcSize + ((srcSize + 7) / 8);
 
 	// Round up to the next multiple of four.
 	worstCaseDestSize = (worstCaseDestSize + 3) & ~3;
 
-	unsigned char *dest = malloc(worstCaseDestSize);
+	writer->dest = malloc(worstCaseDestSize);
 
-	if (dest == NULL)
-		goto fail;
+	if (writer->dest == NULL)
+		FATAL_ERROR("Fatal error while compressing LZ file.\n");
 
 	// header
-	dest[0] = 0x10; // LZ compression type
-	dest[1] = (unsigned char)srcSize;
-	dest[2] = (unsigned char)(srcSize >> 8);
-	dest[3] = (unsigned char)(srcSize >> 16);
+	writer->dest[0] = 0x10; // LZ compression type
+	writer->dest[1] = (unsigned char)srcSize;
+	writer->dest[2] = (unsigned char)(srcSize >> 8);
+	writer->dest[3] = (unsigned char)(srcSize >> 16);
+
+	writer->destPos = 4;
+	writer->flagsPos = 0;
+	writer->blockCount = 0;
+}
+
+// Each group of eight literals or blocks is preceded by a byte of flags.
+static void LZStartBlock(struct LZWriter *writer, bool isCompressed)
+{
+	if (writer->blockCount % 8 == 0) {
+		writer->flagsPos = writer->destPos++;
+		writer->dest[writer->flagsPos] = 0;
+	}
 
+	if (isCompressed)
+		writer->dest[writer->flagsPos] |= (0x80 >> (writer->blockCount % 8));
+
+	writer->blockCount++;
+}
+
+static void LZWriteLiteral(struct LZWriter *writer, unsigned char c)
+{
+	LZStartBlock(writer, false);
+	writer->dest[writer->destPos++] = c;
+}
+
+static void LZWriteBlock(struct LZWriter *writer, int blockSize, int blockDistance)
+{
+	LZStartBlock(writer, true);
+	blockSize -= 3;
+	blockDistance--;
+	writer->dest[writer->destPos++] = (blockSize << 4) | ((unsigned int)blockDistance >> 8);
+	writer->dest[writer->destPos++] = (unsigned char)blockDistance;
+}
+
+static unsigned char *LZFinishWriter(struct LZWriter *writer, int *compressedSize)
+{
+	// Pad to multiple of 4 bytes.
+	while (writer->destPos % 4 != 0)
+		writer->dest[writer->destPos++] = 0;
+
+	*compressedSize = writer->destPos;
+	return writer->dest;
+}
+
+// Greedy parse that always takes the longest match at the nearest distance.
+// The output has to stay identical to the original games' compressor.
+unsigned char *LZCompress(unsigned char *src, int srcSize, int *compressedSize, const int minDistance)
+{
+	if (srcSize <= 0)
+		FATAL_ERROR("Fatal error while compressing LZ file.\n");
+
+	struct LZMatchFinder finder;
+	struct LZWriter writer;
 	int srcPos = 0;
-	int destPos = 4;
 
-	for (;;) {
-		unsigned char *flags = &dest[destPos++];
-		*flags = 0;
+	LZInitMatchFinder(&finder, src, srcSize, minDistance);
+	LZInitWriter(&writer, srcSize);
 
-		for (int i = 0; i < 8; i++) {
-			int bestBlockDistance = 0;
-			int bestBlockSize = 0;
-			int blockDistance = minDistance;
+	while (srcPos < srcSize) {
+		int blockDistance;
+		int blockSize = LZFindMatch(&finder, srcPos, &blockDistance);
+
+		if (blockSize >= LZ_MIN_MATCH) {
+			LZWriteBlock(&writer, blockSize, blockDistance);
+			srcPos += blockSize;
+		} else {
+			LZWriteLiteral(&writer, src[srcPos++]);
+		}
+	}
 
-			while (blockDistance <= srcPos && blockDistance <= 0x1000) {
-				int blockStart = srcPos - blockDistance;
-				int blockSize = 0;
+	LZFreeMatchFinder(&finder);
 
-				while (blockSize < 18
-				    && srcPos + blockSize < srcSize
-				    && src[blockStart + blockSize] == src[srcPos + blockSize])
-					blockSize++;
+	return LZFinishWriter(&writer, compressedSize);
+}
 
-				if (blockSize > bestBlockSize) {
-					bestBlockDistance = blockDistance;
-					bestBlockSize = blockSize;
+// Finds the parse with the smallest output. A literal costs 9 bits and a block
+// 17 bits (counting its flag bit), and any length up to the longest match at a
+// position can be used, so the cheapest parse of each suffix of the data can
+// be found by working backwards from the end.
+unsigned char *LZCompressOptimal(unsigned char *src, int srcSize, int *compressedSize, const int minDistance)
+{
+	if (srcSize <= 0)
+		FATAL_ERROR("Fatal error while compressing LZ file.\n");
 
-					if (blockSize == 18)
-						break;
-				}
+	struct LZMatchFinder finder;
+	struct LZWriter writer;
+	int *matchSizes = malloc(sizeof(int) * srcSize);
+	int *matchDistances = malloc(sizeof(int) * srcSize);
+	int *costs = malloc(sizeof(int) * (srcSize + 1));
+	int *choices = malloc(sizeof(int) * srcSize);
 
-				blockDistance++;
-			}
+	if (matchSizes == NULL || matchDistances == NULL || costs == NULL || choices == NULL)
+		FATAL_ERROR("Failed to allocate memory for LZ parse.\n");
 
-			if (bestBlockSize >= 3) {
-				*flags |= (0x80 >> i);
-				srcPos += bestBlockSize;
-				bestBlockSize -= 3;
-				bestBlockDistance--;
-				dest[destPos++] = (bestBlockSize << 4) | ((unsigned int)bestBlockDistance >> 8);
-				dest[destPos++] = (unsigned char)bestBlockDistance;
-			} else {
-				dest[destPos++] = src[srcPos++];
-			}
+	LZInitMatchFinder(&finder, src, srcSize, minDistance);
 
-			if (srcPos == srcSize) {
-				// Pad to multiple of 4 bytes.
-				int remainder = destPos % 4;
+	for (int i = 0; i < srcSize; i++)
+		matchSizes[i] = LZFindMatch(&finder, i, &matchDistances[i]);
 
-				if (remainder != 0) {
-					for (int i = 0; i < 4 - remainder; i++)
-						dest[destPos++] = 0;
-				}
+	LZFreeMatchFinder(&finder);
 
-				*compressedSize = destPos;
-				return dest;
+	costs[srcSize] = 0;
+
+	for (int i = srcSize - 1; i >= 0; i--) {
+		costs[i] = 9 + costs[i + 1];
+		choices[i] = 1;
+
+		for (int blockSize = LZ_MIN_MATCH; blockSize <= matchSizes[i]; blockSize++) {
+			int cost = 17 + costs[i + blockSize];
+
+			if (cost <= costs[i]) {
+				costs[i] = cost;
+				choices[i] = blockSize;
 			}
 		}
 	}
 
-fail:
-	FATAL_ERROR("Fatal error while compressing LZ file.\n");
+	LZInitWriter(&writer, srcSize);
+
+	for (int srcPos = 0; srcPos < srcSize; srcPos += choices[srcPos]) {
+		if (choices[srcPos] >= LZ_MIN_MATCH)
+			LZWriteBlock(&writer, choices[srcPos], matchDistances[srcPos]);
+		else
+			LZWriteLiteral(&writer, src[srcPos]);
+	}
+
+	free(matchSizes);
+	free(matchDistances);
+	free(costs);
+	free(choices);
+
+	return LZFinishWriter(&writer, compressedSize);
 }
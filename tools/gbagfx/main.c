@@ -13,6 +13,9 @@
 #include "rl.h"
 #include "font.h"
 #include "huff.h"
+#include "batch.h"
+#include "asset_cache.h"
+#include "quantize.h"
 
 struct CommandHandler
 {
@@ -68,18 +71,215 @@ void ConvertGbaToPng(char *inputPath, char *outputPath, struct GbaToPngOptions *
     FreeImage(&image);
 }
 
-void ConvertPngToGba(char *inputPath, char *outputPath, struct PngToGbaOptions *options)
+// Removes repeated tiles from size bytes of tiles, writes the tilemap that
+// rebuilds the image from the rest to options->tilemapFilePath, and prints
+// how much was saved. paletteNumbers gives each tile's palette, or is NULL
+// to use palette 0. Takes ownership of tiles and returns the unique tiles.
+unsigned char *WriteDeduplicatedTilemap(char *inputPath, unsigned char *tiles, int *size, unsigned char *paletteNumbers, struct PngToGbaOptions *options)
+{
+    int tileSize = options->bitDepth * 8;
+    int numTiles = *size / tileSize;
+    int numUniqueTiles;
+    struct Tilemap tilemap;
+
+    if (options->isAffineMap && options->bitDepth != 8)
+        FATAL_ERROR("affine maps are necessarily 8bpp\n");
+
+    tiles = DeduplicateTiles(tiles, numTiles, options->bitDepth, options->isAffineMap, paletteNumbers, &tilemap, &numUniqueTiles);
+
+    WriteWholeFile(options->tilemapFilePath, tilemap.data.affine, tilemap.size);
+
+    free(tilemap.data.affine);
+
+    *size = numUniqueTiles * tileSize;
+
+    printf("%s: %d tiles, %d unique; %d tile bytes + %d map bytes = %d (%d saved)\n",
+        inputPath, numTiles, numUniqueTiles, *size, tilemap.size, *size + tilemap.size,
+        numTiles * tileSize - *size - tilemap.size);
+
+    return tiles;
+}
+
+// Reads a PNG in any format and picks up to options->numPalettes palettes
+// for it, which are written to options->paletteFilePath. Returns each tile's
+// palette number, in the order the tiles will be written.
+unsigned char *ReadQuantizedPng(char *inputPath, struct Image *image, struct PngToGbaOptions *options)
+{
+    if (options->bitDepth != 4)
+        FATAL_ERROR("Only 4bpp tiles can use more than one palette.\n");
+
+    if (options->tilemapFilePath == NULL || options->isAffineMap)
+        FATAL_ERROR("\"-num_palettes\" needs a non-affine \"-tilemap\" to store each tile's palette in.\n");
+
+    if (options->paletteFilePath == NULL)
+        FATAL_ERROR("\"-num_palettes\" needs a \"-palette_out\" file to write the palettes to.\n");
+
+    if (options->firstPalette + options->numPalettes > 16)
+        FATAL_ERROR("Palettes %d to %d don't fit in the 16 palette slots.\n",
+            options->firstPalette, options->firstPalette + options->numPalettes - 1);
+
+    int width;
+    int height;
+    unsigned char *rgba = ReadPngRgba(inputPath, &width, &height);
+    unsigned char *tilePalettes;
+    int numPalettes;
+    int numLossyTiles = QuantizeImage(rgba, width, height, options->numPalettes, image, &tilePalettes, &numPalettes);
+
+    free(rgba);
+
+    char *paletteFileExtension = GetFileExtensionAfterDot(options->paletteFilePath);
+
+    if (strcmp(paletteFileExtension, "gbapal") == 0)
+        WriteGbaPalette(options->paletteFilePath, &image->palette);
+    else
+        WriteJascPalette(options->paletteFilePath, &image->palette);
+
+    printf("%s: %d palettes, %d tiles not drawn exactly\n", inputPath, numPalettes, numLossyTiles);
+
+    // Puts the palette numbers in the same order as the tiles by converting
+    // an 8bpp image of them, with every pixel of a tile set to its number.
+    struct Image paletteImage;
+
+    paletteImage.width = width;
+    paletteImage.height = height;
+    paletteImage.bitDepth = 8;
+    paletteImage.pixels = malloc(width * height);
+
+    if (paletteImage.pixels == NULL)
+        FATAL_ERROR("Failed to allocate pixel buffer.\n");
+
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+            paletteImage.pixels[y * width + x] = options->firstPalette + tilePalettes[(y / 8) * (width / 8) + x / 8];
+    }
+
+    free(tilePalettes);
+
+    int size;
+    unsigned char *tiles = ConvertImageToTiles(options->numTiles, 8, options->metatileWidth, options->metatileHeight, &paletteImage, false, &size);
+    int numTiles = size / 64;
+
+    free(paletteImage.pixels);
+
+    for (int i = 0; i < numTiles; i++)
+        tiles[i] = tiles[i * 64];
+
+    return tiles;
+}
+
+// Removes repeated animation frames from size bytes of tiles, each frame
+// being one metatile, and writes the SpriteFrameImage entries that find the
+// frames in the rest to options->frameTablePath. The entries are meant to be
+// included in a frame table, so several sheets can share a table, as the
+// object event tables do. Takes ownership of tiles and returns the frames
+// that are kept.
+unsigned char *WriteFrameTable(char *inputPath, unsigned char *tiles, int *size, struct PngToGbaOptions *options)
+{
+    int frameWidth = options->metatileWidth;
+    int frameHeight = options->metatileHeight;
+    int frameSize = frameWidth * frameHeight * options->bitDepth * 8;
+    int numFrames = *size / frameSize;
+    int numUniqueFrames;
+
+    if (options->frameSymbol == NULL)
+        FATAL_ERROR("\"-frame_table\" needs a \"-frame_symbol\" naming the array the frames will be in.\n");
+
+    if (options->tilemapFilePath != NULL)
+        FATAL_ERROR("\"-frame_table\" and \"-tilemap\" can't be used together.\n");
+
+    if (*size % frameSize != 0)
+        FATAL_ERROR("The number of tiles isn't a multiple of the frame size.\n");
+
+    struct FrameInfo *frames = malloc((numFrames ? numFrames : 1) * sizeof(struct FrameInfo));
+
+    if (frames == NULL)
+        FATAL_ERROR("Failed to allocate memory for frames.\n");
+
+    tiles = DeduplicateFrames(tiles, numFrames, frameWidth, frameHeight, options->bitDepth, frames, &numUniqueFrames);
+
+    FILE *fp = fopen(options->frameTablePath, "wb");
+
+    if (fp == NULL)
+        FATAL_ERROR("Failed to open \"%s\" for writing.\n", options->frameTablePath);
+
+    int numMirrors = 0;
+
+    fprintf(fp, "// Generated by gbagfx from %s. %d frames of %dx%d tiles, %d stored.\n",
+        inputPath, numFrames, frameWidth, frameHeight, numUniqueFrames);
+
+    for (int i = 0; i < numFrames; i++)
+    {
+        // overworld_frame() assumes 4bpp frames.
+        if (options->bitDepth == 4)
+            fprintf(fp, "overworld_frame(%s, %d, %d, %d),", options->frameSymbol, frameWidth, frameHeight, frames[i].offset / frameSize);
+        else
+            fprintf(fp, "{.data = (const u8 *)%s + %d, .size = %d},", options->frameSymbol, frames[i].offset, frameSize);
+
+        fprintf(fp, " // frame %d", i);
+
+        if (frames[i].duplicateOf != -1)
+        {
+            fprintf(fp, ", same as frame %d", frames[i].duplicateOf);
+        }
+        else if (frames[i].mirrorOf != -1)
+        {
+            fprintf(fp, ", frame %d flipped %s", frames[i].mirrorOf,
+                frames[i].hflip ? (frames[i].vflip ? "both ways" : "horizontally") : "vertically");
+            numMirrors++;
+        }
+
+        fputc('\n', fp);
+    }
+
+    fclose(fp);
+    free(frames);
+
+    *size = numUniqueFrames * frameSize;
+
+    printf("%s: %d frames, %d stored, %d bytes saved; %d more are flips of other frames (%d bytes)\n",
+        inputPath, numFrames, numUniqueFrames, (numFrames - numUniqueFrames) * frameSize, numMirrors, numMirrors * frameSize);
+
+    return tiles;
+}
+
+// Converts a PNG to tiles, removing repeated tiles if there's a tilemap or
+// repeated frames if there's a frame table.
+unsigned char *ConvertPngToTiles(char *inputPath, struct PngToGbaOptions *options, int *size)
 {
     struct Image image;
+    unsigned char *paletteNumbers = NULL;
 
     image.bitDepth = options->bitDepth;
     image.tilemap.data.affine = NULL; // initialize to NULL to avoid issues in FreeImage
 
-    ReadPng(inputPath, &image);
+    if (options->numPalettes != 0)
+        paletteNumbers = ReadQuantizedPng(inputPath, &image, options);
+    else
+        ReadPng(inputPath, &image);
 
-    WriteImage(outputPath, options->numTiles, options->bitDepth, options->metatileWidth, options->metatileHeight, &image, !image.hasPalette);
+    unsigned char *data = ConvertImageToTiles(options->numTiles, options->bitDepth, options->metatileWidth, options->metatileHeight, &image, !image.hasPalette, size);
 
     FreeImage(&image);
+
+    if (options->frameTablePath != NULL)
+        data = WriteFrameTable(inputPath, data, size, options);
+    else if (options->tilemapFilePath != NULL)
+        data = WriteDeduplicatedTilemap(inputPath, data, size, paletteNumbers, options);
+
+    free(paletteNumbers);
+
+    return data;
+}
+
+void ConvertPngToGba(char *inputPath, char *outputPath, struct PngToGbaOptions *options)
+{
+    int size;
+    unsigned char *data = ConvertPngToTiles(inputPath, options, &size);
+
+    WriteWholeFile(outputPath, data, size);
+
+    free(data);
 }
 
 void HandleGbaToPngCommand(char *inputPath, char *outputPath, int argc, char **argv)
@@ -174,6 +374,125 @@ void HandleGbaToPngCommand(char *inputPath, char *outputPath, int argc, char **a
     ConvertGbaToPng(inputPath, outputPath, &options);
 }
 
+// Parses argv[*i] if it's an option for converting a PNG to tiles, moving *i
+// past any value it takes. Returns false for other options.
+bool ParsePngToGbaOption(int argc, char **argv, int *i, struct PngToGbaOptions *options)
+{
+    char *option = argv[*i];
+
+    if (strcmp(option, "-num_tiles") == 0)
+    {
+        if (*i + 1 >= argc)
+            FATAL_ERROR("No number of tiles following \"-num_tiles\".\n");
+
+        (*i)++;
+
+        if (!ParseNumber(argv[*i], NULL, 10, &options->numTiles))
+            FATAL_ERROR("Failed to parse number of tiles.\n");
+
+        if (options->numTiles < 1)
+            FATAL_ERROR("Number of tiles must be positive.\n");
+    }
+    else if (strcmp(option, "-mwidth") == 0)
+    {
+        if (*i + 1 >= argc)
+            FATAL_ERROR("No metatile width value following \"-mwidth\".\n");
+
+        (*i)++;
+
+        if (!ParseNumber(argv[*i], NULL, 10, &options->metatileWidth))
+            FATAL_ERROR("Failed to parse metatile width.\n");
+
+        if (options->metatileWidth < 1)
+            FATAL_ERROR("metatile width must be positive.\n");
+    }
+    else if (strcmp(option, "-mheight") == 0)
+    {
+        if (*i + 1 >= argc)
+            FATAL_ERROR("No metatile height value following \"-mheight\".\n");
+
+        (*i)++;
+
+        if (!ParseNumber(argv[*i], NULL, 10, &options->metatileHeight))
+            FATAL_ERROR("Failed to parse metatile height.\n");
+
+        if (options->metatileHeight < 1)
+            FATAL_ERROR("metatile height must be positive.\n");
+    }
+    else if (strcmp(option, "-tilemap") == 0)
+    {
+        if (*i + 1 >= argc)
+            FATAL_ERROR("No tilemap value following \"-tilemap\".\n");
+
+        (*i)++;
+
+        options->tilemapFilePath = argv[*i];
+    }
+    else if (strcmp(option, "-affine") == 0)
+    {
+        options->isAffineMap = true;
+    }
+    else if (strcmp(option, "-num_palettes") == 0)
+    {
+        if (*i + 1 >= argc)
+            FATAL_ERROR("No number of palettes following \"-num_palettes\".\n");
+
+        (*i)++;
+
+        if (!ParseNumber(argv[*i], NULL, 10, &options->numPalettes))
+            FATAL_ERROR("Failed to parse number of palettes.\n");
+
+        if (options->numPalettes < 1 || options->numPalettes > 16)
+            FATAL_ERROR("Number of palettes must be between 1 and 16.\n");
+    }
+    else if (strcmp(option, "-first_palette") == 0)
+    {
+        if (*i + 1 >= argc)
+            FATAL_ERROR("No palette number following \"-first_palette\".\n");
+
+        (*i)++;
+
+        if (!ParseNumber(argv[*i], NULL, 10, &options->firstPalette))
+            FATAL_ERROR("Failed to parse first palette number.\n");
+
+        if (options->firstPalette < 0 || options->firstPalette > 15)
+            FATAL_ERROR("First palette number must be between 0 and 15.\n");
+    }
+    else if (strcmp(option, "-palette_out") == 0)
+    {
+        if (*i + 1 >= argc)
+            FATAL_ERROR("No palette file path following \"-palette_out\".\n");
+
+        (*i)++;
+
+        options->paletteFilePath = argv[*i];
+    }
+    else if (strcmp(option, "-frame_table") == 0)
+    {
+        if (*i + 1 >= argc)
+            FATAL_ERROR("No frame table path following \"-frame_table\".\n");
+
+        (*i)++;
+
+        options->frameTablePath = argv[*i];
+    }
+    else if (strcmp(option, "-frame_symbol") == 0)
+    {
+        if (*i + 1 >= argc)
+            FATAL_ERROR("No symbol following \"-frame_symbol\".\n");
+
+        (*i)++;
+
+        options->frameSymbol = argv[*i];
+    }
+    else
+    {
+        return false;
+    }
+
+    return true;
+}
+
 void HandlePngToGbaCommand(char *inputPath, char *outputPath, int argc, char **argv)
 {
     char *outputFileExtension = GetFileExtensionAfterDot(outputPath);
@@ -185,54 +504,16 @@ void HandlePngToGbaCommand(char *inputPath, char *outputPath, int argc, char **a
     options.metatileHeight = 1;
     options.tilemapFilePath = NULL;
     options.isAffineMap = false;
+    options.numPalettes = 0;
+    options.firstPalette = 0;
+    options.paletteFilePath = NULL;
+    options.frameTablePath = NULL;
+    options.frameSymbol = NULL;
 
     for (int i = 3; i < argc; i++)
     {
-        char *option = argv[i];
-
-        if (strcmp(option, "-num_tiles") == 0)
-        {
-            if (i + 1 >= argc)
-                FATAL_ERROR("No number of tiles following \"-num_tiles\".\n");
-
-            i++;
-
-            if (!ParseNumber(argv[i], NULL, 10, &options.numTiles))
-                FATAL_ERROR("Failed to parse number of tiles.\n");
-
-            if (options.numTiles < 1)
-                FATAL_ERROR("Number of tiles must be positive.\n");
-        }
-        else if (strcmp(option, "-mwidth") == 0)
-        {
-            if (i + 1 >= argc)
-                FATAL_ERROR("No metatile width value following \"-mwidth\".\n");
-
-            i++;
-
-            if (!ParseNumber(argv[i], NULL, 10, &options.metatileWidth))
-                FATAL_ERROR("Failed to parse metatile width.\n");
-
-            if (options.metatileWidth < 1)
-                FATAL_ERROR("metatile width must be positive.\n");
-        }
-        else if (strcmp(option, "-mheight") == 0)
-        {
-            if (i + 1 >= argc)
-                FATAL_ERROR("No metatile height value following \"-mheight\".\n");
-
-            i++;
-
-            if (!ParseNumber(argv[i], NULL, 10, &options.metatileHeight))
-                FATAL_ERROR("Failed to parse metatile height.\n");
-
-            if (options.metatileHeight < 1)
-                FATAL_ERROR("metatile height must be positive.\n");
-        }
-        else
-        {
-            FATAL_ERROR("Unrecognized option \"%s\".\n", option);
-        }
+        if (!ParsePngToGbaOption(argc, argv, &i, &options))
+            FATAL_ERROR("Unrecognized option \"%s\".\n", argv[i]);
     }
 
     ConvertPngToGba(inputPath, outputPath, &options);
@@ -371,63 +652,151 @@ void HandlePngToFullwidthJapaneseFontCommand(char *inputPath, char *outputPath,
     FreeImage(&image);
 }
 
-void HandleLZCompressCommand(char *inputPath, char *outputPath, int argc, char **argv)
+// Prints how large the data would be with each of the formats the BIOS can
+// decompress, next to the size that was actually written. The game code picks
+// the decompression function for each asset, so switching an asset to another
+// format also means changing the code that loads it.
+void ReportCompressedSizes(char *inputPath, unsigned char *buffer, int size, int minDistance, int writtenSize)
 {
-    int overflowSize = 0;
-    int minDistance = 2; // default, for compatibility with LZ77UnCompVram()
+    struct {
+        const char *name;
+        int size;
+    } formats[5];
+    unsigned char *data;
+    int best = 0;
 
-    for (int i = 3; i < argc; i++)
+    data = LZCompress(buffer, size, &formats[0].size, minDistance);
+    formats[0].name = "lz";
+    free(data);
+
+    data = LZCompressOptimal(buffer, size, &formats[1].size, minDistance);
+    formats[1].name = "lz -optimal";
+    free(data);
+
+    data = RLCompress(buffer, size, &formats[2].size);
+    formats[2].name = "rl";
+    free(data);
+
+    formats[3].size = HuffCompressedSize(buffer, size, 4);
+    formats[3].name = "huff -depth 4";
+
+    formats[4].size = HuffCompressedSize(buffer, size, 8);
+    formats[4].name = "huff -depth 8";
+
+    printf("%s: %d bytes uncompressed, %d written", inputPath, size, writtenSize);
+
+    for (int i = 0; i < 5; i++)
     {
-        char *option = argv[i];
+        printf(", %s %d", formats[i].name, formats[i].size);
 
-        if (strcmp(option, "-overflow") == 0)
-        {
-            if (i + 1 >= argc)
-                FATAL_ERROR("No size following \"-overflow\".\n");
+        if (formats[i].size < formats[best].size)
+            best = i;
+    }
 
-            i++;
+    printf("; smallest is %s, %d bytes (%d saved vs. greedy lz)\n",
+        formats[best].name, formats[best].size, formats[0].size - formats[best].size);
+}
 
-            if (!ParseNumber(argv[i], NULL, 10, &overflowSize))
-                FATAL_ERROR("Failed to parse overflow size.\n");
+// Parses argv[*i] if it's an LZ compression option, moving *i past any value
+// it takes. Returns false for other options.
+bool ParseLZCompressOption(int argc, char **argv, int *i, struct LZCompressOptions *options)
+{
+    char *option = argv[*i];
 
-            if (overflowSize < 1)
-                FATAL_ERROR("Overflow size must be positive.\n");
-        }
-        else if (strcmp(option, "-search") == 0)
-        {
-            if (i + 1 >= argc)
-                FATAL_ERROR("No size following \"-overflow\".\n");
+    if (strcmp(option, "-overflow") == 0)
+    {
+        if (*i + 1 >= argc)
+            FATAL_ERROR("No size following \"-overflow\".\n");
 
-            i++;
+        (*i)++;
 
-            if (!ParseNumber(argv[i], NULL, 10, &minDistance))
-                FATAL_ERROR("Failed to parse LZ min search distance.\n");
+        if (!ParseNumber(argv[*i], NULL, 10, &options->overflowSize))
+            FATAL_ERROR("Failed to parse overflow size.\n");
 
-            if (minDistance < 1)
-                FATAL_ERROR("LZ min search distance must be positive.\n");
-        }
-        else
-        {
-            FATAL_ERROR("Unrecognized option \"%s\".\n", option);
-        }
+        if (options->overflowSize < 1)
+            FATAL_ERROR("Overflow size must be positive.\n");
+    }
+    else if (strcmp(option, "-search") == 0)
+    {
+        if (*i + 1 >= argc)
+            FATAL_ERROR("No size following \"-overflow\".\n");
+
+        (*i)++;
+
+        if (!ParseNumber(argv[*i], NULL, 10, &options->minDistance))
+            FATAL_ERROR("Failed to parse LZ min search distance.\n");
+
+        if (options->minDistance < 1)
+            FATAL_ERROR("LZ min search distance must be positive.\n");
     }
+    else if (strcmp(option, "-optimal") == 0)
+    {
+        // Smaller output, but not what the original games used.
+        options->optimal = true;
+    }
+    else if (strcmp(option, "-report") == 0)
+    {
+        options->report = true;
+    }
+    else
+    {
+        return false;
+    }
+
+    return true;
+}
 
+void InitLZCompressOptions(struct LZCompressOptions *options)
+{
+    options->overflowSize = 0;
+    options->minDistance = 2; // default, for compatibility with LZ77UnCompVram()
+    options->optimal = false;
+    options->report = false;
+}
+
+// Compresses fileSize bytes of data, which must be followed by
+// options->overflowSize zero bytes.
+unsigned char *CompressLZ(char *inputPath, unsigned char *buffer, int fileSize, struct LZCompressOptions *options, int *compressedSize)
+{
     // The overflow option allows a quirk in some of Ruby/Sapphire's tilesets
     // to be reproduced. It works by appending a number of zeros to the data
     // before compressing it and then amending the LZ header's size field to
     // reflect the expected size. This will cause an overflow when decompressing
     // the data.
 
-    int fileSize;
-    unsigned char *buffer = ReadWholeFileZeroPadded(inputPath, &fileSize, overflowSize);
-
-    int compressedSize;
-    unsigned char *compressedData = LZCompress(buffer, fileSize + overflowSize, &compressedSize, minDistance);
+    int size = fileSize + options->overflowSize;
+    unsigned char *compressedData = options->optimal
+        ? LZCompressOptimal(buffer, size, compressedSize, options->minDistance)
+        : LZCompress(buffer, size, compressedSize, options->minDistance);
 
     compressedData[1] = (unsigned char)fileSize;
     compressedData[2] = (unsigned char)(fileSize >> 8);
     compressedData[3] = (unsigned char)(fileSize >> 16);
 
+    if (options->report)
+        ReportCompressedSizes(inputPath, buffer, size, options->minDistance, *compressedSize);
+
+    return compressedData;
+}
+
+void HandleLZCompressCommand(char *inputPath, char *outputPath, int argc, char **argv)
+{
+    struct LZCompressOptions options;
+
+    InitLZCompressOptions(&options);
+
+    for (int i = 3; i < argc; i++)
+    {
+        if (!ParseLZCompressOption(argc, argv, &i, &options))
+            FATAL_ERROR("Unrecognized option \"%s\".\n", argv[i]);
+    }
+
+    int fileSize;
+    unsigned char *buffer = ReadWholeFileZeroPadded(inputPath, &fileSize, options.overflowSize);
+
+    int compressedSize;
+    unsigned char *compressedData = CompressLZ(inputPath, buffer, fileSize, &options, &compressedSize);
+
     free(buffer);
 
     WriteWholeFile(outputPath, compressedData, compressedSize);
@@ -465,6 +834,91 @@ void HandleRLCompressCommand(char *inputPath, char *outputPath, int argc UNUSED,
     free(compressedData);
 }
 
+// Converts a PNG to tiles and compresses them in one go, e.g. foo.png to
+// foo.4bpp.lz, without writing foo.4bpp unless -intermediate is given. Takes
+// the options of both steps.
+void HandlePngToCompressedCommand(char *inputPath, char *outputPath, int argc, char **argv)
+{
+    char *compressionExtension = GetFileExtensionAfterDot(outputPath);
+    bool lz = strcmp(compressionExtension, "lz") == 0;
+    size_t intermediatePathLength = compressionExtension - 1 - outputPath;
+    char *intermediatePath = malloc(intermediatePathLength + 1);
+
+    if (intermediatePath == NULL)
+        FATAL_ERROR("Failed to allocate memory for the intermediate path.\n");
+
+    memcpy(intermediatePath, outputPath, intermediatePathLength);
+    intermediatePath[intermediatePathLength] = 0;
+
+    char *imageExtension = GetFileExtensionAfterDot(intermediatePath);
+
+    if (imageExtension == NULL
+        || (strcmp(imageExtension, "1bpp") != 0 && strcmp(imageExtension, "4bpp") != 0 && strcmp(imageExtension, "8bpp") != 0))
+        FATAL_ERROR("Don't know how to convert \"%s\" to \"%s\".\n", inputPath, outputPath);
+
+    struct PngToGbaOptions options;
+    options.numTiles = 0;
+    options.bitDepth = imageExtension[0] - '0';
+    options.metatileWidth = 1;
+    options.metatileHeight = 1;
+    options.tilemapFilePath = NULL;
+    options.isAffineMap = false;
+    options.numPalettes = 0;
+    options.firstPalette = 0;
+    options.paletteFilePath = NULL;
+    options.frameTablePath = NULL;
+    options.frameSymbol = NULL;
+
+    struct LZCompressOptions lzOptions;
+    bool writeIntermediate = false;
+
+    InitLZCompressOptions(&lzOptions);
+
+    for (int i = 3; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-intermediate") == 0)
+            writeIntermediate = true;
+        else if (!ParsePngToGbaOption(argc, argv, &i, &options)
+              && !(lz && ParseLZCompressOption(argc, argv, &i, &lzOptions)))
+            FATAL_ERROR("Unrecognized option \"%s\".\n", argv[i]);
+    }
+
+    int size;
+    unsigned char *data = ConvertPngToTiles(inputPath, &options, &size);
+
+    if (writeIntermediate)
+        WriteWholeFile(intermediatePath, data, size);
+
+    int compressedSize;
+    unsigned char *compressedData;
+
+    if (lz)
+    {
+        if (lzOptions.overflowSize != 0)
+        {
+            data = realloc(data, size + lzOptions.overflowSize);
+
+            if (data == NULL)
+                FATAL_ERROR("Failed to allocate memory for overflow.\n");
+
+            memset(data + size, 0, lzOptions.overflowSize);
+        }
+
+        compressedData = CompressLZ(intermediatePath, data, size, &lzOptions, &compressedSize);
+    }
+    else
+    {
+        compressedData = RLCompress(data, size, &compressedSize);
+    }
+
+    free(data);
+
+    WriteWholeFile(outputPath, compressedData, compressedSize);
+
+    free(compressedData);
+    free(intermediatePath);
+}
+
 void HandleRLDecompressCommand(char *inputPath, char *outputPath, int argc UNUSED, char **argv UNUSED)
 {
     int fileSize;
@@ -535,40 +989,40 @@ void HandleHuffDecompressCommand(char *inputPath, char *outputPath, int argc UNU
     free(uncompressedData);
 }
 
-int main(int argc, char **argv)
+static const struct CommandHandler handlers[] =
 {
-    char converted = 0;
-
-    if (argc < 3)
-        FATAL_ERROR("Usage: gbagfx INPUT_PATH OUTPUT_PATH [options...]\n");
-
-    struct CommandHandler handlers[] =
-    {
-        { "1bpp", "png", HandleGbaToPngCommand },
-        { "4bpp", "png", HandleGbaToPngCommand },
-        { "8bpp", "png", HandleGbaToPngCommand },
-        { "png", "1bpp", HandlePngToGbaCommand },
-        { "png", "4bpp", HandlePngToGbaCommand },
-        { "png", "8bpp", HandlePngToGbaCommand },
-        { "png", "gbapal", HandlePngToGbaPaletteCommand },
-        { "png", "pal", HandlePngToJascPaletteCommand },
-        { "gbapal", "pal", HandleGbaToJascPaletteCommand },
-        { "pal", "gbapal", HandleJascToGbaPaletteCommand },
-        { "latfont", "png", HandleLatinFontToPngCommand },
-        { "png", "latfont", HandlePngToLatinFontCommand },
-        { "hwjpnfont", "png", HandleHalfwidthJapaneseFontToPngCommand },
-        { "png", "hwjpnfont", HandlePngToHalfwidthJapaneseFontCommand },
-        { "fwjpnfont", "png", HandleFullwidthJapaneseFontToPngCommand },
-        { "png", "fwjpnfont", HandlePngToFullwidthJapaneseFontCommand },
-        { NULL, "huff", HandleHuffCompressCommand },
-        { NULL, "lz", HandleLZCompressCommand },
-        { "huff", NULL, HandleHuffDecompressCommand },
-        { "lz", NULL, HandleLZDecompressCommand },
-        { NULL, "rl", HandleRLCompressCommand },
-        { "rl", NULL, HandleRLDecompressCommand },
-        { NULL, NULL, NULL }
-    };
+    { "1bpp", "png", HandleGbaToPngCommand },
+    { "4bpp", "png", HandleGbaToPngCommand },
+    { "8bpp", "png", HandleGbaToPngCommand },
+    { "png", "1bpp", HandlePngToGbaCommand },
+    { "png", "4bpp", HandlePngToGbaCommand },
+    { "png", "8bpp", HandlePngToGbaCommand },
+    { "png", "gbapal", HandlePngToGbaPaletteCommand },
+    { "png", "pal", HandlePngToJascPaletteCommand },
+    { "gbapal", "pal", HandleGbaToJascPaletteCommand },
+    { "pal", "gbapal", HandleJascToGbaPaletteCommand },
+    { "latfont", "png", HandleLatinFontToPngCommand },
+    { "png", "latfont", HandlePngToLatinFontCommand },
+    { "hwjpnfont", "png", HandleHalfwidthJapaneseFontToPngCommand },
+    { "png", "hwjpnfont", HandlePngToHalfwidthJapaneseFontCommand },
+    { "fwjpnfont", "png", HandleFullwidthJapaneseFontToPngCommand },
+    { "png", "fwjpnfont", HandlePngToFullwidthJapaneseFontCommand },
+    { "png", "lz", HandlePngToCompressedCommand },
+    { "png", "rl", HandlePngToCompressedCommand },
+    { NULL, "huff", HandleHuffCompressCommand },
+    { NULL, "lz", HandleLZCompressCommand },
+    { "huff", NULL, HandleHuffDecompressCommand },
+    { "lz", NULL, HandleLZDecompressCommand },
+    { NULL, "rl", HandleRLCompressCommand },
+    { "rl", NULL, HandleRLDecompressCommand },
+    { NULL, NULL, NULL }
+};
 
+// Runs one conversion. argv is laid out like the command line: the input
+// path, output path and options start at argv[1].
+static void ConvertFile(int argc, char **argv)
+{
+    char converted = 0;
     char *inputPath = argv[1];
     char *outputPath = argv[2];
     char *inputFileExtension = GetFileExtensionAfterDot(inputPath);
@@ -605,22 +1059,70 @@ int main(int argc, char **argv)
         }
     }
 
-    for (int i = 0; handlers[i].function != NULL; i++)
+    struct AssetCacheKey cacheKey;
+    unsigned char *cachedData = NULL;
+    size_t cachedSize;
+
+    if (AssetCacheBegin(&cacheKey, argc, argv))
     {
-        if ((handlers[i].inputFileExtension == NULL || strcmp(handlers[i].inputFileExtension, inputFileExtension) == 0)
-            && (handlers[i].outputFileExtension == NULL || strcmp(handlers[i].outputFileExtension, outputFileExtension) == 0))
+        for (int i = 3; i < argc; i++)
         {
-            handlers[i].function(inputPath, outputPath, argc, argv);
-            converted = 1;
-            break;
+            // These write a second file or print a report, which a cached
+            // conversion wouldn't do.
+            if (strcmp(argv[i], "-intermediate") == 0 || strcmp(argv[i], "-report") == 0)
+                cacheKey.enabled = false;
+            else if ((strcmp(argv[i], "-tilemap") == 0 || strcmp(argv[i], "-frame_table") == 0) && strcmp(inputFileExtension, "png") == 0)
+                cacheKey.enabled = false;
+            else if ((strcmp(argv[i], "-palette") == 0 || strcmp(argv[i], "-tilemap") == 0) && i + 1 < argc)
+                AssetCacheAddInput(&cacheKey, argv[i + 1]);
         }
+
+        AssetCacheAddInput(&cacheKey, inputPath);
+        cachedData = AssetCacheFetch(&cacheKey, &cachedSize);
     }
 
+    if (cachedData != NULL)
+    {
+        WriteWholeFile(outputPath, cachedData, cachedSize);
+        free(cachedData);
+        converted = 1;
+    }
+    else
+    {
+        for (int i = 0; handlers[i].function != NULL; i++)
+        {
+            if ((handlers[i].inputFileExtension == NULL || strcmp(handlers[i].inputFileExtension, inputFileExtension) == 0)
+                && (handlers[i].outputFileExtension == NULL || strcmp(handlers[i].outputFileExtension, outputFileExtension) == 0))
+            {
+                handlers[i].function(inputPath, outputPath, argc, argv);
+                AssetCacheStoreFile(&cacheKey, outputPath);
+                converted = 1;
+                break;
+            }
+        }
+    }
+
+    AssetCacheEnd(&cacheKey);
+
     if (outputPath != argv[2])
         free(outputPath);
 
     if (!converted)
         FATAL_ERROR("Don't know how to convert \"%s\" to \"%s\".\n", argv[1], argv[2]);
+}
+
+int main(int argc, char **argv)
+{
+    AssetCacheInit(argv[0]);
+
+    if (argc >= 2 && strcmp(argv[1], "batch") == 0)
+        return RunBatch(argc, argv, ConvertFile);
+
+    if (argc < 3)
+        FATAL_ERROR("Usage: gbagfx INPUT_PATH OUTPUT_PATH [options...]\n"
+                    "       gbagfx batch [-j THREADS] [MANIFEST_PATH]\n");
+
+    ConvertFile(argc, argv);
 
     return 0;
 }
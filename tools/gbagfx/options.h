@@ -23,6 +23,18 @@ struct PngToGbaOptions {
     int metatileHeight;
     char *tilemapFilePath;
     bool isAffineMap;
+    int numPalettes;
+    int firstPalette;
+    char *paletteFilePath;
+    char *frameTablePath;
+    char *frameSymbol;
+};
+
+struct LZCompressOptions {
+    int overflowSize;
+    int minDistance;
+    bool optimal;
+    bool report;
 };
 
 #endif // OPTIONS_H
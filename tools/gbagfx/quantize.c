@@ -0,0 +1,394 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "global.h"
+#include "gfx.h"
+#include "quantize.h"
+
+// Colors are compared after reducing them to the GBA's 5 bits per channel,
+// so colors that the hardware can't tell apart count as one.
+struct QuantColor
+{
+    int red;
+    int green;
+    int blue;
+    long weight; // the number of pixels with this color
+};
+
+struct QuantPalette
+{
+    struct QuantColor *colors;
+    int numColors;
+    int capacity;
+};
+
+// The number of colors in a palette besides color 0, which is transparent.
+#define COLORS_PER_PALETTE 15
+
+static int To5Bit(int value)
+{
+    return (value * 31 + 127) / 255;
+}
+
+static int ColorDistance(struct QuantColor *a, struct QuantColor *b)
+{
+    int red = a->red - b->red;
+    int green = a->green - b->green;
+    int blue = a->blue - b->blue;
+
+    // The eye is most sensitive to green and least to blue.
+    return 3 * red * red + 4 * green * green + 2 * blue * blue;
+}
+
+static bool SameColor(struct QuantColor *a, struct QuantColor *b)
+{
+    return a->red == b->red && a->green == b->green && a->blue == b->blue;
+}
+
+static int FindColor(struct QuantColor *colors, int numColors, struct QuantColor *color)
+{
+    for (int i = 0; i < numColors; i++)
+    {
+        if (SameColor(&colors[i], color))
+            return i;
+    }
+
+    return -1;
+}
+
+static int FindNearestColor(struct QuantColor *colors, int numColors, struct QuantColor *color)
+{
+    int best = 0;
+    int bestDistance = ColorDistance(&colors[0], color);
+
+    for (int i = 1; i < numColors && bestDistance != 0; i++)
+    {
+        int distance = ColorDistance(&colors[i], color);
+
+        if (distance < bestDistance)
+        {
+            best = i;
+            bestDistance = distance;
+        }
+    }
+
+    return best;
+}
+
+static void AddColor(struct QuantPalette *palette, struct QuantColor *color)
+{
+    int index = FindColor(palette->colors, palette->numColors, color);
+
+    if (index != -1)
+    {
+        palette->colors[index].weight += color->weight;
+        return;
+    }
+
+    if (palette->numColors == palette->capacity)
+    {
+        palette->capacity = palette->capacity ? palette->capacity * 2 : 16;
+        palette->colors = realloc(palette->colors, palette->capacity * sizeof(struct QuantColor));
+
+        if (palette->colors == NULL)
+            FATAL_ERROR("Failed to allocate memory for palette colors.\n");
+    }
+
+    palette->colors[palette->numColors++] = *color;
+}
+
+// Merges the two closest colors, weighted by how many pixels would change,
+// until there are at most maxColors. The merged color is the average of the
+// two, weighted the same way.
+static void ReduceColors(struct QuantColor *colors, int *numColors, int maxColors)
+{
+    while (*numColors > maxColors)
+    {
+        int bestA = 0;
+        int bestB = 1;
+        double bestCost = -1;
+
+        for (int a = 0; a < *numColors; a++)
+        {
+            for (int b = a + 1; b < *numColors; b++)
+            {
+                long smaller = colors[a].weight < colors[b].weight ? colors[a].weight : colors[b].weight;
+                double cost = (double)ColorDistance(&colors[a], &colors[b]) * smaller;
+
+                if (bestCost < 0 || cost < bestCost)
+                {
+                    bestA = a;
+                    bestB = b;
+                    bestCost = cost;
+                }
+            }
+        }
+
+        struct QuantColor *a = &colors[bestA];
+        struct QuantColor *b = &colors[bestB];
+        long weight = a->weight + b->weight;
+
+        a->red = (a->red * a->weight + b->red * b->weight + weight / 2) / weight;
+        a->green = (a->green * a->weight + b->green * b->weight + weight / 2) / weight;
+        a->blue = (a->blue * a->weight + b->blue * b->weight + weight / 2) / weight;
+        a->weight = weight;
+
+        colors[bestB] = colors[--*numColors];
+    }
+}
+
+// The number of a tile's colors that aren't in a palette yet.
+static int CountNewColors(struct QuantPalette *palette, struct QuantPalette *tile)
+{
+    int count = 0;
+
+    for (int i = 0; i < tile->numColors; i++)
+    {
+        if (FindColor(palette->colors, palette->numColors, &tile->colors[i]) == -1)
+            count++;
+    }
+
+    return count;
+}
+
+// The total squared error of drawing a tile with a palette.
+static double TileError(struct QuantPalette *palette, struct QuantPalette *tile)
+{
+    double error = 0;
+
+    for (int i = 0; i < tile->numColors; i++)
+    {
+        int nearest = FindNearestColor(palette->colors, palette->numColors, &tile->colors[i]);
+
+        error += (double)ColorDistance(&palette->colors[nearest], &tile->colors[i]) * tile->colors[i].weight;
+    }
+
+    return error;
+}
+
+// A tile's sort key. It carries the color count with it, so sorting doesn't
+// have to look the tiles up, which batch jobs on other threads would share.
+struct TileOrder
+{
+    int numColors;
+    int index;
+};
+
+static int CompareTilesByColorCount(const void *a, const void *b)
+{
+    const struct TileOrder *tileA = a;
+    const struct TileOrder *tileB = b;
+
+    if (tileA->numColors != tileB->numColors)
+        return tileB->numColors - tileA->numColors;
+
+    return tileA->index - tileB->index;
+}
+
+int QuantizeImage(unsigned char *rgba, int width, int height, int maxPalettes, struct Image *image, unsigned char **tilePalettes_p, int *numPalettes_p)
+{
+    if (width % 8 != 0)
+        FATAL_ERROR("The width in pixels (%d) isn't a multiple of 8.\n", width);
+
+    if (height % 8 != 0)
+        FATAL_ERROR("The height in pixels (%d) isn't a multiple of 8.\n", height);
+
+    int tilesWide = width / 8;
+    int numTiles = tilesWide * (height / 8);
+    struct QuantPalette *tiles = calloc(numTiles, sizeof(struct QuantPalette));
+    struct QuantPalette *palettes = calloc(maxPalettes, sizeof(struct QuantPalette));
+    unsigned char *tilePalettes = calloc(numTiles ? numTiles : 1, 1);
+    bool *lossy = calloc(numTiles ? numTiles : 1, sizeof(bool));
+    struct TileOrder *order = malloc((numTiles ? numTiles : 1) * sizeof(struct TileOrder));
+
+    if (tiles == NULL || palettes == NULL || tilePalettes == NULL || lossy == NULL || order == NULL)
+        FATAL_ERROR("Failed to allocate memory for quantization.\n");
+
+    // Collects the colors of each tile. A tile with more colors than fit in
+    // a palette has them merged down first.
+    for (int i = 0; i < numTiles; i++)
+    {
+        int tileX = (i % tilesWide) * 8;
+        int tileY = (i / tilesWide) * 8;
+
+        for (int y = 0; y < 8; y++)
+        {
+            for (int x = 0; x < 8; x++)
+            {
+                unsigned char *pixel = &rgba[((tileY + y) * width + tileX + x) * 4];
+
+                if (pixel[3] < 0x80)
+                    continue;
+
+                struct QuantColor color = { To5Bit(pixel[0]), To5Bit(pixel[1]), To5Bit(pixel[2]), 1 };
+
+                AddColor(&tiles[i], &color);
+            }
+        }
+
+        if (tiles[i].numColors > COLORS_PER_PALETTE)
+            ReduceColors(tiles[i].colors, &tiles[i].numColors, COLORS_PER_PALETTE);
+
+        order[i].numColors = tiles[i].numColors;
+        order[i].index = i;
+    }
+
+    // Packs the tiles with the most colors first, each into the palette it
+    // adds the fewest new colors to, starting a new palette when it doesn't
+    // fit in any. Once the budget is used up, tiles go wherever they add the
+    // fewest colors, and overfull palettes are merged down afterward.
+    qsort(order, numTiles, sizeof(struct TileOrder), CompareTilesByColorCount);
+
+    int numPalettes = 0;
+
+    for (int n = 0; n < numTiles; n++)
+    {
+        int i = order[n].index;
+        int best = -1;
+        int bestNewColors = 0;
+        int bestFit = -1;
+        int bestFitNewColors = 0;
+
+        for (int p = 0; p < numPalettes; p++)
+        {
+            int newColors = CountNewColors(&palettes[p], &tiles[i]);
+
+            if (best == -1 || newColors < bestNewColors)
+            {
+                best = p;
+                bestNewColors = newColors;
+            }
+
+            if (palettes[p].numColors + newColors <= COLORS_PER_PALETTE
+             && (bestFit == -1 || newColors < bestFitNewColors))
+            {
+                bestFit = p;
+                bestFitNewColors = newColors;
+            }
+        }
+
+        if (bestFit != -1)
+            best = bestFit;
+        else if (numPalettes < maxPalettes)
+            best = numPalettes++;
+
+        for (int c = 0; c < tiles[i].numColors; c++)
+            AddColor(&palettes[best], &tiles[i].colors[c]);
+
+        tilePalettes[i] = best;
+    }
+
+    if (numPalettes == 0)
+        numPalettes = 1;
+
+    bool reduced = false;
+
+    for (int p = 0; p < numPalettes; p++)
+    {
+        if (palettes[p].numColors > COLORS_PER_PALETTE)
+        {
+            ReduceColors(palettes[p].colors, &palettes[p].numColors, COLORS_PER_PALETTE);
+            reduced = true;
+        }
+    }
+
+    // Merging changed some palettes, so each tile may now look better in
+    // another one.
+    if (reduced)
+    {
+        for (int i = 0; i < numTiles; i++)
+        {
+            double bestError = -1;
+
+            if (tiles[i].numColors == 0)
+                continue;
+
+            for (int p = 0; p < numPalettes; p++)
+            {
+                if (palettes[p].numColors == 0)
+                    continue;
+
+                double error = TileError(&palettes[p], &tiles[i]);
+
+                if (bestError < 0 || error < bestError)
+                {
+                    bestError = error;
+                    tilePalettes[i] = p;
+                }
+            }
+        }
+    }
+
+    // Draws each tile with its palette. Color 0 is transparent, so the
+    // palette's colors start at 1.
+    image->width = width;
+    image->height = height;
+    image->bitDepth = 4;
+    image->hasPalette = true;
+    image->pixels = calloc(width * height / 2, 1);
+
+    if (image->pixels == NULL)
+        FATAL_ERROR("Failed to allocate pixel buffer.\n");
+
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            unsigned char *pixel = &rgba[(y * width + x) * 4];
+            int tile = (y / 8) * tilesWide + x / 8;
+            struct QuantPalette *palette = &palettes[tilePalettes[tile]];
+            int index = 0;
+
+            if (pixel[3] >= 0x80)
+            {
+                struct QuantColor color = { To5Bit(pixel[0]), To5Bit(pixel[1]), To5Bit(pixel[2]), 1 };
+                int nearest = FindNearestColor(palette->colors, palette->numColors, &color);
+
+                if (!SameColor(&palette->colors[nearest], &color))
+                    lossy[tile] = true;
+
+                index = 1 + nearest;
+            }
+
+            image->pixels[(y * width + x) / 2] |= index << ((x & 1) ? 0 : 4);
+        }
+    }
+
+    // Unused colors are left black.
+    memset(&image->palette, 0, sizeof(image->palette));
+    image->palette.numColors = numPalettes * 16;
+
+    for (int p = 0; p < numPalettes; p++)
+    {
+        for (int c = 0; c < palettes[p].numColors; c++)
+        {
+            struct Color *color = &image->palette.colors[p * 16 + 1 + c];
+
+            // Scaled so that WriteGbaPalette's division by 8 gives back the
+            // 5-bit value.
+            color->red = (palettes[p].colors[c].red << 3) | (palettes[p].colors[c].red >> 2);
+            color->green = (palettes[p].colors[c].green << 3) | (palettes[p].colors[c].green >> 2);
+            color->blue = (palettes[p].colors[c].blue << 3) | (palettes[p].colors[c].blue >> 2);
+        }
+    }
+
+    int numLossyTiles = 0;
+
+    for (int i = 0; i < numTiles; i++)
+        numLossyTiles += lossy[i];
+
+    for (int i = 0; i < numTiles; i++)
+        free(tiles[i].colors);
+
+    for (int p = 0; p < maxPalettes; p++)
+        free(palettes[p].colors);
+
+    free(tiles);
+    free(palettes);
+    free(lossy);
+    free(order);
+
+    *tilePalettes_p = tilePalettes;
+    *numPalettes_p = numPalettes;
+    return numLossyTiles;
+}
@@ -0,0 +1,14 @@
+#ifndef QUANTIZE_H
+#define QUANTIZE_H
+
+#include "gfx.h"
+
+// Converts width x height RGBA pixels to a 4bpp image whose 8x8 tiles each use
+// one of at most maxPalettes 16-color palettes, with color 0 of each left
+// transparent. Tiles are grouped so that as few colors as possible are lost.
+// Sets image->palette to all of the palettes in a row, and *tilePalettes_p
+// to the palette of each tile, in rows from the top left. Returns the number
+// of tiles that couldn't be drawn with their exact colors.
+int QuantizeImage(unsigned char *rgba, int width, int height, int maxPalettes, struct Image *image, unsigned char **tilePalettes_p, int *numPalettes_p);
+
+#endif // QUANTIZE_H
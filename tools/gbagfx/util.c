@@ -117,8 +117,43 @@ unsigned char *ReadWholeFileZeroPadded(char *path, int *size, int padAmount)
 	return buffer;
 }
 
+// Set by batch mode, where outputs are kept if they're already up to date so
+// that anything built from them isn't rebuilt.
+bool gSkipUnchangedWrites = false;
+
+static bool FileHasContents(char *path, void *buffer, int bufferSize)
+{
+	FILE *fp = fopen(path, "rb");
+
+	if (fp == NULL)
+		return false;
+
+	bool same = false;
+
+	fseek(fp, 0, SEEK_END);
+
+	if (ftell(fp) == bufferSize)
+	{
+		unsigned char *existing = malloc(bufferSize + 1);
+
+		rewind(fp);
+
+		if (existing != NULL && fread(existing, bufferSize, 1, fp) == (bufferSize != 0))
+			same = memcmp(existing, buffer, bufferSize) == 0;
+
+		free(existing);
+	}
+
+	fclose(fp);
+
+	return same;
+}
+
 void WriteWholeFile(char *path, void *buffer, int bufferSize)
 {
+	if (gSkipUnchangedWrites && FileHasContents(path, buffer, bufferSize))
+		return;
+
 	FILE *fp = fopen(path, "wb");
 
 	if (fp == NULL)
@@ -5,6 +5,8 @@
 
 #include <stdbool.h>
 
+extern bool gSkipUnchangedWrites;
+
 bool ParseNumber(char *s, char **end, int radix, int *intValue);
 char *GetFileExtension(char *path);
 char *GetFileExtensionAfterDot(char *path);
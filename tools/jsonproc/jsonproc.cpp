@@ -4,6 +4,14 @@
 
 #include <map>
 
+#include <fstream>
+#include <sstream>
+
+#include <chrono>
+using std::chrono::steady_clock;
+
+#include <cstring>
+
 #include <string>
 using std::string; using std::to_string;
 
@@ -23,19 +31,56 @@ string get_custom_var(string key)
     return customVars[key];
 }
 
+// Leaves the file alone if it already holds text, so that its timestamp
+// doesn't make everything built from it out of date.
+void write_text_file(string filepath, const string &text)
+{
+    std::ifstream in_file(filepath);
+
+    if (in_file.is_open())
+    {
+        std::ostringstream existing;
+        existing << in_file.rdbuf();
+
+        if (existing.str() == text)
+            return;
+
+        in_file.close();
+    }
+
+    std::ofstream out_file(filepath);
+
+    if (!out_file.is_open())
+        FATAL_ERROR("Cannot open file %s for writing.\n", filepath.c_str());
+
+    out_file << text;
+}
+
+double elapsed_ms(steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(steady_clock::now() - start).count();
+}
+
 int main(int argc, char *argv[])
 {
-    if (argc != 4)
-        FATAL_ERROR("USAGE: jsonproc <json-filepath> <template-filepath> <output-filepath>\n");
+    bool printStats = false;
+    int firstArg = 1;
+
+    if (argc > 1 && strcmp(argv[1], "--stats") == 0)
+    {
+        printStats = true;
+        firstArg++;
+    }
 
-    string jsonfilepath = argv[1];
-    string templateFilepath = argv[2];
-    string outputFilepath = argv[3];
+    if (argc - firstArg < 3 || (argc - firstArg) % 3 != 0)
+        FATAL_ERROR("USAGE: jsonproc [--stats] <json-filepath> <template-filepath> <output-filepath> [...]\n");
 
-    Environment env;
+    string jsonfilepath;
+    string templateFilepath;
 
+    Environment env;
     // Add custom command callbacks.
-    env.add_callback("doNotModifyHeader", 0, [jsonfilepath, templateFilepath](Arguments& args) {
+    env.add_callback("doNotModifyHeader", 0, [&jsonfilepath, &templateFilepath](Arguments& args) {
         return "//\n// DO NOT MODIFY THIS FILE! It is auto-generated from " + jsonfilepath +" and Inja template " + templateFilepath + "\n//\n";
     });
 
@@ -96,13 +141,53 @@ int main(int argc, char *argv[])
         return args.at(0)->empty();
     });
 
-    try
-    {
-        env.write_with_json_file(templateFilepath, jsonfilepath, outputFilepath);
-    }
-    catch (const std::exception& e)
+    // Each JSON file and template is only loaded once, however many outputs
+    // use it.
+    std::map<string, json> jsonFiles;
+    std::map<string, Template> templates;
+
+    for (int i = firstArg; i < argc; i += 3)
     {
-        FATAL_ERROR("JSONPROC_ERROR: %s\n", e.what());
+        jsonfilepath = argv[i];
+        templateFilepath = argv[i + 1];
+        string outputFilepath = argv[i + 2];
+
+        double loadMs = 0, parseMs = 0, renderMs = 0, writeMs = 0;
+
+        try
+        {
+            auto start = steady_clock::now();
+
+            if (jsonFiles.find(jsonfilepath) == jsonFiles.end())
+                jsonFiles[jsonfilepath] = env.load_json(jsonfilepath);
+
+            loadMs = elapsed_ms(start);
+            start = steady_clock::now();
+
+            if (templates.find(templateFilepath) == templates.end())
+                templates[templateFilepath] = env.parse_template(templateFilepath);
+
+            parseMs = elapsed_ms(start);
+            start = steady_clock::now();
+
+            customVars.clear();
+            string output = env.render(templates[templateFilepath], jsonFiles[jsonfilepath]);
+
+            renderMs = elapsed_ms(start);
+            start = steady_clock::now();
+
+            write_text_file(outputFilepath, output);
+
+            writeMs = elapsed_ms(start);
+        }
+        catch (const std::exception& e)
+        {
+            FATAL_ERROR("JSONPROC_ERROR: %s\n", e.what());
+        }
+
+        if (printStats)
+            fprintf(stderr, "%s: load %.1f ms, parse %.1f ms, render %.1f ms, write %.1f ms\n",
+                    outputFilepath.c_str(), loadMs, parseMs, renderMs, writeMs);
     }
 
     return 0;
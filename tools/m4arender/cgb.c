@@ -0,0 +1,289 @@
+#include <stdbool.h>
+#include <string.h>
+#include "gba/gba.h"
+#include "cgb.h"
+
+#define REG(offset) gHostIoRegs[REG_OFFSET_##offset]
+
+struct CgbVoice
+{
+    bool playing;
+    double phase;
+    s32 volume;
+    s32 envelopeTimer;
+    s32 length;
+    s32 sweepTimer;
+    u32 sweepFreq;
+    u16 lfsr;
+};
+
+static const u8 sRegOffsets[4][4] =
+{
+    { REG_OFFSET_NR11, REG_OFFSET_NR12, REG_OFFSET_NR13, REG_OFFSET_NR14 },
+    { REG_OFFSET_NR21, REG_OFFSET_NR22, REG_OFFSET_NR23, REG_OFFSET_NR24 },
+    { REG_OFFSET_NR31, REG_OFFSET_NR32, REG_OFFSET_NR33, REG_OFFSET_NR34 },
+    { REG_OFFSET_NR41, REG_OFFSET_NR42, REG_OFFSET_NR43, REG_OFFSET_NR44 },
+};
+
+// The square wave for each duty cycle, one bit per step.
+static const u8 sDutyCycles[4] = { 0x01, 0x81, 0x87, 0x7E };
+
+static struct CgbVoice sVoices[4];
+static double sSampleRate;
+static double sSequencerPhase;
+static u32 sSequencerStep;
+
+void InitCgbSynth(uint32_t sampleRate)
+{
+    memset(sVoices, 0, sizeof(sVoices));
+    sSampleRate = sampleRate;
+    sSequencerPhase = 0;
+    sSequencerStep = 0;
+}
+
+static u8 *VoiceReg(int ch, int reg)
+{
+    return &gHostIoRegs[sRegOffsets[ch][reg]];
+}
+
+static u32 VoiceFreq(int ch)
+{
+    return *VoiceReg(ch, 2) | ((*VoiceReg(ch, 3) & 7) << 8);
+}
+
+// Whether the channel's DAC is on, without which it's silent.
+static bool VoiceEnabled(int ch)
+{
+    if (ch == 2)
+        return REG(NR30) & 0x80;
+
+    return *VoiceReg(ch, 1) & 0xF8;
+}
+
+static void TriggerVoice(int ch)
+{
+    struct CgbVoice *voice = &sVoices[ch];
+    u8 envelope = *VoiceReg(ch, 1);
+
+    voice->playing = VoiceEnabled(ch);
+
+    if (ch == 2)
+    {
+        voice->length = 256 - *VoiceReg(ch, 0);
+        voice->phase = 0;
+        return;
+    }
+
+    voice->length = 64 - (*VoiceReg(ch, 0) & 0x3F);
+    voice->volume = envelope >> 4;
+    voice->envelopeTimer = envelope & 7;
+
+    if (ch == 0)
+    {
+        voice->sweepFreq = VoiceFreq(ch);
+        voice->sweepTimer = (REG(NR10) >> 4) & 7;
+    }
+    else if (ch == 3)
+    {
+        voice->lfsr = 0x7FFF;
+    }
+}
+
+static void ClockLength(void)
+{
+    for (int ch = 0; ch < 4; ch++)
+    {
+        struct CgbVoice *voice = &sVoices[ch];
+
+        if ((*VoiceReg(ch, 3) & 0x40) && voice->length > 0 && --voice->length == 0)
+            voice->playing = false;
+    }
+}
+
+static void ClockSweep(void)
+{
+    struct CgbVoice *voice = &sVoices[0];
+    u8 sweep = REG(NR10);
+    u32 period = (sweep >> 4) & 7;
+    u32 shift = sweep & 7;
+
+    if (period == 0 || --voice->sweepTimer > 0)
+        return;
+
+    voice->sweepTimer = period;
+
+    u32 change = voice->sweepFreq >> shift;
+    u32 freq = (sweep & 0x08) ? voice->sweepFreq - change : voice->sweepFreq + change;
+
+    if (freq > 2047)
+    {
+        voice->playing = false;
+    }
+    else if (shift != 0)
+    {
+        voice->sweepFreq = freq;
+        REG(NR13) = freq;
+        REG(NR14) = (REG(NR14) & ~7) | (freq >> 8);
+    }
+}
+
+static void ClockEnvelope(void)
+{
+    for (int ch = 0; ch < 4; ch++)
+    {
+        struct CgbVoice *voice = &sVoices[ch];
+        u8 envelope = *VoiceReg(ch, 1);
+
+        if (ch == 2 || (envelope & 7) == 0 || --voice->envelopeTimer > 0)
+            continue;
+
+        voice->envelopeTimer = envelope & 7;
+
+        if ((envelope & 0x08) && voice->volume < 15)
+            voice->volume++;
+        else if (!(envelope & 0x08) && voice->volume > 0)
+            voice->volume--;
+    }
+}
+
+// Steps the frame sequencer, which runs at 512 Hz.
+static void ClockSequencer(void)
+{
+    if (!(sSequencerStep & 1))
+        ClockLength();
+
+    if (sSequencerStep == 2 || sSequencerStep == 6)
+        ClockSweep();
+
+    if (sSequencerStep == 7)
+        ClockEnvelope();
+
+    sSequencerStep = (sSequencerStep + 1) & 7;
+}
+
+static s32 SquareSample(int ch)
+{
+    struct CgbVoice *voice = &sVoices[ch];
+    u32 duty = sDutyCycles[*VoiceReg(ch, 0) >> 6];
+    u32 step = (u32)voice->phase & 7;
+
+    voice->phase += 1048576.0 / (2048 - VoiceFreq(ch)) / sSampleRate;
+
+    if (voice->phase >= 8)
+        voice->phase -= 8 * (u32)(voice->phase / 8);
+
+    return (duty >> (7 - step)) & 1 ? voice->volume : -voice->volume;
+}
+
+static s32 WaveSample(void)
+{
+    struct CgbVoice *voice = &sVoices[2];
+    u8 volume = REG(NR32);
+    u32 index = (u32)voice->phase & 31;
+    u8 data = gHostIoRegs[REG_OFFSET_WAVE_RAM0 + index / 2];
+    s32 sample = ((index & 1) ? data & 0xF : data >> 4) * 2 - 15;
+
+    voice->phase += 2097152.0 / (2048 - VoiceFreq(2)) / sSampleRate;
+
+    if (voice->phase >= 32)
+        voice->phase -= 32 * (u32)(voice->phase / 32);
+
+    if (volume & 0x80)
+        return sample * 3 / 4;
+
+    switch ((volume >> 5) & 3)
+    {
+    case 0:
+        return 0;
+    case 1:
+        return sample;
+    case 2:
+        return sample / 2;
+    default:
+        return sample / 4;
+    }
+}
+
+static s32 NoiseSample(void)
+{
+    struct CgbVoice *voice = &sVoices[3];
+    u8 control = REG(NR43);
+    u32 divider = control & 7;
+    double freq = (divider ? 524288.0 / divider : 1048576.0) / (2 << (control >> 4));
+
+    voice->phase += freq / sSampleRate;
+
+    while (voice->phase >= 1)
+    {
+        u32 bit = (voice->lfsr ^ (voice->lfsr >> 1)) & 1;
+
+        voice->lfsr = (voice->lfsr >> 1) | (bit << 14);
+
+        if (control & 0x08)
+            voice->lfsr = (voice->lfsr & ~0x40) | (bit << 6);
+
+        voice->phase -= 1;
+    }
+
+    return (voice->lfsr & 1) ? -voice->volume : voice->volume;
+}
+
+void RenderCgbFrame(int32_t *left, int32_t *right, int samples)
+{
+    for (int ch = 0; ch < 4; ch++)
+    {
+        u8 *control = VoiceReg(ch, 3);
+
+        if (*control & 0x80)
+        {
+            TriggerVoice(ch);
+            *control &= 0x7F;
+        }
+
+        if (!VoiceEnabled(ch))
+            sVoices[ch].playing = false;
+    }
+
+    u8 panning = REG(NR51);
+    u8 volume = REG(NR50);
+    u32 ratio = REG(SOUNDCNT_H) & 3;
+    u32 shift = ratio >= SOUND_CGB_MIX_FULL ? 0 : 2 - ratio;
+
+    for (int i = 0; i < samples; i++)
+    {
+        s32 sumLeft = 0;
+        s32 sumRight = 0;
+
+        sSequencerPhase += 512 / sSampleRate;
+
+        while (sSequencerPhase >= 1)
+        {
+            ClockSequencer();
+            sSequencerPhase -= 1;
+        }
+
+        for (int ch = 0; ch < 4; ch++)
+        {
+            s32 sample;
+
+            if (!sVoices[ch].playing)
+                continue;
+
+            if (ch == 2)
+                sample = WaveSample();
+            else if (ch == 3)
+                sample = NoiseSample();
+            else
+                sample = SquareSample(ch);
+
+            if (panning & (1 << ch))
+                sumRight += sample;
+
+            if (panning & (0x10 << ch))
+                sumLeft += sample;
+        }
+
+        right[i] += (sumRight * ((volume & 7) + 1)) >> shift;
+        left[i] += (sumLeft * (((volume >> 4) & 7) + 1)) >> shift;
+    }
+}
@@ -0,0 +1,17 @@
+#ifndef CGB_H
+#define CGB_H
+
+#include <stdint.h>
+
+// Plays the four CGB channels from the sound registers that CgbSound writes.
+// This is an approximation of the hardware, enough to hear the square,
+// wave and noise parts of a song; the Direct Sound mixing is exact.
+
+void InitCgbSynth(uint32_t sampleRate);
+
+// Adds a frame of CGB output to the left and right buffers, after CgbSound
+// has run for it. The output is on the same scale as a Direct Sound sample
+// times 4, like the GBA's 10-bit sound output.
+void RenderCgbFrame(int32_t *left, int32_t *right, int samples);
+
+#endif // CGB_H
@@ -0,0 +1,1223 @@
+// A host port of src/m4a_1.s, the half of the m4a engine that's written in
+// assembly: the sequencer's main loop and commands, the channel allocator
+// and the Direct Sound mixer. It follows the assembly step by step, so that
+// songs play the same way they do on the GBA.
+//
+// The engine keeps some pointers in u32 fields, which can't hold host
+// pointers. The song data is read from the sound data image, and the
+// channel chains hold handles instead of addresses.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "m4a_host.h"
+#include "sound_data.h"
+
+extern const u8 gClockTable[];
+extern const s8 gDeltaEncodingTable[];
+extern void * const gMPlayJumpTableTemplate[];
+
+// The tracks that own the CGB channels, which the assembly keeps in their
+// u32 tp fields.
+static struct MusicPlayerTrack *sCgbChanTracks[4];
+
+// The decoded block of a compressed sample, like gUnknown_03001300.
+static s8 sDecodedBlock[64];
+static u32 sDecodedBlockIndex;
+
+u32 umul3232H32(u32 multiplier, u32 multiplicand)
+{
+    return ((u64)multiplier * multiplicand) >> 32;
+}
+
+// Channel chains.
+//
+// The pp and np fields link a track's channels. They hold a handle: the
+// channel's index plus 1, with the CGB channels after the Direct Sound ones.
+// The first 0x15 bytes of SoundChannel and CgbChannel have the same layout,
+// so a CGB channel is handled as a SoundChannel where they agree, as the
+// assembly does.
+
+static bool IsCgbChan(struct SoundChannel *chan)
+{
+    struct CgbChannel *cgbChans = SOUND_INFO_PTR->cgbChans;
+
+    return cgbChans != NULL
+        && (uintptr_t)chan >= (uintptr_t)cgbChans
+        && (uintptr_t)chan < (uintptr_t)(cgbChans + 4);
+}
+
+static struct CgbChannel *ToCgbChan(struct SoundChannel *chan)
+{
+    return (struct CgbChannel *)chan;
+}
+
+static u32 ChanToHandle(struct SoundChannel *chan)
+{
+    if (chan == NULL)
+        return 0;
+
+    if (IsCgbChan(chan))
+        return 1 + MAX_DIRECTSOUND_CHANNELS + (ToCgbChan(chan) - SOUND_INFO_PTR->cgbChans);
+
+    return 1 + (chan - SOUND_INFO_PTR->chans);
+}
+
+static struct SoundChannel *HandleToChan(u32 handle)
+{
+    if (handle == 0)
+        return NULL;
+
+    if (handle > MAX_DIRECTSOUND_CHANNELS)
+        return (struct SoundChannel *)&SOUND_INFO_PTR->cgbChans[handle - 1 - MAX_DIRECTSOUND_CHANNELS];
+
+    return &SOUND_INFO_PTR->chans[handle - 1];
+}
+
+static u32 *ChanPrev(struct SoundChannel *chan)
+{
+    return IsCgbChan(chan) ? &ToCgbChan(chan)->pp : &chan->pp;
+}
+
+static u32 *ChanNext(struct SoundChannel *chan)
+{
+    return IsCgbChan(chan) ? &ToCgbChan(chan)->np : &chan->np;
+}
+
+static struct MusicPlayerTrack **ChanTrack(struct SoundChannel *chan)
+{
+    if (IsCgbChan(chan))
+        return &sCgbChanTracks[ToCgbChan(chan) - SOUND_INFO_PTR->cgbChans];
+
+    return &chan->track;
+}
+
+static struct SoundChannel *NextChan(struct SoundChannel *chan)
+{
+    return HandleToChan(*ChanNext(chan));
+}
+
+void RealClearChain(void *x)
+{
+    struct SoundChannel *chan = x;
+    struct MusicPlayerTrack *track = *ChanTrack(chan);
+
+    if (track == NULL)
+        return;
+
+    u32 next = *ChanNext(chan);
+    u32 prev = *ChanPrev(chan);
+
+    if (prev != 0)
+        *ChanNext(HandleToChan(prev)) = next;
+    else
+        track->chan = HandleToChan(next);
+
+    if (next != 0)
+        *ChanPrev(HandleToChan(next)) = prev;
+
+    *ChanTrack(chan) = NULL;
+}
+
+// Clears the start of a track or music player. On the GBA that's the first
+// 64 bytes; here it's everything before the track's command pointer, which
+// covers the same fields.
+void SoundMainBTM(void *x)
+{
+    memset(x, 0, offsetof(struct MusicPlayerTrack, cmdPtr));
+}
+
+void MPlayJumpTableCopy(void **mplayJumpTable)
+{
+    for (int i = 0; i < 36; i++)
+        mplayJumpTable[i] = gMPlayJumpTableTemplate[i];
+}
+
+void CpuSet(const void *src, void *dest, u32 control)
+{
+    u32 count = control & 0x1FFFFF;
+    u32 size = (control & CPU_SET_32BIT) ? 4 : 2;
+
+    if (control & CPU_SET_SRC_FIXED)
+    {
+        for (u32 i = 0; i < count; i++)
+            memcpy((u8 *)dest + i * size, src, size);
+    }
+    else
+    {
+        memmove(dest, src, count * size);
+    }
+}
+
+// Sequencer commands
+
+static u8 ReadCmdByte(struct MusicPlayerTrack *track)
+{
+    return *track->cmdPtr++;
+}
+
+static u32 ReadWord(const u8 *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((u32)p[3] << 24);
+}
+
+// Reads one of the 12-byte ToneData entries in the sound data. Its wav field
+// is a ROM address, except for square and noise voices, which keep their
+// duty cycle or period there.
+static void DecodeToneData(const u8 *src, struct ToneData *tone)
+{
+    u32 wav = ReadWord(src + 4);
+    u32 cgbType = src[0] & TONEDATA_TYPE_CGB;
+
+    tone->type = src[0];
+    tone->key = src[1];
+    tone->length = src[2];
+    tone->pan_sweep = src[3];
+
+    if ((cgbType == 0 || cgbType == 3) && wav != 0)
+        tone->wav = (struct WaveData *)SoundDataPointer(wav);
+    else
+        tone->wav = (struct WaveData *)(uintptr_t)wav;
+
+    tone->attack = src[8];
+    tone->decay = src[9];
+    tone->sustain = src[10];
+    tone->release = src[11];
+}
+
+void ply_fine(struct MusicPlayerInfo *mplayInfo, struct MusicPlayerTrack *track)
+{
+    struct SoundChannel *chan = track->chan;
+
+    while (chan != NULL)
+    {
+        if (chan->status & 0xC7)
+            chan->status |= 0x40;
+
+        RealClearChain(chan);
+        chan = NextChan(chan);
+    }
+
+    track->flags = 0;
+    (void)mplayInfo;
+}
+
+void ply_goto(struct MusicPlayerInfo *mplayInfo, struct MusicPlayerTrack *track)
+{
+    track->cmdPtr = SoundDataPointer(ReadWord(track->cmdPtr));
+    (void)mplayInfo;
+}
+
+void ply_patt(struct MusicPlayerInfo *mplayInfo, struct MusicPlayerTrack *track)
+{
+    if (track->patternLevel >= 3)
+    {
+        ply_fine(mplayInfo, track);
+        return;
+    }
+
+    track->patternStack[track->patternLevel] = track->cmdPtr + 4;
+    track->patternLevel++;
+    ply_goto(mplayInfo, track);
+}
+
+void ply_pend(struct MusicPlayerInfo *mplayInfo, struct MusicPlayerTrack *track)
+{
+    if (track->patternLevel != 0)
+    {
+        track->patternLevel--;
+        track->cmdPtr = track->patternStack[track->patternLevel];
+    }
+
+    (void)mplayInfo;
+}
+
+void ply_rept(struct MusicPlayerInfo *mplayInfo, struct MusicPlayerTrack *track)
+{
+    u8 *cmdPtr = track->cmdPtr;
+
+    if (cmdPtr[0] == 0)
+    {
+        track->cmdPtr = cmdPtr + 1;
+        ply_goto(mplayInfo, track);
+        return;
+    }
+
+    track->repN++;
+
+    if (track->repN < cmdPtr[0])
+    {
+        track->cmdPtr = cmdPtr + 1;
+        ply_goto(mplayInfo, track);
+    }
+    else
+    {
+        track->repN = 0;
+        track->cmdPtr = cmdPtr + 5;
+    }
+}
+
+void ply_prio(struct MusicPlayerInfo *mplayInfo, struct MusicPlayerTrack *track)
+{
+    track->priority = ReadCmdByte(track);
+    (void)mplayInfo;
+}
+
+void ply_tempo(struct MusicPlayerInfo *mplayInfo, struct MusicPlayerTrack *track)
+{
+    u32 tempo = ReadCmdByte(track) * 2;
+
+    mplayInfo->tempoD = tempo;
+    mplayInfo->tempoI = (tempo * mplayInfo->tempoU) >> 8;
+}
+
+void ply_keysh(struct MusicPlayerInfo *mplayInfo, struct MusicPlayerTrack *track)
+{
+    track->keyShift = ReadCmdByte(track);
+    track->flags |= MPT_FLG_PITCHG;
+    (void)mplayInfo;
+}
+
+void ply_voice(struct MusicPlayerInfo *mplayInfo, struct MusicPlayerTrack *track)
+{
+    u8 voice = ReadCmdByte(track);
+
+    DecodeToneData((const u8 *)mplayInfo->tone + voice * 12, &track->tone);
+}
+
+void ply_vol(struct MusicPlayerInfo *mplayInfo, struct MusicPlayerTrack *track)
+{
+    track->vol = ReadCmdByte(track);
+    track->flags |= MPT_FLG_VOLCHG;
+    (void)mplayInfo;
+}
+
+void ply_pan(struct MusicPlayerInfo *mplayInfo, struct MusicPlayerTrack *track)
+{
+    track->pan = ReadCmdByte(track) - C_V;
+    track->flags |= MPT_FLG_VOLCHG;
+    (void)mplayInfo;
+}
+
+void ply_bend(struct MusicPlayerInfo *mplayInfo, struct MusicPlayerTrack *track)
+{
+    track->bend = ReadCmdByte(track) - C_V;
+    track->flags |= MPT_FLG_PITCHG;
+    (void)mplayInfo;
+}
+
+void ply_bendr(struct MusicPlayerInfo *mplayInfo, struct MusicPlayerTrack *track)
+{
+    track->bendRange = ReadCmdByte(track);
+    track->flags |= MPT_FLG_PITCHG;
+    (void)mplayInfo;
+}
+
+void ply_lfodl(struct MusicPlayerInfo *mplayInfo, struct MusicPlayerTrack *track)
+{
+    track->lfoDelay = ReadCmdByte(track);
+    (void)mplayInfo;
+}
+
+void ply_modt(struct MusicPlayerInfo *mplayInfo, struct MusicPlayerTrack *track)
+{
+    u8 modT = ReadCmdByte(track);
+
+    if (track->modT != modT)
+    {
+        track->modT = modT;
+        track->flags |= MPT_FLG_VOLCHG | MPT_FLG_PITCHG;
+    }
+
+    (void)mplayInfo;
+}
+
+void ply_tune(struct MusicPlayerInfo *mplayInfo, struct MusicPlayerTrack *track)
+{
+    track->tune = ReadCmdByte(track) - C_V;
+    track->flags |= MPT_FLG_PITCHG;
+    (void)mplayInfo;
+}
+
+void ply_port(struct MusicPlayerInfo *mplayInfo, struct MusicPlayerTrack *track)
+{
+    u8 reg = ReadCmdByte(track);
+
+    *(vu8 *)(REG_ADDR_SOUND1CNT_L + reg) = ReadCmdByte(track);
+    (void)mplayInfo;
+}
+
+static void clear_modM(struct MusicPlayerTrack *track)
+{
+    track->modM = 0;
+    track->lfoSpeedC = 0;
+    track->flags |= track->modT == 0 ? MPT_FLG_PITCHG : MPT_FLG_VOLCHG;
+}
+
+void ply_lfos(struct MusicPlayerInfo *mplayInfo, struct MusicPlayerTrack *track)
+{
+    track->lfoSpeed = ReadCmdByte(track);
+
+    if (track->lfoSpeed == 0)
+        clear_modM(track);
+
+    (void)mplayInfo;
+}
+
+void ply_mod(struct MusicPlayerInfo *mplayInfo, struct MusicPlayerTrack *track)
+{
+    track->mod = ReadCmdByte(track);
+
+    if (track->mod == 0)
+        clear_modM(track);
+
+    (void)mplayInfo;
+}
+
+void ply_endtie(struct MusicPlayerInfo *mplayInfo, struct MusicPlayerTrack *track)
+{
+    u8 key;
+
+    if (*track->cmdPtr < 0x80)
+        track->key = ReadCmdByte(track);
+
+    key = track->key;
+
+    for (struct SoundChannel *chan = track->chan; chan != NULL; chan = NextChan(chan))
+    {
+        if ((chan->status & 0x83) && !(chan->status & 0x40) && chan->mk == key)
+        {
+            chan->status |= 0x40;
+            break;
+        }
+    }
+
+    (void)mplayInfo;
+}
+
+void TrackStop(struct MusicPlayerInfo *mplayInfo, struct MusicPlayerTrack *track)
+{
+    if (!(track->flags & MPT_FLG_EXIST))
+        return;
+
+    for (struct SoundChannel *chan = track->chan; chan != NULL; chan = NextChan(chan))
+    {
+        if (chan->status != 0)
+        {
+            if (chan->type & TONEDATA_TYPE_CGB)
+                SOUND_INFO_PTR->CgbOscOff(chan->type & TONEDATA_TYPE_CGB);
+
+            chan->status = 0;
+        }
+
+        *ChanTrack(chan) = NULL;
+    }
+
+    track->chan = NULL;
+    (void)mplayInfo;
+}
+
+static void ChnVolSet(struct SoundChannel *chan, struct MusicPlayerTrack *track)
+{
+    s32 rhythmPan = (s8)chan->rp;
+    s32 right = ((0x80 + rhythmPan) * chan->ve * track->volMR) >> 14;
+    s32 left = ((0x7F - rhythmPan) * chan->ve * track->volML) >> 14;
+
+    chan->rightVolume = right > 0xFF ? 0xFF : right;
+    chan->leftVolume = left > 0xFF ? 0xFF : left;
+}
+
+// Finds a Direct Sound channel for a note: a free one, or else the releasing
+// channel with the lowest priority, or else the playing one with the lowest
+// priority, if it isn't higher than the note's.
+static struct SoundChannel *AllocDirectSoundChan(struct SoundInfo *soundInfo, struct MusicPlayerTrack *track, u32 priority)
+{
+    struct SoundChannel *chan = soundInfo->chans;
+    struct SoundChannel *best = NULL;
+    uintptr_t bestTrack = (uintptr_t)track;
+    bool foundReleasing = false;
+    s32 count = soundInfo->maxChans;
+
+    do
+    {
+        uintptr_t chanTrack = (uintptr_t)chan->track;
+
+        if (!(chan->status & 0xC7))
+            return chan;
+
+        if (chan->status & 0x40)
+        {
+            if (!foundReleasing)
+            {
+                foundReleasing = true;
+                priority = chan->pr;
+                bestTrack = chanTrack;
+                best = chan;
+                continue;
+            }
+        }
+        else if (foundReleasing)
+        {
+            continue;
+        }
+
+        if (chan->pr < priority)
+        {
+            priority = chan->pr;
+            bestTrack = chanTrack;
+            best = chan;
+        }
+        else if (chan->pr == priority && chanTrack >= bestTrack)
+        {
+            bestTrack = chanTrack;
+            best = chan;
+        }
+    } while (chan++, --count > 0);
+
+    return best;
+}
+
+void ply_note(u32 clockIndex, struct MusicPlayerInfo *mplayInfo, struct MusicPlayerTrack *track)
+{
+    struct SoundInfo *soundInfo = SOUND_INFO_PTR;
+    struct ToneData *tone = &track->tone;
+    struct ToneData splitTone;
+    struct SoundChannel *chan;
+    s32 rhythmPan = 0;
+    u32 key;
+    u32 priority;
+    u32 cgbType;
+
+    track->gateTime = gClockTable[clockIndex];
+
+    if (*track->cmdPtr < 0x80)
+    {
+        track->key = ReadCmdByte(track);
+
+        if (*track->cmdPtr < 0x80)
+        {
+            track->velocity = ReadCmdByte(track);
+
+            if (*track->cmdPtr < 0x80)
+                track->gateTime += ReadCmdByte(track);
+        }
+    }
+
+    key = track->key;
+
+    if (tone->type & (TONEDATA_TYPE_RHY | TONEDATA_TYPE_SPL))
+    {
+        u32 index = track->key;
+
+        if (tone->type & TONEDATA_TYPE_SPL)
+        {
+            // The key split table's address is kept where the envelope
+            // would be.
+            u32 keySplitTable = tone->attack | (tone->decay << 8) | (tone->sustain << 16) | ((u32)tone->release << 24);
+
+            index = *SoundDataPointer(keySplitTable + track->key);
+        }
+
+        DecodeToneData((const u8 *)tone->wav + index * 12, &splitTone);
+
+        if (splitTone.type & (TONEDATA_TYPE_RHY | TONEDATA_TYPE_SPL))
+            return;
+
+        if (tone->type & TONEDATA_TYPE_RHY)
+        {
+            if (splitTone.pan_sweep & 0x80)
+                rhythmPan = (s8)((splitTone.pan_sweep - TONEDATA_P_S_PAN) * 2);
+
+            key = splitTone.key;
+        }
+
+        tone = &splitTone;
+    }
+
+    priority = mplayInfo->priority + track->priority;
+
+    if (priority > 0xFF)
+        priority = 0xFF;
+
+    cgbType = tone->type & TONEDATA_TYPE_CGB;
+
+    if (cgbType != 0)
+    {
+        if (soundInfo->cgbChans == NULL)
+            return;
+
+        chan = (struct SoundChannel *)&soundInfo->cgbChans[cgbType - 1];
+
+        if ((chan->status & 0xC7) && !(chan->status & 0x40))
+        {
+            if (chan->pr > priority)
+                return;
+
+            if (chan->pr == priority && (uintptr_t)*ChanTrack(chan) < (uintptr_t)track)
+                return;
+        }
+    }
+    else
+    {
+        chan = AllocDirectSoundChan(soundInfo, track, priority);
+
+        if (chan == NULL)
+            return;
+    }
+
+    ClearChain(chan);
+    *ChanPrev(chan) = 0;
+    *ChanNext(chan) = ChanToHandle(track->chan);
+
+    if (track->chan != NULL)
+        *ChanPrev(track->chan) = ChanToHandle(chan);
+
+    track->chan = chan;
+    *ChanTrack(chan) = track;
+
+    track->lfoDelayC = track->lfoDelay;
+
+    if (track->lfoDelay != 0)
+        clear_modM(track);
+
+    TrkVolPitSet(mplayInfo, track);
+
+    chan->gt = track->gateTime;
+    chan->mk = track->key;
+    chan->ve = track->velocity;
+    chan->pr = priority;
+    chan->ky = key;
+    chan->rp = rhythmPan;
+    chan->type = tone->type;
+    chan->attack = tone->attack;
+    chan->decay = tone->decay;
+    chan->sustain = tone->sustain;
+    chan->release = tone->release;
+    chan->echoVolume = track->echoVolume;
+    chan->echoLength = track->echoLength;
+
+    ChnVolSet(chan, track);
+
+    s32 noteKey = chan->ky + (s8)track->keyM;
+
+    if (noteKey < 0)
+        noteKey = 0;
+
+    if (cgbType != 0)
+    {
+        struct CgbChannel *cgbChan = ToCgbChan(chan);
+        u8 sweep = tone->pan_sweep;
+
+        cgbChan->wp = (u32 *)tone->wav;
+        cgbChan->le = tone->length;
+        cgbChan->sw = ((sweep & 0x80) || !(sweep & 0x70)) ? 8 : sweep;
+        cgbChan->fr = soundInfo->MidiKeyToCgbFreq(cgbType, noteKey, track->pitM);
+    }
+    else
+    {
+        chan->wav = tone->wav;
+        chan->ct = track->unk_3C;
+        chan->freq = MidiKeyToFreq(chan->wav, noteKey, track->pitM);
+    }
+
+    chan->status = 0x80;
+    track->flags &= 0xF0;
+}
+
+// Plays one tick of a track's commands.
+static void TrackTick(struct MusicPlayerInfo *mplayInfo, struct MusicPlayerTrack *track, int trackIndex)
+{
+    for (struct SoundChannel *chan = track->chan; chan != NULL; chan = NextChan(chan))
+    {
+        if (!(chan->status & 0xC7))
+            ClearChain(chan);
+        else if (chan->gt != 0 && --chan->gt == 0)
+            chan->status |= 0x40;
+    }
+
+    if (track->flags & MPT_FLG_START)
+    {
+        Clear64byte(track);
+        track->flags = MPT_FLG_EXIST;
+        track->bendRange = 2;
+        track->volX = 64;
+        track->lfoSpeed = 22;
+        track->tone.type = 1;
+    }
+
+    while (track->wait == 0)
+    {
+        u8 cmd = *track->cmdPtr;
+
+        if (cmd < 0x80)
+        {
+            cmd = track->runningStatus;
+        }
+        else
+        {
+            track->cmdPtr++;
+
+            if (cmd >= 0xBD)
+                track->runningStatus = cmd;
+        }
+
+        if (cmd >= 0xCF)
+        {
+            ply_note(cmd - 0xCF, mplayInfo, track);
+        }
+        else if (cmd > 0xB0)
+        {
+            const u8 *cmdPtr = track->cmdPtr;
+            XcmdFunc func = (XcmdFunc)gMPlayJumpTable[cmd - 0xB1];
+
+            mplayInfo->cmd = cmd - 0xB1;
+            func(mplayInfo, track);
+
+            // 0xB2 is GOTO.
+            if (cmd == 0xB2 && track->cmdPtr <= cmdPtr)
+                gHostTrackLoops[trackIndex]++;
+
+            if (track->flags == 0)
+                return;
+        }
+        else
+        {
+            track->wait = gClockTable[cmd - 0x80];
+        }
+    }
+
+    track->wait--;
+
+    if (track->lfoSpeed == 0 || track->mod == 0)
+        return;
+
+    if (track->lfoDelayC != 0)
+    {
+        track->lfoDelayC--;
+        return;
+    }
+
+    u8 phase = track->lfoSpeedC += track->lfoSpeed;
+    s32 wave = ((u8)(phase - 64) & 0x80) ? (s8)phase : 128 - phase;
+
+    wave = (track->mod * wave) >> 6;
+
+    if ((s8)(track->modM ^ wave) != 0)
+    {
+        track->modM = wave;
+        track->flags |= track->modT == 0 ? MPT_FLG_PITCHG : MPT_FLG_VOLCHG;
+    }
+}
+
+void MPlayMain(struct MusicPlayerInfo *mplayInfo)
+{
+    struct SoundInfo *soundInfo = SOUND_INFO_PTR;
+    struct MusicPlayerTrack *track;
+    u32 tempoC;
+    s32 i;
+
+    if (mplayInfo->ident != ID_NUMBER)
+        return;
+
+    mplayInfo->ident++;
+
+    if (mplayInfo->status & MUSICPLAYER_STATUS_PAUSE)
+        goto done;
+
+    FadeOutBody(mplayInfo);
+
+    if (mplayInfo->status & MUSICPLAYER_STATUS_PAUSE)
+        goto done;
+
+    tempoC = mplayInfo->tempoC + mplayInfo->tempoI;
+
+    for (;;)
+    {
+        mplayInfo->tempoC = tempoC;
+
+        if (tempoC < 150)
+            break;
+
+        u32 active = 0;
+
+        for (i = 0, track = mplayInfo->tracks; i < mplayInfo->trackCount; i++, track++)
+        {
+            if (!(track->flags & MPT_FLG_EXIST))
+                continue;
+
+            active |= 1 << i;
+            TrackTick(mplayInfo, track, i);
+        }
+
+        mplayInfo->clock++;
+
+        if (active == 0)
+        {
+            mplayInfo->status = MUSICPLAYER_STATUS_PAUSE;
+            goto done;
+        }
+
+        mplayInfo->status = active;
+        tempoC = mplayInfo->tempoC - 150;
+    }
+
+    for (i = 0, track = mplayInfo->tracks; i < mplayInfo->trackCount; i++, track++)
+    {
+        if (!(track->flags & MPT_FLG_EXIST) || !(track->flags & 0xF))
+            continue;
+
+        TrkVolPitSet(mplayInfo, track);
+
+        for (struct SoundChannel *chan = track->chan; chan != NULL; chan = NextChan(chan))
+        {
+            u32 cgbType;
+
+            if (!(chan->status & 0xC7))
+            {
+                ClearChain(chan);
+                continue;
+            }
+
+            cgbType = chan->type & TONEDATA_TYPE_CGB;
+
+            if (track->flags & MPT_FLG_VOLCHG)
+            {
+                ChnVolSet(chan, track);
+
+                if (cgbType != 0)
+                    ToCgbChan(chan)->mo |= 1;
+            }
+
+            if (track->flags & MPT_FLG_PITCHG)
+            {
+                s32 key = chan->ky + (s8)track->keyM;
+
+                if (key < 0)
+                    key = 0;
+
+                if (cgbType != 0)
+                {
+                    ToCgbChan(chan)->fr = soundInfo->MidiKeyToCgbFreq(cgbType, key, track->pitM);
+                    ToCgbChan(chan)->mo |= 2;
+                }
+                else
+                {
+                    chan->freq = MidiKeyToFreq(chan->wav, key, track->pitM);
+                }
+            }
+        }
+
+        track->flags &= 0xF0;
+    }
+
+done:
+    mplayInfo->ident = ID_NUMBER;
+}
+
+// Mixer
+
+// Adds a sample to an 8-bit output sample, wrapping around like the
+// assembly's packed adds.
+static inline void MixSample(s8 *out, u32 volume, s32 sample)
+{
+    *out = (s8)(*out + (((s32)volume * sample) >> 8));
+}
+
+static s32 PcmBufferOffset(struct SoundInfo *soundInfo)
+{
+    u8 counter = soundInfo->pcmDmaCounter;
+
+    if (counter <= 1)
+        return 0;
+
+    return (soundInfo->pcmDmaPeriod - (counter - 1)) * soundInfo->pcmSamplesPerVBlank;
+}
+
+// Compressed samples are stored in blocks of 33 bytes, each a start sample
+// followed by 4-bit indexes into gDeltaEncodingTable, that make 64 samples.
+static s32 FetchSample(struct WaveData *wav, u32 index)
+{
+    if (wav->type == 0)
+        return wav->data[index];
+
+    u32 block = index >> 6;
+
+    if (block != sDecodedBlockIndex)
+    {
+        const u8 *src = (const u8 *)wav->data + block * 33;
+        s8 sample = src[0];
+
+        sDecodedBlockIndex = block;
+        sDecodedBlock[0] = sample;
+        sample += gDeltaEncodingTable[src[1] & 0xF];
+        sDecodedBlock[1] = sample;
+
+        for (int i = 2; i < 64; i += 2)
+        {
+            u8 deltas = src[1 + i / 2];
+
+            sample += gDeltaEncodingTable[deltas >> 4];
+            sDecodedBlock[i] = sample;
+            sample += gDeltaEncodingTable[deltas & 0xF];
+            sDecodedBlock[i + 1] = sample;
+        }
+    }
+
+    return sDecodedBlock[index & 0x3F];
+}
+
+// Reverse and compressed samples (sub_82DF49C in the assembly), which go
+// through FetchSample one at a time.
+static void MixSpecialChan(struct SoundInfo *soundInfo, struct SoundChannel *chan, s8 *out, u32 loopStart, s32 loopLength)
+{
+    struct WaveData *wav = chan->wav;
+    bool reverse = chan->type & 0x10;
+    s32 direction = reverse ? -1 : 1;
+    s32 samples = soundInfo->pcmSamplesPerVBlank;
+    u32 step = (chan->type & TONEDATA_TYPE_FIX) ? 0x800000 : soundInfo->divFreq * chan->freq;
+    u32 fw = chan->fw;
+    s32 ct = chan->ct;
+    s32 pos;
+
+    if (!(chan->status & 0x20))
+    {
+        chan->status |= 0x20;
+
+        if (reverse)
+            chan->cp = wav->size - chan->cp;
+    }
+
+    sDecodedBlockIndex = 0xFF000000;
+    pos = reverse ? (s32)chan->cp - 1 : (s32)chan->cp;
+
+    s32 current = FetchSample(wav, pos);
+    s32 delta = FetchSample(wav, pos + direction) - current;
+
+    for (s32 i = 0; i < samples; i++)
+    {
+        s32 sample = current + (((s32)fw * delta) >> 23);
+
+        MixSample(&out[i], chan->er, sample);
+        MixSample(&out[i + PCM_DMA_BUF_SIZE], chan->el, sample);
+
+        fw += step;
+
+        u32 advance = fw >> 23;
+
+        if (advance == 0)
+            continue;
+
+        fw &= 0x7FFFFF;
+        ct -= advance;
+
+        if (ct <= 0)
+        {
+            if (reverse || loopLength == 0)
+            {
+                chan->status = 0;
+                return;
+            }
+
+            s32 overshoot = -ct;
+
+            while ((ct += loopLength) <= 0)
+                overshoot -= loopLength;
+
+            pos = loopStart + overshoot;
+        }
+        else
+        {
+            pos += direction * (s32)advance;
+        }
+
+        current = FetchSample(wav, pos);
+        delta = FetchSample(wav, pos + direction) - current;
+    }
+
+    chan->fw = fw;
+    chan->ct = ct;
+    chan->cp = reverse ? pos + 1 : pos;
+}
+
+// Samples that play at their own rate, one per output sample.
+static void MixFixedChan(struct SoundInfo *soundInfo, struct SoundChannel *chan, s8 *out, u32 loopStart, s32 loopLength)
+{
+    const s8 *data = chan->wav->data;
+    s32 samples = soundInfo->pcmSamplesPerVBlank;
+    s32 ct = chan->ct;
+    u32 pos = chan->cp;
+
+    for (s32 i = 0; i < samples; i++)
+    {
+        s32 sample = data[pos++];
+
+        MixSample(&out[i], chan->er, sample);
+        MixSample(&out[i + PCM_DMA_BUF_SIZE], chan->el, sample);
+
+        if (--ct == 0)
+        {
+            if (loopLength == 0)
+            {
+                chan->status = 0;
+                return;
+            }
+
+            pos = loopStart;
+            ct = loopLength;
+        }
+    }
+
+    chan->ct = ct;
+    chan->cp = pos;
+}
+
+// Resamples with linear interpolation. fw is the position between two
+// samples, in 23-bit fixed point.
+static void MixResampledChan(struct SoundInfo *soundInfo, struct SoundChannel *chan, s8 *out, u32 loopStart, s32 loopLength)
+{
+    const s8 *data = chan->wav->data;
+    s32 samples = soundInfo->pcmSamplesPerVBlank;
+    u32 step = soundInfo->divFreq * chan->freq;
+    u32 fw = chan->fw;
+    s32 ct = chan->ct;
+    u32 pos = chan->cp;
+    s32 current = data[pos];
+    s32 delta = data[pos + 1] - current;
+
+    for (s32 i = 0; i < samples; i++)
+    {
+        s32 sample = current + (((s32)fw * delta) >> 23);
+
+        MixSample(&out[i], chan->er, sample);
+        MixSample(&out[i + PCM_DMA_BUF_SIZE], chan->el, sample);
+
+        fw += step;
+
+        u32 advance = fw >> 23;
+
+        if (advance == 0)
+            continue;
+
+        fw &= 0x7FFFFF;
+        ct -= advance;
+
+        if (ct <= 0)
+        {
+            if (loopLength == 0)
+            {
+                chan->status = 0;
+                return;
+            }
+
+            s32 overshoot = -ct;
+
+            while ((ct += loopLength) <= 0)
+                overshoot -= loopLength;
+
+            pos = loopStart + overshoot;
+        }
+        else
+        {
+            pos += advance;
+        }
+
+        current = data[pos];
+        delta = data[pos + 1] - current;
+    }
+
+    chan->fw = fw;
+    chan->ct = ct;
+    chan->cp = pos;
+}
+
+// Steps a channel's envelope. Returns false if the channel stopped.
+static bool UpdateEnvelope(struct SoundInfo *soundInfo, struct SoundChannel *chan)
+{
+    struct WaveData *wav = chan->wav;
+    u8 status = chan->status;
+    u32 ev;
+
+    if (status & 0x80)
+    {
+        if (status & 0x40)
+        {
+            chan->status = 0;
+            return false;
+        }
+
+        // Starts the note. cp counts samples from the start of the data.
+        status = 3;
+        chan->cp = chan->ct;
+        chan->ct = wav->size - chan->ct;
+        chan->fw = 0;
+        ev = 0;
+
+        if (wav->status & 0xC000)
+            status |= 0x10;
+
+        chan->status = status;
+        goto attack;
+    }
+
+    ev = chan->ev;
+
+    if (status & 0x04)
+    {
+        if (chan->echoLength-- <= 1)
+        {
+            chan->status = 0;
+            return false;
+        }
+    }
+    else if (status & 0x40)
+    {
+        ev = (ev * chan->release) >> 8;
+
+        if (ev <= chan->echoVolume)
+            goto echo;
+    }
+    else if ((status & 0x03) == 2)
+    {
+        ev = (ev * chan->decay) >> 8;
+
+        if (ev <= chan->sustain)
+        {
+            ev = chan->sustain;
+
+            if (ev == 0)
+                goto echo;
+
+            chan->status = --status;
+        }
+    }
+    else if ((status & 0x03) == 3)
+    {
+    attack:
+        ev += chan->attack;
+
+        if (ev >= 0xFF)
+        {
+            ev = 0xFF;
+            chan->status = --status;
+        }
+    }
+
+    goto store;
+
+echo:
+    ev = chan->echoVolume;
+
+    if (ev == 0)
+    {
+        chan->status = 0;
+        return false;
+    }
+
+    status |= 0x04;
+    chan->status = status;
+
+store:
+    chan->ev = ev;
+    ev = ((soundInfo->masterVolume + 1) * ev) >> 4;
+    chan->er = (chan->rightVolume * ev) >> 8;
+    chan->el = (chan->leftVolume * ev) >> 8;
+    return true;
+}
+
+static void MixFrame(struct SoundInfo *soundInfo)
+{
+    s32 samples = soundInfo->pcmSamplesPerVBlank;
+    s8 *out = HostMixedFrame();
+
+    if (soundInfo->reverb != 0)
+    {
+        // Feeds back the frame mixed a whole buffer ago.
+        s8 *past = soundInfo->pcmDmaCounter == 2 ? soundInfo->pcmBuffer : out + samples;
+
+        for (s32 i = 0; i < samples; i++)
+        {
+            s32 sum = out[i + PCM_DMA_BUF_SIZE] + out[i] + past[i + PCM_DMA_BUF_SIZE] + past[i];
+            s32 sample = (sum * soundInfo->reverb) >> 9;
+
+            if (sample & 0x80)
+                sample++;
+
+            out[i] = out[i + PCM_DMA_BUF_SIZE] = sample;
+        }
+    }
+    else
+    {
+        memset(out, 0, samples);
+        memset(out + PCM_DMA_BUF_SIZE, 0, samples);
+    }
+
+    struct SoundChannel *chan = soundInfo->chans;
+    s32 count = soundInfo->maxChans;
+
+    do
+    {
+        if (!(chan->status & 0xC7) || !UpdateEnvelope(soundInfo, chan))
+            continue;
+
+        struct WaveData *wav = chan->wav;
+        u32 loopStart = 0;
+        s32 loopLength = 0;
+
+        if (chan->status & 0x10)
+        {
+            loopStart = wav->loopStart;
+            loopLength = wav->size - wav->loopStart;
+        }
+
+        if (chan->type & 0x30)
+            MixSpecialChan(soundInfo, chan, out, loopStart, loopLength);
+        else if (chan->type & TONEDATA_TYPE_FIX)
+            MixFixedChan(soundInfo, chan, out, loopStart, loopLength);
+        else
+            MixResampledChan(soundInfo, chan, out, loopStart, loopLength);
+    } while (chan++, --count > 0);
+}
+
+void SoundMain(void)
+{
+    struct SoundInfo *soundInfo = SOUND_INFO_PTR;
+
+    if (soundInfo->ident != ID_NUMBER)
+        return;
+
+    soundInfo->ident++;
+    MPlayMain(&gMPlayInfo_BGM);
+    soundInfo->CgbSound();
+    MixFrame(soundInfo);
+    soundInfo->ident = ID_NUMBER;
+}
+
+void HostSoundMix(void)
+{
+    struct SoundInfo *soundInfo = SOUND_INFO_PTR;
+
+    if (soundInfo->ident != ID_NUMBER)
+        return;
+
+    soundInfo->ident++;
+    soundInfo->CgbSound();
+    MixFrame(soundInfo);
+    soundInfo->ident = ID_NUMBER;
+}
+
+s8 *HostMixedFrame(void)
+{
+    return SOUND_INFO_PTR->pcmBuffer + PcmBufferOffset(SOUND_INFO_PTR);
+}
+
+void HostSoundVSync(void)
+{
+    struct SoundInfo *soundInfo = SOUND_INFO_PTR;
+
+    if (soundInfo->ident - ID_NUMBER > 1)
+        return;
+
+    if ((s8)--soundInfo->pcmDmaCounter <= 0)
+        soundInfo->pcmDmaCounter = soundInfo->pcmDmaPeriod;
+}
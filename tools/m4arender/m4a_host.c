@@ -0,0 +1,122 @@
+// Builds src/m4a.c and src/m4a_tables.c for the host, against the headers
+// in shim/gba, and sets the engine up the way m4aSoundInit would.
+//
+// The files are used as is. Their inline assembly only matters on the GBA,
+// so it's dropped, and so is the section that puts the mixer's RAM copy in
+// IWRAM. The engine keeps a few pointers in u32 fields, which is harmless
+// here because the renderer never calls through them.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define asm(...)
+#define section(name) unused
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpointer-to-int-cast"
+#pragma GCC diagnostic ignored "-Wint-to-pointer-cast"
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#pragma GCC diagnostic ignored "-Wsign-compare"
+#pragma GCC diagnostic ignored "-Wmissing-braces"
+
+#include "../../src/m4a.c"
+#include "../../src/m4a_tables.c"
+
+#pragma GCC diagnostic pop
+
+#undef asm
+#undef section
+
+#include "sound_data.h"
+
+// The I/O registers, and the pointer the GBA keeps at the end of IWRAM.
+ALIGNED(4) u8 gHostIoRegs[HOST_IO_REG_SIZE];
+struct SoundInfo *gHostSoundInfoPtr;
+
+u16 gHostTrackLoops[MAX_MUSICPLAYER_TRACKS];
+
+// What the rest of the game would provide. None of it is used, since the
+// renderer drives a single music player itself.
+const struct MusicPlayer gMPlayTable[1];
+const struct Song gSongTable[1];
+char gNumMusicPlayers[1];
+char gMaxLines[1];
+char SoundMainRAM[1];
+const struct ToneData voicegroup000;
+
+static struct MusicPlayerTrack sTracks[MAX_MUSICPLAYER_TRACKS];
+
+static struct
+{
+    struct SongHeader header;
+    u8 *parts[MAX_MUSICPLAYER_TRACKS];
+} sSongHeader;
+
+void HostSoundInit(u32 freq)
+{
+    struct SoundInfo *soundInfo = &gSoundInfo;
+
+    // SoundInit, without the DMA setup.
+    SOUND_INFO_PTR = soundInfo;
+    memset(soundInfo, 0, sizeof(*soundInfo));
+
+    soundInfo->maxChans = 8;
+    soundInfo->masterVolume = 15;
+    soundInfo->CgbSound = DummyFunc;
+    soundInfo->CgbOscOff = (void (*)(u8))DummyFunc;
+    soundInfo->MidiKeyToCgbFreq = (u32 (*)(u8, u8, u8))DummyFunc;
+
+    REG_SOUNDCNT_H = SOUND_B_FIFO_RESET | SOUND_B_TIMER_0 | SOUND_B_LEFT_OUTPUT
+                   | SOUND_A_FIFO_RESET | SOUND_A_TIMER_0 | SOUND_A_RIGHT_OUTPUT
+                   | SOUND_ALL_MIX_FULL;
+
+    MPlayJumpTableCopy(gMPlayJumpTable);
+
+    // SampleFreqSet, which also waits for VBlank.
+    soundInfo->freq = freq;
+    soundInfo->pcmSamplesPerVBlank = gPcmSamplesPerVBlankTable[freq - 1];
+    soundInfo->pcmDmaPeriod = PCM_DMA_BUF_SIZE / soundInfo->pcmSamplesPerVBlank;
+    soundInfo->pcmFreq = (597275 * soundInfo->pcmSamplesPerVBlank + 5000) / 10000;
+    soundInfo->divFreq = (16777216 / soundInfo->pcmFreq + 1) >> 1;
+
+    soundInfo->ident = ID_NUMBER;
+
+    MPlayExtender(gCgbChans);
+    soundInfo->maxLines = 0;
+
+    m4aSoundMode(SOUND_MODE_DA_BIT_8
+               | (12 << SOUND_MODE_MASVOL_SHIFT)
+               | (5 << SOUND_MODE_MAXCHN_SHIFT));
+
+    MPlayOpen(&gMPlayInfo_BGM, sTracks, MAX_MUSICPLAYER_TRACKS);
+    gMPlayInfo_BGM.memAccArea = gMPlayMemAccArea;
+}
+
+void HostSongStart(u32 songAddress)
+{
+    const u8 *src = SoundDataPointer(songAddress);
+    struct SongHeader *header = &sSongHeader.header;
+    u32 voiceGroup = src[4] | (src[5] << 8) | (src[6] << 16) | ((u32)src[7] << 24);
+
+    header->trackCount = src[0];
+    header->blockCount = src[1];
+    header->priority = src[2];
+    header->reverb = src[3];
+    header->tone = (struct ToneData *)SoundDataPointer(voiceGroup);
+
+    if (header->trackCount > MAX_MUSICPLAYER_TRACKS)
+        header->trackCount = MAX_MUSICPLAYER_TRACKS;
+
+    for (int i = 0; i < header->trackCount; i++)
+    {
+        const u8 *p = src + 8 + i * 4;
+
+        header->part[i] = SoundDataPointer(p[0] | (p[1] << 8) | (p[2] << 16) | ((u32)p[3] << 24));
+    }
+
+    memset(gHostTrackLoops, 0, sizeof(gHostTrackLoops));
+    MPlayStart(&gMPlayInfo_BGM, header);
+}
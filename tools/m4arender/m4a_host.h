@@ -0,0 +1,46 @@
+#ifndef M4A_HOST_H
+#define M4A_HOST_H
+
+// The engine's header declares some of the functions written in assembly
+// without the arguments they take in registers. The host versions take them
+// as ordinary arguments, so those prototypes are renamed out of the way.
+#define MPlayMain MPlayMain_NoArgs
+#define SoundMainBTM SoundMainBTM_NoArgs
+#define ply_note ply_note_NoClock
+#include "gba/m4a_internal.h"
+#undef MPlayMain
+#undef SoundMainBTM
+#undef ply_note
+
+void MPlayMain(struct MusicPlayerInfo *mplayInfo);
+void SoundMainBTM(void *x);
+void ply_note(u32 clockIndex, struct MusicPlayerInfo *mplayInfo, struct MusicPlayerTrack *track);
+u32 MidiKeyToFreq(struct WaveData *wav, u8 key, u8 fineAdjust);
+void MPlayFadeOut(struct MusicPlayerInfo *mplayInfo, u16 speed);
+
+extern struct SoundInfo gSoundInfo;
+extern struct MusicPlayerInfo gMPlayInfo_BGM;
+
+// The number of times each track has jumped back with GOTO, which is how
+// songs loop.
+extern u16 gHostTrackLoops[MAX_MUSICPLAYER_TRACKS];
+
+// Does what m4aSoundInit does for one music player, without the hardware
+// setup. freq is one of the engine's sample rates, 1 to 12.
+void HostSoundInit(u32 freq);
+
+// Starts the song whose header is at a ROM address in the sound data.
+void HostSongStart(u32 songAddress);
+
+// SoundMain without the sequencer: updates the CGB channels and mixes one
+// frame of Direct Sound into the PCM buffer.
+void HostSoundMix(void);
+
+// The frame HostSoundMix just mixed. The right channel comes first and the
+// left channel is PCM_DMA_BUF_SIZE bytes after it.
+s8 *HostMixedFrame(void);
+
+// Counts down to the next PCM DMA, like m4aSoundVSync.
+void HostSoundVSync(void);
+
+#endif // M4A_HOST_H
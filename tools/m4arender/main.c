@@ -0,0 +1,308 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "global.h"
+#include "m4a_host.h"
+#include "sound_data.h"
+#include "cgb.h"
+#include "wav.h"
+
+// The sound data every song refers to, as data/sound_data.s includes it.
+static const char *const sSoundDataFiles[] =
+{
+    "asm/macros/music_voice.inc",
+    "sound/voice_groups.inc",
+    "sound/keysplit_tables.inc",
+    "sound/programmable_wave_data.inc",
+    "sound/direct_sound_data.inc",
+};
+
+struct Options
+{
+    const char *songPath;
+    const char *wavPath;
+    const char *label;
+    int loops;
+    int maxSeconds;
+    int freq;
+};
+
+struct Timing
+{
+    uint64_t totalNs;
+    uint64_t maxNs;
+};
+
+static void Usage(void)
+{
+    fprintf(stderr,
+        "Usage: m4arender SONG.s [OUT.wav] [options]\n"
+        "Plays a song through the m4a engine and prints how long the sequencer\n"
+        "and mixer took. Run it from the repository's root.\n"
+        "\n"
+        "Options:\n"
+        "  --label NAME     the song's label (default: the file's name)\n"
+        "  --loops N        fade out after the song loops N times, or never if 0\n"
+        "                   (default: 1)\n"
+        "  --max-seconds N  stop after N seconds (default: 600)\n"
+        "  --freq N         the engine's sample rate, 1 to 12 (default: 4, 13379 Hz)\n"
+        "  -I DIR           search DIR for included files\n");
+    exit(1);
+}
+
+static int ParseNumber(const char *arg, const char *option, int min, int max)
+{
+    char *end;
+    long value;
+
+    if (arg == NULL)
+        FATAL_ERROR("%s needs a value.\n", option);
+
+    value = strtol(arg, &end, 10);
+
+    if (*end != '\0' || value < min || value > max)
+        FATAL_ERROR("%s must be a number from %d to %d.\n", option, min, max);
+
+    return value;
+}
+
+static void ParseOptions(int argc, char **argv, struct Options *options)
+{
+    int numPaths = 0;
+
+    options->loops = 1;
+    options->maxSeconds = 600;
+    options->freq = 4;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+
+        if (strcmp(arg, "--label") == 0)
+        {
+            if (++i == argc)
+                FATAL_ERROR("--label needs a value.\n");
+
+            options->label = argv[i];
+        }
+        else if (strcmp(arg, "--loops") == 0)
+        {
+            options->loops = ParseNumber(argv[++i], arg, 0, 1000);
+        }
+        else if (strcmp(arg, "--max-seconds") == 0)
+        {
+            options->maxSeconds = ParseNumber(argv[++i], arg, 1, 36000);
+        }
+        else if (strcmp(arg, "--freq") == 0)
+        {
+            options->freq = ParseNumber(argv[++i], arg, 1, 12);
+        }
+        else if (strcmp(arg, "-I") == 0)
+        {
+            if (++i == argc)
+                FATAL_ERROR("-I needs a directory.\n");
+
+            AddSoundIncludeDir(argv[i]);
+        }
+        else if (arg[0] == '-' && arg[1] != '\0')
+        {
+            Usage();
+        }
+        else if (numPaths == 0)
+        {
+            options->songPath = arg;
+            numPaths++;
+        }
+        else if (numPaths == 1)
+        {
+            options->wavPath = arg;
+            numPaths++;
+        }
+        else
+        {
+            Usage();
+        }
+    }
+
+    if (options->songPath == NULL)
+        Usage();
+}
+
+// Returns the song file's name without its directory or extension, which is
+// what mid2agb names the song's header.
+static char *DefaultLabel(const char *path)
+{
+    const char *name = strrchr(path, '/');
+    char *label = strdup(name != NULL ? name + 1 : path);
+    char *extension = strrchr(label, '.');
+
+    if (extension != NULL)
+        *extension = '\0';
+
+    return label;
+}
+
+static uint64_t NowNs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void AddTiming(struct Timing *timing, uint64_t ns)
+{
+    timing->totalNs += ns;
+
+    if (ns > timing->maxNs)
+        timing->maxNs = ns;
+}
+
+static int CountActiveChannels(void)
+{
+    int count = 0;
+
+    for (int i = 0; i < gSoundInfo.maxChans; i++)
+        if (gSoundInfo.chans[i].status & 0xC7)
+            count++;
+
+    for (int i = 0; i < 4; i++)
+        if (gSoundInfo.cgbChans[i].sf & 0xC7)
+            count++;
+
+    return count;
+}
+
+static int MaxTrackLoops(void)
+{
+    int loops = 0;
+
+    for (int i = 0; i < MAX_MUSICPLAYER_TRACKS; i++)
+        if (gHostTrackLoops[i] > loops)
+            loops = gHostTrackLoops[i];
+
+    return loops;
+}
+
+int main(int argc, char **argv)
+{
+    struct Options options = {0};
+    struct Timing sequencerTiming = {0};
+    struct Timing mixerTiming = {0};
+    int32_t left[PCM_DMA_BUF_SIZE];
+    int32_t right[PCM_DMA_BUF_SIZE];
+    int16_t *samples = NULL;
+    uint32_t frameCount = 0;
+    uint32_t sampleCount = 0;
+    uint32_t capacity = 0;
+    uint64_t hash = 0xCBF29CE484222325;
+    int peakChannels = 0;
+    bool fading = false;
+
+    ParseOptions(argc, argv, &options);
+
+    AddSoundIncludeDir("sound");
+
+    for (size_t i = 0; i < sizeof(sSoundDataFiles) / sizeof(sSoundDataFiles[0]); i++)
+        AssembleSoundFile(sSoundDataFiles[i]);
+
+    AssembleSoundFile(options.songPath);
+    FinishSoundData();
+
+    if (options.label == NULL)
+        options.label = DefaultLabel(options.songPath);
+
+    HostSoundInit(options.freq);
+    InitCgbSynth(gSoundInfo.pcmFreq);
+    HostSongStart(LookUpSoundSymbol(options.label));
+
+    int samplesPerFrame = gSoundInfo.pcmSamplesPerVBlank;
+    uint32_t maxFrames = (uint64_t)options.maxSeconds * gSoundInfo.pcmFreq / samplesPerFrame;
+
+    while (frameCount < maxFrames)
+    {
+        uint64_t start = NowNs();
+
+        MPlayMain(&gMPlayInfo_BGM);
+
+        uint64_t sequenced = NowNs();
+
+        HostSoundMix();
+        AddTiming(&sequencerTiming, sequenced - start);
+        AddTiming(&mixerTiming, NowNs() - sequenced);
+
+        s8 *frame = HostMixedFrame();
+        int activeChannels = CountActiveChannels();
+
+        if (activeChannels > peakChannels)
+            peakChannels = activeChannels;
+
+        for (int i = 0; i < samplesPerFrame; i++)
+        {
+            right[i] = frame[i] * 4;
+            left[i] = frame[i + PCM_DMA_BUF_SIZE] * 4;
+        }
+
+        RenderCgbFrame(left, right, samplesPerFrame);
+
+        if (sampleCount + samplesPerFrame * 2 > capacity)
+        {
+            capacity = capacity ? capacity * 2 : 0x100000;
+            samples = realloc(samples, capacity * sizeof(*samples));
+
+            if (samples == NULL)
+                FATAL_ERROR("Failed to allocate memory for the samples.\n");
+        }
+
+        for (int i = 0; i < samplesPerFrame; i++)
+        {
+            int32_t pair[2] = { left[i] * 32, right[i] * 32 };
+
+            for (int j = 0; j < 2; j++)
+            {
+                int32_t value = pair[j] < -32768 ? -32768 : pair[j] > 32767 ? 32767 : pair[j];
+
+                samples[sampleCount++] = value;
+                hash = (hash ^ (value & 0xFF)) * 0x100000001B3;
+                hash = (hash ^ ((value >> 8) & 0xFF)) * 0x100000001B3;
+            }
+        }
+
+        HostSoundVSync();
+        frameCount++;
+
+        // Once the song has ended, or looped enough times and faded out,
+        // the notes it left playing are allowed to finish.
+        if (gMPlayInfo_BGM.status & MUSICPLAYER_STATUS_PAUSE)
+        {
+            if (activeChannels == 0)
+                break;
+        }
+        else if (!fading && options.loops != 0 && MaxTrackLoops() >= options.loops)
+        {
+            MPlayFadeOut(&gMPlayInfo_BGM, 2);
+            fading = true;
+        }
+    }
+
+    if (options.wavPath != NULL)
+        WriteWavFile(options.wavPath, samples, frameCount * samplesPerFrame, gSoundInfo.pcmFreq);
+
+    printf("song:        %s\n", options.label);
+    printf("frames:      %u (%.2f s at %u Hz)\n", frameCount,
+        (double)frameCount * samplesPerFrame / gSoundInfo.pcmFreq, gSoundInfo.pcmFreq);
+    printf("sequencer:   %.3f us/frame avg, %.3f us max\n",
+        sequencerTiming.totalNs / 1000.0 / frameCount, sequencerTiming.maxNs / 1000.0);
+    printf("mixer:       %.3f us/frame avg, %.3f us max\n",
+        mixerTiming.totalNs / 1000.0 / frameCount, mixerTiming.maxNs / 1000.0);
+    printf("peak voices: %d\n", peakChannels);
+    printf("pcm hash:    %016llx\n", (unsigned long long)hash);
+
+    free(samples);
+    return 0;
+}
@@ -0,0 +1,28 @@
+#ifndef GUARD_GBA_GBA_H
+#define GUARD_GBA_GBA_H
+
+// Stands in for include/gba/gba.h when the engine's C code is built for the
+// host. The real headers are used for everything but the memory map: I/O
+// registers live in an ordinary array, which the renderer reads back to
+// play the CGB channels, and SOUND_INFO_PTR is an ordinary variable.
+
+#include <stdint.h>
+#include "gba/defines.h"
+#include "gba/io_reg.h"
+#include "gba/types.h"
+#include "gba/multiboot.h"
+#include "gba/syscall.h"
+#include "gba/macro.h"
+
+#define HOST_IO_REG_SIZE 0x400
+
+extern u8 gHostIoRegs[HOST_IO_REG_SIZE];
+extern struct SoundInfo *gHostSoundInfoPtr;
+
+#undef REG_BASE
+#define REG_BASE ((uintptr_t)gHostIoRegs)
+
+#undef SOUND_INFO_PTR
+#define SOUND_INFO_PTR gHostSoundInfoPtr
+
+#endif // GUARD_GBA_GBA_H
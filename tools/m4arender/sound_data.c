@@ -0,0 +1,1250 @@
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "global.h"
+#include "sound_data.h"
+
+#define HASH_SIZE 4096
+#define MAX_INCLUDE_DIRS 16
+#define MAX_MACRO_PARAMS 16
+#define MAX_COND_DEPTH 32
+#define MAX_NESTING 64
+
+struct Symbol
+{
+    char *name;
+    int64_t value;
+    // A symbol assigned an expression that refers to symbols defined later
+    // keeps the expression until it's first used.
+    char *expr;
+    uint32_t dot;
+    bool isLabel;
+    bool evaluating;
+    struct Symbol *next;
+};
+
+// Data that referred to a symbol defined after it.
+struct Fixup
+{
+    uint32_t offset;
+    int size;
+    char *expr;
+    uint32_t dot;
+    char *location;
+};
+
+struct Macro
+{
+    char *name;
+    int numParams;
+    char *params[MAX_MACRO_PARAMS];
+    char *defaults[MAX_MACRO_PARAMS];
+    bool required[MAX_MACRO_PARAMS];
+    char **lines;
+    int numLines;
+    int lineCapacity;
+    struct Macro *next;
+};
+
+struct Conditional
+{
+    bool active;
+    bool taken;
+};
+
+struct ExprState
+{
+    const char *p;
+    uint32_t dot;
+    bool resolved;
+};
+
+static unsigned char *sImage;
+static uint32_t sSize;
+static uint32_t sCapacity;
+
+static struct Symbol *sSymbols[HASH_SIZE];
+static struct Macro *sMacros[HASH_SIZE];
+
+static struct Fixup *sFixups;
+static int sNumFixups;
+static int sFixupCapacity;
+
+static char *sIncludeDirs[MAX_INCLUDE_DIRS];
+static int sNumIncludeDirs;
+
+static struct Macro *sRecordingMacro;
+static int sRecordingDepth;
+
+static struct Conditional sConds[MAX_COND_DEPTH];
+static int sCondDepth;
+
+static const char *sFileName = "";
+static int sLineNum;
+static bool sEndOfFile;
+static int sNesting;
+
+#define ASM_ERROR(format, ...) FATAL_ERROR("%s:%d: " format, sFileName, sLineNum, ##__VA_ARGS__)
+
+static void ProcessLine(const char *line);
+
+static char *DuplicateString(const char *s, size_t length)
+{
+    char *copy = malloc(length + 1);
+
+    if (copy == NULL)
+        FATAL_ERROR("Failed to allocate memory for a string.\n");
+
+    memcpy(copy, s, length);
+    copy[length] = 0;
+    return copy;
+}
+
+static unsigned int Hash(const char *s)
+{
+    uint32_t hash = 2166136261u;
+
+    while (*s)
+    {
+        hash ^= (unsigned char)*s++;
+        hash *= 16777619u;
+    }
+
+    return hash % HASH_SIZE;
+}
+
+static char *SkipSpace(const char *s)
+{
+    while (isspace((unsigned char)*s))
+        s++;
+
+    return (char *)s;
+}
+
+static char *Trim(char *s)
+{
+    s = SkipSpace(s);
+
+    size_t length = strlen(s);
+
+    while (length > 0 && isspace((unsigned char)s[length - 1]))
+        s[--length] = 0;
+
+    return s;
+}
+
+static bool IsSymbolStart(char c)
+{
+    return isalpha((unsigned char)c) || c == '_' || c == '.' || c == '$';
+}
+
+static bool IsSymbolChar(char c)
+{
+    return isalnum((unsigned char)c) || c == '_' || c == '.' || c == '$';
+}
+
+static size_t SymbolLength(const char *s)
+{
+    size_t length = 0;
+
+    if (!IsSymbolStart(s[0]))
+        return 0;
+
+    while (IsSymbolChar(s[length]))
+        length++;
+
+    return length;
+}
+
+static struct Symbol *FindSymbol(const char *name)
+{
+    for (struct Symbol *sym = sSymbols[Hash(name)]; sym != NULL; sym = sym->next)
+    {
+        if (strcmp(sym->name, name) == 0)
+            return sym;
+    }
+
+    return NULL;
+}
+
+static struct Symbol *AddSymbol(const char *name)
+{
+    struct Symbol *sym = FindSymbol(name);
+
+    if (sym != NULL)
+    {
+        if (sym->isLabel)
+            ASM_ERROR("Symbol \"%s\" is already defined.\n", name);
+
+        free(sym->expr);
+        sym->expr = NULL;
+        return sym;
+    }
+
+    unsigned int hash = Hash(name);
+
+    sym = calloc(1, sizeof(struct Symbol));
+
+    if (sym == NULL)
+        FATAL_ERROR("Failed to allocate memory for a symbol.\n");
+
+    sym->name = DuplicateString(name, strlen(name));
+    sym->next = sSymbols[hash];
+    sSymbols[hash] = sym;
+    return sym;
+}
+
+static struct Macro *FindMacro(const char *name)
+{
+    for (struct Macro *macro = sMacros[Hash(name)]; macro != NULL; macro = macro->next)
+    {
+        if (strcmp(macro->name, name) == 0)
+            return macro;
+    }
+
+    return NULL;
+}
+
+static void EnsureCapacity(uint32_t size)
+{
+    if (size <= sCapacity)
+        return;
+
+    while (sCapacity < size)
+        sCapacity = sCapacity ? sCapacity * 2 : 0x10000;
+
+    sImage = realloc(sImage, sCapacity);
+
+    if (sImage == NULL)
+        FATAL_ERROR("Failed to allocate memory for the sound data.\n");
+}
+
+static void EmitBytes(const void *data, uint32_t size)
+{
+    if (size == 0)
+        return;
+
+    EnsureCapacity(sSize + size);
+    memcpy(sImage + sSize, data, size);
+    sSize += size;
+}
+
+static void EmitFill(int value, uint32_t size)
+{
+    if (size == 0)
+        return;
+
+    EnsureCapacity(sSize + size);
+    memset(sImage + sSize, value, size);
+    sSize += size;
+}
+
+static uint32_t Dot(void)
+{
+    return SOUND_DATA_BASE + sSize;
+}
+
+// Expressions follow the operator precedence of GNU as, which differs from
+// C's: the bitwise operators bind tighter than addition, and comparisons are
+// as loose as addition.
+static int64_t ParseExprLevel(struct ExprState *state, int level);
+
+static bool LookUpValue(const char *name, int64_t *value)
+{
+    struct Symbol *sym = FindSymbol(name);
+
+    if (sym == NULL)
+        return false;
+
+    if (sym->expr != NULL)
+    {
+        if (sym->evaluating)
+            ASM_ERROR("Symbol \"%s\" is defined in terms of itself.\n", name);
+
+        struct ExprState state = { sym->expr, sym->dot, true };
+
+        sym->evaluating = true;
+        int64_t result = ParseExprLevel(&state, 4);
+        sym->evaluating = false;
+
+        if (!state.resolved)
+            return false;
+
+        free(sym->expr);
+        sym->expr = NULL;
+        sym->value = result;
+    }
+
+    *value = sym->value;
+    return true;
+}
+
+static int64_t ParsePrimary(struct ExprState *state)
+{
+    const char *p = SkipSpace(state->p);
+
+    if (*p == '(')
+    {
+        state->p = p + 1;
+
+        int64_t value = ParseExprLevel(state, 4);
+
+        p = SkipSpace(state->p);
+
+        if (*p != ')')
+            ASM_ERROR("Missing ')' in expression.\n");
+
+        state->p = p + 1;
+        return value;
+    }
+
+    if (*p == '-' || *p == '~' || *p == '!' || *p == '+')
+    {
+        char op = *p;
+
+        state->p = p + 1;
+
+        int64_t value = ParsePrimary(state);
+
+        if (op == '-')
+            return -value;
+        if (op == '~')
+            return ~value;
+        if (op == '!')
+            return !value;
+        return value;
+    }
+
+    if (isdigit((unsigned char)*p))
+    {
+        int base = 10;
+
+        if (p[0] == '0' && (p[1] == 'x' || p[1] == 'X'))
+        {
+            base = 16;
+            p += 2;
+        }
+        else if (p[0] == '0' && (p[1] == 'b' || p[1] == 'B'))
+        {
+            base = 2;
+            p += 2;
+        }
+        else if (p[0] == '0')
+        {
+            base = 8;
+        }
+
+        char *end;
+        int64_t value = strtoll(p, &end, base);
+
+        if (end == p && base != 8)
+            ASM_ERROR("Bad number in expression.\n");
+
+        state->p = end;
+        return value;
+    }
+
+    if (*p == '\'' && p[1] != 0)
+    {
+        state->p = p[2] == '\'' ? p + 3 : p + 2;
+        return (unsigned char)p[1];
+    }
+
+    size_t length = SymbolLength(p);
+
+    if (length == 0)
+        ASM_ERROR("Bad expression \"%s\".\n", p);
+
+    state->p = p + length;
+
+    if (length == 1 && p[0] == '.')
+        return state->dot;
+
+    char name[256];
+    int64_t value;
+
+    if (length >= sizeof(name))
+        ASM_ERROR("Symbol name is too long.\n");
+
+    memcpy(name, p, length);
+    name[length] = 0;
+
+    if (!LookUpValue(name, &value))
+    {
+        state->resolved = false;
+        return 0;
+    }
+
+    return value;
+}
+
+// Returns the operator at p for a precedence level, or NULL.
+static const char *MatchOperator(const char *p, int level)
+{
+    static const char *const operators[][10] = {
+        { NULL },
+        { "<<", ">>", "*", "/", "%", NULL },
+        { "|", "&", "^", NULL },
+        { "==", "!=", "<>", "<=", ">=", "+", "-", "<", ">", NULL },
+        { "&&", "||", NULL },
+    };
+
+    for (int i = 0; operators[level][i] != NULL; i++)
+    {
+        size_t length = strlen(operators[level][i]);
+
+        if (strncmp(p, operators[level][i], length) != 0)
+            continue;
+
+        // Don't take the start of a longer operator from another level.
+        if (length == 1 && (p[1] == p[0] || p[1] == '=') && strchr("<>&|", p[0]) != NULL)
+            continue;
+
+        return operators[level][i];
+    }
+
+    return NULL;
+}
+
+static int64_t ParseExprLevel(struct ExprState *state, int level)
+{
+    if (level == 0)
+        return ParsePrimary(state);
+
+    int64_t value = ParseExprLevel(state, level - 1);
+
+    for (;;)
+    {
+        const char *p = SkipSpace(state->p);
+        const char *op = MatchOperator(p, level);
+
+        if (op == NULL)
+            return value;
+
+        state->p = p + strlen(op);
+
+        int64_t rhs = ParseExprLevel(state, level - 1);
+
+        if (strcmp(op, "*") == 0)
+            value *= rhs;
+        else if (strcmp(op, "/") == 0 || strcmp(op, "%") == 0)
+        {
+            if (rhs == 0)
+            {
+                if (state->resolved)
+                    ASM_ERROR("Division by zero.\n");
+                value = 0;
+            }
+            else
+            {
+                value = op[0] == '/' ? value / rhs : value % rhs;
+            }
+        }
+        else if (strcmp(op, "<<") == 0)
+            value = (int64_t)((uint64_t)value << (rhs & 63));
+        else if (strcmp(op, ">>") == 0)
+            value >>= (rhs & 63);
+        else if (strcmp(op, "|") == 0)
+            value |= rhs;
+        else if (strcmp(op, "&") == 0)
+            value &= rhs;
+        else if (strcmp(op, "^") == 0)
+            value ^= rhs;
+        else if (strcmp(op, "+") == 0)
+            value += rhs;
+        else if (strcmp(op, "-") == 0)
+            value -= rhs;
+        else if (strcmp(op, "==") == 0)
+            value = value == rhs ? -1 : 0;
+        else if (strcmp(op, "!=") == 0 || strcmp(op, "<>") == 0)
+            value = value != rhs ? -1 : 0;
+        else if (strcmp(op, "<") == 0)
+            value = value < rhs ? -1 : 0;
+        else if (strcmp(op, ">") == 0)
+            value = value > rhs ? -1 : 0;
+        else if (strcmp(op, "<=") == 0)
+            value = value <= rhs ? -1 : 0;
+        else if (strcmp(op, ">=") == 0)
+            value = value >= rhs ? -1 : 0;
+        else if (strcmp(op, "&&") == 0)
+            value = value && rhs;
+        else
+            value = value || rhs;
+    }
+}
+
+// Evaluates a whole expression. Returns false if it refers to a symbol
+// that isn't defined yet.
+static bool Evaluate(const char *expr, uint32_t dot, int64_t *value)
+{
+    struct ExprState state = { expr, dot, true };
+
+    *value = ParseExprLevel(&state, 4);
+
+    if (*SkipSpace(state.p) != 0)
+        ASM_ERROR("Junk at the end of expression \"%s\".\n", expr);
+
+    return state.resolved;
+}
+
+static int64_t EvaluateNow(const char *expr)
+{
+    int64_t value;
+
+    if (!Evaluate(expr, Dot(), &value))
+        ASM_ERROR("Expression \"%s\" refers to an undefined symbol.\n", expr);
+
+    return value;
+}
+
+// Splits the arguments of a directive or macro at commas that aren't in
+// parentheses or quotes. The string is modified in place.
+static int SplitArguments(char *s, char **args, int maxArgs)
+{
+    int count = 0;
+    int depth = 0;
+    bool quoted = false;
+    char *start = s;
+
+    if (*Trim(s) == 0)
+        return 0;
+
+    for (char *p = s;; p++)
+    {
+        if (*p == '"')
+            quoted = !quoted;
+        else if (!quoted && *p == '(')
+            depth++;
+        else if (!quoted && *p == ')')
+            depth--;
+
+        if (*p == 0 || (*p == ',' && depth == 0 && !quoted))
+        {
+            bool end = *p == 0;
+
+            if (count == maxArgs)
+                ASM_ERROR("Too many arguments.\n");
+
+            *p = 0;
+            args[count++] = Trim(start);
+            start = p + 1;
+
+            if (end)
+                return count;
+        }
+    }
+}
+
+static void WriteValue(uint32_t offset, int64_t value, int size)
+{
+    for (int i = 0; i < size; i++)
+        sImage[offset + i] = (unsigned char)(value >> (8 * i));
+}
+
+static void EmitValue(const char *expr, int size)
+{
+    int64_t value;
+    uint32_t offset = sSize;
+
+    EmitFill(0, size);
+
+    if (Evaluate(expr, SOUND_DATA_BASE + offset, &value))
+    {
+        WriteValue(offset, value, size);
+        return;
+    }
+
+    if (sNumFixups == sFixupCapacity)
+    {
+        sFixupCapacity = sFixupCapacity ? sFixupCapacity * 2 : 256;
+        sFixups = realloc(sFixups, sFixupCapacity * sizeof(struct Fixup));
+
+        if (sFixups == NULL)
+            FATAL_ERROR("Failed to allocate memory for fixups.\n");
+    }
+
+    struct Fixup *fixup = &sFixups[sNumFixups++];
+    char location[1024];
+
+    snprintf(location, sizeof(location), "%s:%d", sFileName, sLineNum);
+    fixup->offset = offset;
+    fixup->size = size;
+    fixup->expr = DuplicateString(expr, strlen(expr));
+    fixup->dot = SOUND_DATA_BASE + offset;
+    fixup->location = DuplicateString(location, strlen(location));
+}
+
+static char *ParseString(char *s)
+{
+    s = SkipSpace(s);
+
+    if (*s != '"')
+        ASM_ERROR("Expected a quoted string.\n");
+
+    char *end = strchr(s + 1, '"');
+
+    if (end == NULL)
+        ASM_ERROR("Missing closing quote.\n");
+
+    *end = 0;
+    return s + 1;
+}
+
+// Looks for a file in the current directory, then in the include dirs.
+static FILE *OpenIncludedFile(const char *path, char *foundPath, size_t foundPathSize)
+{
+    snprintf(foundPath, foundPathSize, "%s", path);
+
+    FILE *fp = fopen(foundPath, "rb");
+
+    for (int i = 0; fp == NULL && i < sNumIncludeDirs; i++)
+    {
+        snprintf(foundPath, foundPathSize, "%s/%s", sIncludeDirs[i], path);
+        fp = fopen(foundPath, "rb");
+    }
+
+    if (fp == NULL)
+        ASM_ERROR("Can't find \"%s\".\n", path);
+
+    return fp;
+}
+
+static char *ReadWholeFile(FILE *fp, long *size_p)
+{
+    fseek(fp, 0, SEEK_END);
+
+    long size = ftell(fp);
+
+    if (size < 0)
+        FATAL_ERROR("Failed to get the size of a file.\n");
+
+    char *buffer = malloc(size + 1);
+
+    if (buffer == NULL)
+        FATAL_ERROR("Failed to allocate memory for a file.\n");
+
+    rewind(fp);
+
+    if (fread(buffer, size, 1, fp) != 1 && size != 0)
+        FATAL_ERROR("Failed to read a file.\n");
+
+    buffer[size] = 0;
+    *size_p = size;
+    return buffer;
+}
+
+static void AssembleFile(const char *path)
+{
+    char foundPath[1024];
+    FILE *fp = OpenIncludedFile(path, foundPath, sizeof(foundPath));
+    long size;
+    char *buffer = ReadWholeFile(fp, &size);
+
+    fclose(fp);
+
+    if (++sNesting > MAX_NESTING)
+        ASM_ERROR("Includes are nested too deeply.\n");
+
+    const char *savedFileName = sFileName;
+    int savedLineNum = sLineNum;
+    char *fileName = DuplicateString(foundPath, strlen(foundPath));
+
+    sFileName = fileName;
+    sLineNum = 0;
+    sEndOfFile = false;
+
+    char *line = buffer;
+
+    while (line != NULL && !sEndOfFile)
+    {
+        char *next = strchr(line, '\n');
+
+        if (next != NULL)
+            *next++ = 0;
+
+        sLineNum++;
+        ProcessLine(line);
+        line = next;
+    }
+
+    if (sRecordingMacro != NULL && savedFileName[0] == 0)
+        ASM_ERROR("Missing .endm for macro \"%s\".\n", sRecordingMacro->name);
+
+    sFileName = savedFileName;
+    sLineNum = savedLineNum;
+    sEndOfFile = false;
+    sNesting--;
+    free(buffer);
+}
+
+static void IncludeBinary(char *args)
+{
+    char *argv[3];
+    int argc = SplitArguments(args, argv, 3);
+
+    if (argc == 0)
+        ASM_ERROR(".incbin needs a file name.\n");
+
+    char foundPath[1024];
+    FILE *fp = OpenIncludedFile(ParseString(argv[0]), foundPath, sizeof(foundPath));
+    long size;
+    char *data = ReadWholeFile(fp, &size);
+    int64_t skip = argc > 1 ? EvaluateNow(argv[1]) : 0;
+    int64_t count = argc > 2 ? EvaluateNow(argv[2]) : size - skip;
+
+    fclose(fp);
+
+    if (skip < 0 || count < 0 || skip + count > size)
+        ASM_ERROR("The range given to .incbin is outside the file.\n");
+
+    EmitBytes(data + skip, count);
+    free(data);
+}
+
+static void StartMacro(char *args)
+{
+    size_t nameLength = SymbolLength(args);
+
+    if (nameLength == 0)
+        ASM_ERROR(".macro needs a name.\n");
+
+    struct Macro *macro = calloc(1, sizeof(struct Macro));
+
+    if (macro == NULL)
+        FATAL_ERROR("Failed to allocate memory for a macro.\n");
+
+    macro->name = DuplicateString(args, nameLength);
+
+    // Parameters may be separated by commas or spaces.
+    char *p = args + nameLength;
+
+    for (;;)
+    {
+        while (isspace((unsigned char)*p) || *p == ',')
+            p++;
+
+        size_t length = SymbolLength(p);
+
+        if (length == 0)
+            break;
+
+        if (macro->numParams == MAX_MACRO_PARAMS)
+            ASM_ERROR("Macro \"%s\" has too many parameters.\n", macro->name);
+
+        int i = macro->numParams++;
+
+        macro->params[i] = DuplicateString(p, length);
+        p += length;
+
+        if (strncmp(p, ":req", 4) == 0)
+        {
+            macro->required[i] = true;
+            p += 4;
+        }
+        else if (*p == '=')
+        {
+            char *start = ++p;
+
+            while (*p != 0 && *p != ',' && !isspace((unsigned char)*p))
+                p++;
+
+            macro->defaults[i] = DuplicateString(start, p - start);
+        }
+    }
+
+    if (*p != 0)
+        ASM_ERROR("Bad parameter list for macro \"%s\".\n", macro->name);
+
+    sRecordingMacro = macro;
+    sRecordingDepth = 1;
+}
+
+static void AddMacroLine(const char *line)
+{
+    struct Macro *macro = sRecordingMacro;
+
+    if (macro->numLines == macro->lineCapacity)
+    {
+        macro->lineCapacity = macro->lineCapacity ? macro->lineCapacity * 2 : 16;
+        macro->lines = realloc(macro->lines, macro->lineCapacity * sizeof(char *));
+
+        if (macro->lines == NULL)
+            FATAL_ERROR("Failed to allocate memory for a macro.\n");
+    }
+
+    macro->lines[macro->numLines++] = DuplicateString(line, strlen(line));
+}
+
+static void FinishMacro(void)
+{
+    struct Macro *macro = sRecordingMacro;
+    unsigned int hash = Hash(macro->name);
+
+    macro->next = sMacros[hash];
+    sMacros[hash] = macro;
+    sRecordingMacro = NULL;
+}
+
+static void ExpandMacro(struct Macro *macro, char *args)
+{
+    char *argv[MAX_MACRO_PARAMS];
+    int argc = SplitArguments(args, argv, MAX_MACRO_PARAMS);
+    const char *values[MAX_MACRO_PARAMS];
+
+    if (argc > macro->numParams)
+        ASM_ERROR("Too many arguments for macro \"%s\".\n", macro->name);
+
+    for (int i = 0; i < macro->numParams; i++)
+    {
+        values[i] = i < argc && argv[i][0] != 0 ? argv[i] : macro->defaults[i];
+
+        if (values[i] == NULL)
+        {
+            if (macro->required[i])
+                ASM_ERROR("Missing argument \"%s\" for macro \"%s\".\n", macro->params[i], macro->name);
+
+            values[i] = "";
+        }
+    }
+
+    if (++sNesting > MAX_NESTING)
+        ASM_ERROR("Macros are nested too deeply.\n");
+
+    for (int n = 0; n < macro->numLines; n++)
+    {
+        const char *src = macro->lines[n];
+        size_t capacity = strlen(src) + 1;
+        size_t length = 0;
+        char *line = malloc(capacity);
+
+        if (line == NULL)
+            FATAL_ERROR("Failed to allocate memory for a macro line.\n");
+
+        while (*src)
+        {
+            const char *insert = NULL;
+            size_t insertLength = 0;
+            size_t skip = 1;
+
+            if (src[0] == '\\' && src[1] == '(' && src[2] == ')')
+            {
+                insert = "";
+                skip = 3;
+            }
+            else if (src[0] == '\\')
+            {
+                size_t nameLength = SymbolLength(src + 1);
+
+                for (int i = 0; i < macro->numParams; i++)
+                {
+                    if (strlen(macro->params[i]) == nameLength && strncmp(macro->params[i], src + 1, nameLength) == 0)
+                    {
+                        insert = values[i];
+                        skip = 1 + nameLength;
+                        break;
+                    }
+                }
+            }
+
+            if (insert == NULL)
+            {
+                insert = src;
+                insertLength = 1;
+            }
+            else
+            {
+                insertLength = strlen(insert);
+            }
+
+            if (length + insertLength + 1 > capacity)
+            {
+                capacity = (length + insertLength + 1) * 2;
+                line = realloc(line, capacity);
+
+                if (line == NULL)
+                    FATAL_ERROR("Failed to allocate memory for a macro line.\n");
+            }
+
+            memcpy(line + length, insert, insertLength);
+            length += insertLength;
+            src += skip;
+        }
+
+        line[length] = 0;
+        ProcessLine(line);
+        free(line);
+    }
+
+    sNesting--;
+}
+
+static bool ConditionActive(void)
+{
+    return sCondDepth == 0 || sConds[sCondDepth - 1].active;
+}
+
+static bool HandleConditional(const char *directive, char *args)
+{
+    if (strcmp(directive, ".if") == 0 || strcmp(directive, ".ifdef") == 0 || strcmp(directive, ".ifndef") == 0)
+    {
+        bool parentActive = ConditionActive();
+        bool condition = false;
+
+        if (sCondDepth == MAX_COND_DEPTH)
+            ASM_ERROR("Conditionals are nested too deeply.\n");
+
+        if (parentActive)
+        {
+            if (strcmp(directive, ".if") == 0)
+                condition = EvaluateNow(args) != 0;
+            else
+                condition = (FindSymbol(Trim(args)) != NULL) == (strcmp(directive, ".ifdef") == 0);
+        }
+
+        sConds[sCondDepth].active = parentActive && condition;
+        sConds[sCondDepth].taken = !parentActive || condition;
+        sCondDepth++;
+        return true;
+    }
+
+    if (strcmp(directive, ".else") == 0)
+    {
+        if (sCondDepth == 0)
+            ASM_ERROR(".else without .if\n");
+
+        struct Conditional *cond = &sConds[sCondDepth - 1];
+
+        cond->active = !cond->taken;
+        cond->taken = true;
+        return true;
+    }
+
+    if (strcmp(directive, ".endif") == 0)
+    {
+        if (sCondDepth == 0)
+            ASM_ERROR(".endif without .if\n");
+
+        sCondDepth--;
+        return true;
+    }
+
+    return false;
+}
+
+static void AssignSymbol(const char *name, const char *expr)
+{
+    struct Symbol *sym = AddSymbol(name);
+    int64_t value;
+
+    if (Evaluate(expr, Dot(), &value))
+    {
+        sym->value = value;
+        return;
+    }
+
+    sym->expr = DuplicateString(expr, strlen(expr));
+    sym->dot = Dot();
+}
+
+static void HandleDirective(const char *directive, char *args)
+{
+    static const char *const ignored[] = {
+        ".section", ".text", ".data", ".rodata", ".global", ".globl",
+        ".syntax", ".type", ".size", ".thumb", ".arm", ".code", NULL,
+    };
+
+    int size = 0;
+
+    if (strcmp(directive, ".byte") == 0)
+        size = 1;
+    else if (strcmp(directive, ".2byte") == 0 || strcmp(directive, ".hword") == 0 || strcmp(directive, ".short") == 0)
+        size = 2;
+    else if (strcmp(directive, ".4byte") == 0 || strcmp(directive, ".word") == 0 || strcmp(directive, ".long") == 0 || strcmp(directive, ".int") == 0)
+        size = 4;
+
+    if (size != 0)
+    {
+        char *argv[64];
+        int argc = SplitArguments(args, argv, 64);
+
+        for (int i = 0; i < argc; i++)
+            EmitValue(argv[i], size);
+
+        return;
+    }
+
+    if (strcmp(directive, ".align") == 0 || strcmp(directive, ".p2align") == 0 || strcmp(directive, ".balign") == 0)
+    {
+        char *argv[2];
+        int argc = SplitArguments(args, argv, 2);
+
+        if (argc == 0)
+            ASM_ERROR("%s needs an alignment.\n", directive);
+
+        int64_t alignment = EvaluateNow(argv[0]);
+        int fill = argc > 1 ? (int)EvaluateNow(argv[1]) : 0;
+
+        // On ARM, .align takes a power of two, like .p2align.
+        if (strcmp(directive, ".balign") != 0)
+            alignment = (int64_t)1 << alignment;
+
+        if (alignment > 1)
+            EmitFill(fill, (alignment - sSize % alignment) % alignment);
+
+        return;
+    }
+
+    if (strcmp(directive, ".space") == 0 || strcmp(directive, ".skip") == 0)
+    {
+        char *argv[2];
+        int argc = SplitArguments(args, argv, 2);
+
+        if (argc == 0)
+            ASM_ERROR("%s needs a size.\n", directive);
+
+        EmitFill(argc > 1 ? (int)EvaluateNow(argv[1]) : 0, EvaluateNow(argv[0]));
+        return;
+    }
+
+    if (strcmp(directive, ".incbin") == 0)
+    {
+        IncludeBinary(args);
+        return;
+    }
+
+    if (strcmp(directive, ".include") == 0)
+    {
+        AssembleFile(ParseString(args));
+        return;
+    }
+
+    if (strcmp(directive, ".equ") == 0 || strcmp(directive, ".set") == 0)
+    {
+        char *argv[2];
+
+        if (SplitArguments(args, argv, 2) != 2 || SymbolLength(argv[0]) != strlen(argv[0]))
+            ASM_ERROR("%s needs a symbol and a value.\n", directive);
+
+        AssignSymbol(argv[0], argv[1]);
+        return;
+    }
+
+    if (strcmp(directive, ".macro") == 0)
+    {
+        StartMacro(args);
+        return;
+    }
+
+    if (strcmp(directive, ".end") == 0)
+    {
+        sEndOfFile = true;
+        return;
+    }
+
+    for (int i = 0; ignored[i] != NULL; i++)
+    {
+        if (strcmp(directive, ignored[i]) == 0)
+            return;
+    }
+
+    ASM_ERROR("Unknown directive \"%s\".\n", directive);
+}
+
+static void ProcessStatement(char *s)
+{
+    // Labels
+    for (;;)
+    {
+        s = SkipSpace(s);
+
+        size_t length = SymbolLength(s);
+
+        if (length == 0 || s[length] != ':')
+            break;
+
+        if (ConditionActive())
+        {
+            s[length] = 0;
+
+            struct Symbol *sym = AddSymbol(s);
+
+            sym->value = Dot();
+            sym->isLabel = true;
+        }
+
+        s += length + 1;
+
+        if (*s == ':')
+            s++;
+    }
+
+    s = Trim(s);
+
+    if (*s == 0)
+        return;
+
+    char *args = s;
+
+    while (*args != 0 && !isspace((unsigned char)*args))
+        args++;
+
+    if (*args != 0)
+        *args++ = 0;
+
+    args = Trim(args);
+
+    if (s[0] == '.' && HandleConditional(s, args))
+        return;
+
+    if (!ConditionActive())
+        return;
+
+    if (args[0] == '=' && args[1] != '=' && SymbolLength(s) == strlen(s))
+    {
+        AssignSymbol(s, SkipSpace(args + 1));
+        return;
+    }
+
+    struct Macro *macro = FindMacro(s);
+
+    if (macro != NULL)
+        ExpandMacro(macro, args);
+    else if (s[0] == '.')
+        HandleDirective(s, args);
+    else
+        ASM_ERROR("Unknown instruction \"%s\".\n", s);
+}
+
+static void ProcessLine(const char *line)
+{
+    size_t length = strlen(line);
+    char *copy = DuplicateString(line, length);
+    bool quoted = false;
+
+    // Strips the comment, which runs from an @ to the end of the line.
+    for (char *p = copy; *p; p++)
+    {
+        if (*p == '"')
+            quoted = !quoted;
+        else if (!quoted && (*p == '@' || *p == '\r'))
+        {
+            *p = 0;
+            break;
+        }
+    }
+
+    char *s = SkipSpace(copy);
+
+    if (*s == '#')
+    {
+        free(copy);
+        return;
+    }
+
+    if (sRecordingMacro != NULL)
+    {
+        size_t wordLength = SymbolLength(s);
+
+        if (wordLength == 6 && strncmp(s, ".macro", 6) == 0)
+            sRecordingDepth++;
+        else if (wordLength == 5 && strncmp(s, ".endm", 5) == 0 && --sRecordingDepth == 0)
+        {
+            FinishMacro();
+            free(copy);
+            return;
+        }
+
+        AddMacroLine(copy);
+        free(copy);
+        return;
+    }
+
+    // A semicolon separates statements on the same line.
+    char *start = copy;
+
+    quoted = false;
+
+    for (char *p = copy;; p++)
+    {
+        if (*p == '"')
+            quoted = !quoted;
+
+        if (*p == 0 || (*p == ';' && !quoted))
+        {
+            bool end = *p == 0;
+
+            *p = 0;
+            ProcessStatement(start);
+
+            if (end || sEndOfFile || sRecordingMacro != NULL)
+                break;
+
+            start = p + 1;
+        }
+    }
+
+    free(copy);
+}
+
+void AddSoundIncludeDir(const char *dir)
+{
+    if (sNumIncludeDirs == MAX_INCLUDE_DIRS)
+        FATAL_ERROR("Too many include directories.\n");
+
+    sIncludeDirs[sNumIncludeDirs++] = DuplicateString(dir, strlen(dir));
+}
+
+void AssembleSoundFile(const char *path)
+{
+    AssembleFile(path);
+
+    if (sCondDepth != 0)
+        FATAL_ERROR("%s: Missing .endif.\n", path);
+}
+
+void FinishSoundData(void)
+{
+    for (int i = 0; i < sNumFixups; i++)
+    {
+        struct Fixup *fixup = &sFixups[i];
+        int64_t value;
+
+        sFileName = fixup->location;
+        sLineNum = 0;
+
+        if (!Evaluate(fixup->expr, fixup->dot, &value))
+            FATAL_ERROR("%s: Expression \"%s\" refers to an undefined symbol.\n", fixup->location, fixup->expr);
+
+        WriteValue(fixup->offset, value, fixup->size);
+        free(fixup->expr);
+        free(fixup->location);
+    }
+
+    sNumFixups = 0;
+    sFileName = "";
+
+    // The mixer reads a sample past the one it's playing, even at the end
+    // of the data.
+    EnsureCapacity(sSize + 16);
+    memset(sImage + sSize, 0, 16);
+}
+
+uint32_t LookUpSoundSymbol(const char *name)
+{
+    int64_t value;
+
+    if (!LookUpValue(name, &value))
+        FATAL_ERROR("Symbol \"%s\" isn't defined.\n", name);
+
+    return (uint32_t)value;
+}
+
+unsigned char *SoundDataPointer(uint32_t address)
+{
+    if (address < SOUND_DATA_BASE || address - SOUND_DATA_BASE >= sSize)
+        FATAL_ERROR("Address 0x%08X is outside the sound data.\n", address);
+
+    return sImage + (address - SOUND_DATA_BASE);
+}
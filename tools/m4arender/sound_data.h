@@ -0,0 +1,29 @@
+#ifndef SOUND_DATA_H
+#define SOUND_DATA_H
+
+#include <stdint.h>
+
+// Assembles the game's sound data into an image of the ROM it would be
+// linked into, so the engine can follow the addresses in it. Only the subset
+// of GNU as that the sound data uses is understood: data directives, labels,
+// symbol assignments, macros and conditionals.
+
+#define SOUND_DATA_BASE 0x08000000
+
+// Adds a directory to search for .include and .incbin files after the
+// current directory.
+void AddSoundIncludeDir(const char *dir);
+
+// Appends a file to the image.
+void AssembleSoundFile(const char *path);
+
+// Fills in the data that referred to symbols defined after it. Call once,
+// after the last file.
+void FinishSoundData(void);
+
+uint32_t LookUpSoundSymbol(const char *name);
+
+// Returns a pointer into the image for a ROM address.
+unsigned char *SoundDataPointer(uint32_t address);
+
+#endif // SOUND_DATA_H
@@ -0,0 +1,55 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "global.h"
+#include "wav.h"
+
+static void PutU16(unsigned char *p, uint16_t value)
+{
+    p[0] = value;
+    p[1] = value >> 8;
+}
+
+static void PutU32(unsigned char *p, uint32_t value)
+{
+    PutU16(p, value);
+    PutU16(p + 2, value >> 16);
+}
+
+void WriteWavFile(const char *path, const int16_t *samples, uint32_t frameCount, uint32_t sampleRate)
+{
+    unsigned char header[44];
+    uint32_t dataSize = frameCount * 4;
+    FILE *fp = fopen(path, "wb");
+
+    if (fp == NULL)
+        FATAL_ERROR("Failed to open \"%s\" for writing.\n", path);
+
+    memcpy(header, "RIFF", 4);
+    PutU32(header + 4, 36 + dataSize);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    PutU32(header + 16, 16);
+    PutU16(header + 20, 1);
+    PutU16(header + 22, 2);
+    PutU32(header + 24, sampleRate);
+    PutU32(header + 28, sampleRate * 4);
+    PutU16(header + 32, 4);
+    PutU16(header + 34, 16);
+    memcpy(header + 36, "data", 4);
+    PutU32(header + 40, dataSize);
+
+    if (fwrite(header, sizeof(header), 1, fp) != 1)
+        FATAL_ERROR("Failed to write \"%s\".\n", path);
+
+    for (uint32_t i = 0; i < frameCount * 2; i++)
+    {
+        unsigned char sample[2];
+
+        PutU16(sample, samples[i]);
+
+        if (fwrite(sample, 2, 1, fp) != 1)
+            FATAL_ERROR("Failed to write \"%s\".\n", path);
+    }
+
+    fclose(fp);
+}
@@ -0,0 +1,9 @@
+#ifndef WAV_H
+#define WAV_H
+
+#include <stdint.h>
+
+// Writes 16-bit stereo samples, left first, to a WAV file.
+void WriteWavFile(const char *path, const int16_t *samples, uint32_t frameCount, uint32_t sampleRate);
+
+#endif // WAV_H
@@ -0,0 +1,377 @@
+// json_arena.cpp
+
+#include "json_arena.h"
+
+#include <cstdlib>
+#include <cstring>
+
+using std::string;
+
+static const int max_depth = 200;
+
+class JsonParser {
+public:
+    JsonParser(JsonDoc &doc) : doc(doc), pos(doc.text.data()), failed(false) {}
+
+    bool parse(string &err) {
+        parse_value(nullptr, 0, 0);
+        skip_whitespace();
+
+        if (!failed && *pos != 0)
+            fail("unexpected trailing " + describe(*pos));
+
+        if (failed)
+            err = error;
+
+        return !failed;
+    }
+
+private:
+    JsonDoc &doc;
+    char *pos;
+    bool failed;
+    string error;
+
+    void fail(string msg) {
+        if (failed)
+            return;
+
+        int line = 1;
+        for (const char *c = doc.text.data(); c < pos; c++)
+            if (*c == '\n')
+                line++;
+
+        error = msg + " on line " + std::to_string(line);
+        failed = true;
+    }
+
+    static string describe(char c) {
+        if (c == 0)
+            return "end of input";
+        if (static_cast<unsigned char>(c) < 0x20)
+            return "character " + std::to_string(static_cast<int>(c));
+        return string("'") + c + "'";
+    }
+
+    void skip_whitespace() {
+        while (*pos == ' ' || *pos == '\t' || *pos == '\n' || *pos == '\r')
+            pos++;
+    }
+
+    uint32_t add_node(JsonRef::Type type, const char *key, uint32_t key_len) {
+        JsonDoc::Node node = {};
+        node.type = type;
+        node.key = key;
+        node.key_len = key_len;
+        doc.nodes.push_back(node);
+        return static_cast<uint32_t>(doc.nodes.size() - 1);
+    }
+
+    static void encode_utf8(unsigned long cp, char *&out) {
+        if (cp < 0x80) {
+            *out++ = static_cast<char>(cp);
+        } else if (cp < 0x800) {
+            *out++ = static_cast<char>((cp >> 6) | 0xC0);
+            *out++ = static_cast<char>((cp & 0x3F) | 0x80);
+        } else if (cp < 0x10000) {
+            *out++ = static_cast<char>((cp >> 12) | 0xE0);
+            *out++ = static_cast<char>(((cp >> 6) & 0x3F) | 0x80);
+            *out++ = static_cast<char>((cp & 0x3F) | 0x80);
+        } else {
+            *out++ = static_cast<char>((cp >> 18) | 0xF0);
+            *out++ = static_cast<char>(((cp >> 12) & 0x3F) | 0x80);
+            *out++ = static_cast<char>(((cp >> 6) & 0x3F) | 0x80);
+            *out++ = static_cast<char>((cp & 0x3F) | 0x80);
+        }
+    }
+
+    bool parse_hex4(unsigned long &value) {
+        value = 0;
+        for (int i = 0; i < 4; i++) {
+            char c = *pos++;
+            value <<= 4;
+            if (c >= '0' && c <= '9')
+                value |= c - '0';
+            else if (c >= 'a' && c <= 'f')
+                value |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F')
+                value |= c - 'A' + 10;
+            else {
+                fail("bad \\u escape");
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Decodes the string starting after the opening quote in place. Escapes
+    // never decode to more bytes than they take up, so the decoded string
+    // fits where the original was.
+    bool parse_string(const char *&str, uint32_t &len) {
+        char *out = pos;
+        str = pos;
+
+        for (;;) {
+            char c = *pos;
+
+            if (c == 0) {
+                fail("unexpected end of input in string");
+                return false;
+            }
+
+            pos++;
+
+            if (c == '"')
+                break;
+
+            if (static_cast<unsigned char>(c) < 0x20) {
+                fail("unescaped " + describe(c) + " in string");
+                return false;
+            }
+
+            if (c != '\\') {
+                *out++ = c;
+                continue;
+            }
+
+            c = *pos++;
+
+            switch (c) {
+            case '"': case '\\': case '/': *out++ = c; break;
+            case 'b': *out++ = '\b'; break;
+            case 'f': *out++ = '\f'; break;
+            case 'n': *out++ = '\n'; break;
+            case 'r': *out++ = '\r'; break;
+            case 't': *out++ = '\t'; break;
+            case 'u': {
+                unsigned long cp;
+                if (!parse_hex4(cp))
+                    return false;
+                if (cp >= 0xD800 && cp <= 0xDBFF && pos[0] == '\\' && pos[1] == 'u') {
+                    unsigned long low;
+                    pos += 2;
+                    if (!parse_hex4(low))
+                        return false;
+                    if (low >= 0xDC00 && low <= 0xDFFF) {
+                        cp = (((cp - 0xD800) << 10) | (low - 0xDC00)) + 0x10000;
+                    } else {
+                        encode_utf8(cp, out);
+                        cp = low;
+                    }
+                }
+                encode_utf8(cp, out);
+                break;
+            }
+            default:
+                fail("invalid escape " + describe(c) + " in string");
+                return false;
+            }
+        }
+
+        len = static_cast<uint32_t>(out - str);
+        return true;
+    }
+
+    bool expect(const char *word) {
+        size_t len = strlen(word);
+        if (strncmp(pos, word, len) != 0) {
+            fail("expected " + string(word) + ", got " + describe(*pos));
+            return false;
+        }
+        pos += len;
+        return true;
+    }
+
+    uint32_t parse_value(const char *key, uint32_t key_len, int depth) {
+        if (depth > max_depth) {
+            fail("exceeded maximum nesting depth");
+            return 0;
+        }
+
+        skip_whitespace();
+
+        char c = *pos;
+
+        if (c == '"') {
+            pos++;
+            uint32_t index = add_node(JsonRef::STRING, key, key_len);
+            const char *str;
+            uint32_t len;
+            if (parse_string(str, len)) {
+                doc.nodes[index].str = str;
+                doc.nodes[index].str_len = len;
+            }
+            return index;
+        }
+
+        if (c == '-' || (c >= '0' && c <= '9')) {
+            uint32_t index = add_node(JsonRef::NUMBER, key, key_len);
+            char *end;
+            doc.nodes[index].number = strtod(pos, &end);
+            if (end == pos)
+                fail("invalid number");
+            pos = end;
+            return index;
+        }
+
+        if (c == 't' || c == 'f') {
+            uint32_t index = add_node(JsonRef::BOOL, key, key_len);
+            doc.nodes[index].boolean = c == 't';
+            expect(c == 't' ? "true" : "false");
+            return index;
+        }
+
+        if (c == 'n') {
+            uint32_t index = add_node(JsonRef::NUL, key, key_len);
+            expect("null");
+            return index;
+        }
+
+        if (c == '[' || c == '{') {
+            bool is_object = c == '{';
+            char close = is_object ? '}' : ']';
+            uint32_t index = add_node(is_object ? JsonRef::OBJECT : JsonRef::ARRAY, key, key_len);
+            uint32_t last_child = 0;
+            uint32_t size = 0;
+
+            pos++;
+            skip_whitespace();
+
+            if (*pos == close) {
+                pos++;
+                return index;
+            }
+
+            while (!failed) {
+                const char *child_key = nullptr;
+                uint32_t child_key_len = 0;
+
+                if (is_object) {
+                    skip_whitespace();
+                    if (*pos != '"') {
+                        fail("expected '\"' in object, got " + describe(*pos));
+                        break;
+                    }
+                    pos++;
+                    if (!parse_string(child_key, child_key_len))
+                        break;
+                    skip_whitespace();
+                    if (*pos != ':') {
+                        fail("expected ':' in object, got " + describe(*pos));
+                        break;
+                    }
+                    pos++;
+                }
+
+                uint32_t child = parse_value(child_key, child_key_len, depth + 1);
+
+                if (failed)
+                    break;
+
+                if (last_child == 0)
+                    doc.nodes[index].first_child = child;
+                else
+                    doc.nodes[last_child].next = child;
+
+                last_child = child;
+                size++;
+
+                skip_whitespace();
+
+                if (*pos == close) {
+                    pos++;
+                    break;
+                }
+
+                if (*pos != ',') {
+                    fail(string("expected ',' in ") + (is_object ? "object" : "array") + ", got " + describe(*pos));
+                    break;
+                }
+
+                pos++;
+            }
+
+            doc.nodes[index].size = size;
+            return index;
+        }
+
+        fail("expected value, got " + describe(c));
+        return 0;
+    }
+};
+
+bool JsonDoc::parse(const string &source, string &err) {
+    text.assign(source.begin(), source.end());
+    text.push_back(0);
+    nodes.clear();
+
+    // Most values in the map files take at least this many bytes.
+    nodes.reserve(source.size() / 8);
+
+    JsonParser parser(*this);
+
+    if (!parser.parse(err)) {
+        nodes.clear();
+        return false;
+    }
+
+    return true;
+}
+
+JsonRef::iterator &JsonRef::iterator::operator++() {
+    index = doc->nodes[index].next;
+    return *this;
+}
+
+JsonRef::Type JsonRef::type() const {
+    return doc ? doc->nodes[index].type : NUL;
+}
+
+string JsonRef::string_value() const {
+    if (type() != STRING)
+        return string();
+
+    const JsonDoc::Node &node = doc->nodes[index];
+    return string(node.str, node.str_len);
+}
+
+int JsonRef::int_value() const {
+    return type() == NUMBER ? static_cast<int>(doc->nodes[index].number) : 0;
+}
+
+bool JsonRef::bool_value() const {
+    return type() == BOOL && doc->nodes[index].boolean;
+}
+
+size_t JsonRef::size() const {
+    Type t = type();
+    return (t == ARRAY || t == OBJECT) ? doc->nodes[index].size : 0;
+}
+
+bool JsonRef::has(const char *key) const {
+    return type() == OBJECT && (*this)[key].doc != nullptr;
+}
+
+JsonRef JsonRef::operator[](const char *key) const {
+    if (type() != OBJECT)
+        return JsonRef();
+
+    size_t key_len = strlen(key);
+
+    for (uint32_t i = doc->nodes[index].first_child; i != 0; i = doc->nodes[i].next) {
+        const JsonDoc::Node &node = doc->nodes[i];
+        if (node.key_len == key_len && memcmp(node.key, key, key_len) == 0)
+            return JsonRef(doc, i);
+    }
+
+    return JsonRef();
+}
+
+JsonRef::iterator JsonRef::begin() const {
+    Type t = type();
+    return iterator(doc, (t == ARRAY || t == OBJECT) ? doc->nodes[index].first_child : 0);
+}
+
+JsonRef::iterator JsonRef::end() const {
+    return iterator(doc, 0);
+}
@@ -0,0 +1,91 @@
+// json_arena.h
+
+#ifndef JSON_ARENA_H
+#define JSON_ARENA_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A read-only JSON parser for the map files. json11 allocates every value
+// separately and shares them through reference counts. JsonDoc instead
+// keeps every value of a document in one array, with strings decoded in
+// place in its copy of the text. Values are accessed through JsonRef, which
+// is only a pointer and an index.
+//
+// The accessors behave like json11's: looking up a missing key or reading a
+// value as the wrong type gives null, "", 0 or false instead of failing.
+
+class JsonDoc;
+
+class JsonRef {
+public:
+    enum Type : uint8_t { NUL, NUMBER, BOOL, STRING, ARRAY, OBJECT };
+
+    class iterator {
+    public:
+        iterator(const JsonDoc *doc, uint32_t index) : doc(doc), index(index) {}
+        JsonRef operator*() const { return JsonRef(doc, index); }
+        iterator &operator++();
+        bool operator!=(const iterator &other) const { return index != other.index; }
+
+    private:
+        const JsonDoc *doc;
+        uint32_t index;
+    };
+
+    JsonRef() : doc(nullptr), index(0) {}
+    JsonRef(const JsonDoc *doc, uint32_t index) : doc(doc), index(index) {}
+
+    Type type() const;
+    bool is_null() const { return type() == NUL; }
+
+    std::string string_value() const;
+    int int_value() const;
+    bool bool_value() const;
+
+    // The number of elements of an array or members of an object.
+    size_t size() const;
+
+    bool has(const char *key) const;
+    JsonRef operator[](const char *key) const;
+    JsonRef operator[](const std::string &key) const { return (*this)[key.c_str()]; }
+
+    // Iterates over the elements of an array or the values of an object.
+    iterator begin() const;
+    iterator end() const;
+
+private:
+    const JsonDoc *doc;
+    uint32_t index;
+};
+
+class JsonDoc {
+public:
+    // Parses text, returning false and setting err if it isn't valid JSON.
+    bool parse(const std::string &text, std::string &err);
+
+    JsonRef root() const { return nodes.empty() ? JsonRef() : JsonRef(this, 0); }
+
+private:
+    friend class JsonRef;
+    friend class JsonParser;
+
+    struct Node {
+        JsonRef::Type type;
+        bool boolean;
+        uint32_t key_len;
+        uint32_t str_len;
+        uint32_t size;
+        uint32_t first_child; // 0 if there are no children
+        uint32_t next;        // next sibling, 0 if this is the last one
+        const char *key;      // the member name, for object members
+        const char *str;      // the contents of a string
+        double number;
+    };
+
+    std::vector<char> text;
+    std::vector<Node> nodes;
+};
+
+#endif // JSON_ARENA_H
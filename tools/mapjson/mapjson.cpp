@@ -24,9 +24,20 @@ using std::ostringstream;
 #include <limits>
 using std::numeric_limits;
 
+#include <unordered_map>
+using std::unordered_map;
+
+#include <thread>
+using std::thread;
+
+#include <atomic>
+using std::atomic;
+
 #include "json11.h"
 using json11::Json;
 
+#include "json_arena.h"
+
 #include "mapjson.h"
 
 
@@ -49,7 +60,27 @@ string read_text_file(string filepath) {
     return text;
 }
 
+// Leaves the file alone if it already holds text, so that its timestamp
+// doesn't make everything built from it out of date.
 void write_text_file(string filepath, string text) {
+    ifstream in_file(filepath, std::ifstream::binary);
+
+    if (in_file.is_open()) {
+        in_file.seekg(0, std::ios::end);
+
+        if (static_cast<size_t>(in_file.tellg()) == text.size()) {
+            string existing(text.size(), '\0');
+
+            in_file.seekg(0, std::ios::beg);
+            in_file.read(&existing[0], existing.size());
+
+            if (in_file && existing == text)
+                return;
+        }
+
+        in_file.close();
+    }
+
     ofstream out_file(filepath, std::ofstream::binary);
 
     if (!out_file.is_open())
@@ -60,9 +91,26 @@ void write_text_file(string filepath, string text) {
     out_file.close();
 }
 
-string generate_map_header_text(Json map_data, Json layouts_data, string version) {
-    string map_layout_id = map_data["layout"].string_value();
+Json parse_json_file(string filepath) {
+    string err;
+    Json data = Json::parse(read_text_file(filepath), err);
+
+    if (data == Json())
+        FATAL_ERROR("%s\n", err.c_str());
+
+    return data;
+}
+
+// The map files are by far the most numerous, so they're read with the
+// lighter JsonDoc.
+void parse_map_file(string filepath, JsonDoc &doc) {
+    string err;
 
+    if (!doc.parse(read_text_file(filepath), err))
+        FATAL_ERROR("%s: %s\n", filepath.c_str(), err.c_str());
+}
+
+Json find_layout(const Json &layouts_data, string map_layout_id) {
     vector<Json> matched;
 
     for (auto &field : layouts_data["layouts"].array_items()) {
@@ -73,8 +121,10 @@ string generate_map_header_text(Json map_data, Json layouts_data, string version
     if (matched.size() != 1)
         FATAL_ERROR("Failed to find matching layout for %s.\n", map_layout_id.c_str());
 
-    Json layout = matched[0];
+    return matched[0];
+}
 
+string generate_map_header_text(JsonRef map_data, const Json &layout, string version) {
     ostringstream text;
 
     text << "@\n@ DO NOT MODIFY THIS FILE! It is auto-generated from data/maps/" 
@@ -84,18 +134,18 @@ string generate_map_header_text(Json map_data, Json layouts_data, string version
     text << map_data["name"].string_value() << ":\n"
          << "\t.4byte " << layout["name"].string_value() << "\n";
 
-    if (map_data.object_items().find("shared_events_map") != map_data.object_items().end())
+    if (map_data.has("shared_events_map"))
         text << "\t.4byte " << map_data["shared_events_map"].string_value() << "_MapEvents\n";
     else
         text << "\t.4byte " << map_data["name"].string_value() << "_MapEvents\n";
 
-    if (map_data.object_items().find("shared_scripts_map") != map_data.object_items().end())
+    if (map_data.has("shared_scripts_map"))
         text << "\t.4byte " << map_data["shared_scripts_map"].string_value() << "_MapScripts\n";
     else
         text << "\t.4byte " << map_data["name"].string_value() << "_MapScripts\n";
 
-    if (map_data.object_items().find("connections") != map_data.object_items().end()
-     && map_data["connections"].array_items().size() > 0)
+    if (map_data.has("connections")
+     && map_data["connections"].size() > 0)
         text << "\t.4byte " << map_data["name"].string_value() << "_MapConnections\n";
     else
         text << "\t.4byte 0x0\n";
@@ -122,8 +172,8 @@ string generate_map_header_text(Json map_data, Json layouts_data, string version
     return text.str();
 }
 
-string generate_map_connections_text(Json map_data) {
-    if (map_data["connections"] == Json())
+string generate_map_connections_text(JsonRef map_data) {
+    if (map_data["connections"].is_null())
         return string("\n");
 
     ostringstream text;
@@ -134,7 +184,7 @@ string generate_map_connections_text(Json map_data) {
 
     text << map_data["name"].string_value() << "_MapConnectionsList:\n";
 
-    for (auto &connection : map_data["connections"].array_items()) {
+    for (JsonRef connection : map_data["connections"]) {
         text << "\tconnection "
              << connection["direction"].string_value() << ", "
              << connection["offset"].int_value() << ", "
@@ -142,14 +192,14 @@ string generate_map_connections_text(Json map_data) {
     }
 
     text << "\n" << map_data["name"].string_value() << "_MapConnections:\n"
-         << "\t.4byte " << map_data["connections"].array_items().size() << "\n"
+         << "\t.4byte " << map_data["connections"].size() << "\n"
          << "\t.4byte " << map_data["name"].string_value() << "_MapConnectionsList\n\n";
 
     return text.str();
 }
 
-string generate_map_events_text(Json map_data) {
-    if (map_data.object_items().find("shared_events_map") != map_data.object_items().end())
+string generate_map_events_text(JsonRef map_data) {
+    if (map_data.has("shared_events_map"))
         return string("\n");
 
     ostringstream text;
@@ -160,12 +210,12 @@ string generate_map_events_text(Json map_data) {
 
     string objects_label, warps_label, coords_label, bgs_label;
 
-    if (map_data["object_events"].array_items().size() > 0) {
+    if (map_data["object_events"].size() > 0) {
         objects_label = map_data["name"].string_value() + "_ObjectEvents";
         text << objects_label << ":\n";
-        for (unsigned int i = 0; i < map_data["object_events"].array_items().size(); i++) {
-            auto obj_event = map_data["object_events"].array_items()[i];
-            text << "\tobject_event " << i + 1 << ", "
+        unsigned int i = 0;
+        for (JsonRef obj_event : map_data["object_events"]) {
+            text << "\tobject_event " << ++i << ", "
                  << obj_event["graphics_id"].string_value() << ", 0, "
                  << obj_event["x"].int_value() << ", "
                  << obj_event["y"].int_value() << ", "
@@ -183,10 +233,10 @@ string generate_map_events_text(Json map_data) {
         objects_label = "0x0";
     }
 
-    if (map_data["warp_events"].array_items().size() > 0) {
+    if (map_data["warp_events"].size() > 0) {
         warps_label = map_data["name"].string_value() + "_MapWarps";
         text << warps_label << ":\n";
-        for (auto &warp_event : map_data["warp_events"].array_items()) {
+        for (JsonRef warp_event : map_data["warp_events"]) {
             text << "\twarp_def "
                  << warp_event["x"].int_value() << ", "
                  << warp_event["y"].int_value() << ", "
@@ -199,10 +249,10 @@ string generate_map_events_text(Json map_data) {
         warps_label = "0x0";
     }
 
-    if (map_data["coord_events"].array_items().size() > 0) {
+    if (map_data["coord_events"].size() > 0) {
         coords_label = map_data["name"].string_value() + "_MapCoordEvents";
         text << coords_label << ":\n";
-        for (auto &coord_event : map_data["coord_events"].array_items()) {
+        for (JsonRef coord_event : map_data["coord_events"]) {
             if (coord_event["type"].string_value() == "trigger") {
                 text << "\tcoord_event "
                      << coord_event["x"].int_value() << ", "
@@ -212,7 +262,7 @@ string generate_map_events_text(Json map_data) {
                      << coord_event["var_value"].string_value() << ", "
                      << coord_event["script"].string_value() << "\n";
             }
-            else if (coord_event["type"] == "weather") {
+            else if (coord_event["type"].string_value() == "weather") {
                 text << "\tcoord_weather_event "
                      << coord_event["x"].int_value() << ", "
                      << coord_event["y"].int_value() << ", "
@@ -225,11 +275,11 @@ string generate_map_events_text(Json map_data) {
         coords_label = "0x0";
     }
 
-    if (map_data["bg_events"].array_items().size() > 0) {
+    if (map_data["bg_events"].size() > 0) {
         bgs_label = map_data["name"].string_value() + "_MapBGEvents";
         text << bgs_label << ":\n";
-        for (auto &bg_event : map_data["bg_events"].array_items()) {
-            if (bg_event["type"] == "sign") {
+        for (JsonRef bg_event : map_data["bg_events"]) {
+            if (bg_event["type"].string_value() == "sign") {
                 text << "\tbg_event "
                      << bg_event["x"].int_value() << ", "
                      << bg_event["y"].int_value() << ", "
@@ -237,7 +287,7 @@ string generate_map_events_text(Json map_data) {
                      << bg_event["player_facing_dir"].string_value() << ", "
                      << bg_event["script"].string_value() << "\n";
             }
-            else if (bg_event["type"] == "hidden_item") {
+            else if (bg_event["type"].string_value() == "hidden_item") {
                 text << "\tbg_hidden_item_event "
                      << bg_event["x"].int_value() << ", "
                      << bg_event["y"].int_value() << ", "
@@ -245,7 +295,7 @@ string generate_map_events_text(Json map_data) {
                      << bg_event["item"].string_value() << ", "
                      << bg_event["flag"].string_value() << "\n";
             }
-            else if (bg_event["type"] == "secret_base") {
+            else if (bg_event["type"].string_value() == "secret_base") {
                 text << "\tbg_secret_base_event "
                      << bg_event["x"].int_value() << ", "
                      << bg_event["y"].int_value() << ", "
@@ -272,20 +322,14 @@ string get_directory_name(string filename) {
 }
 
 void process_map(string map_filepath, string layouts_filepath, string version) {
-    string mapdata_err, layouts_err;
-
-    string mapdata_json_text = read_text_file(map_filepath);
-    string layouts_json_text = read_text_file(layouts_filepath);
+    JsonDoc map_doc;
+    parse_map_file(map_filepath, map_doc);
+    JsonRef map_data = map_doc.root();
 
-    Json map_data = Json::parse(mapdata_json_text, mapdata_err);
-    if (map_data == Json())
-        FATAL_ERROR("%s\n", mapdata_err.c_str());
+    Json layouts_data = parse_json_file(layouts_filepath);
+    Json layout = find_layout(layouts_data, map_data["layout"].string_value());
 
-    Json layouts_data = Json::parse(layouts_json_text, layouts_err);
-    if (layouts_data == Json())
-        FATAL_ERROR("%s\n", layouts_err.c_str());
-
-    string header_text = generate_map_header_text(map_data, layouts_data, version);
+    string header_text = generate_map_header_text(map_data, layout, version);
     string events_text = generate_map_events_text(map_data);
     string connections_text = generate_map_connections_text(map_data);
 
@@ -381,10 +425,7 @@ string generate_events_text(Json groups_data) {
     return text.str();
 }
 
-string generate_map_constants_text(string groups_filepath, Json groups_data) {
-    string file_dir = get_directory_name(groups_filepath);
-    char dir_separator = file_dir.back();
-
+string generate_map_constants_text(Json groups_data, const unordered_map<string, JsonRef> &maps_data) {
     ostringstream text;
 
     text << "#ifndef GUARD_CONSTANTS_MAP_GROUPS_H\n"
@@ -396,21 +437,19 @@ string generate_map_constants_text(string groups_filepath, Json groups_data) {
 
     for (auto &group : groups_data["group_order"].array_items()) {
         text << "// Map Group " << group_num << "\n";
-        vector<Json> map_ids;
+        vector<string> map_ids;
         size_t max_length = 0;
 
         for (auto &map_name : groups_data[group.string_value()].array_items()) {
-            string header_filepath = file_dir + map_name.string_value() + dir_separator + "map.json";
-            string err_str;
-            Json map_data = Json::parse(read_text_file(header_filepath), err_str);
-            map_ids.push_back(map_data["id"]);
-            if (map_data["id"].string_value().length() > max_length)
-                max_length = map_data["id"].string_value().length();
+            string map_id = maps_data.at(map_name.string_value())["id"].string_value();
+            map_ids.push_back(map_id);
+            if (map_id.length() > max_length)
+                max_length = map_id.length();
         }
 
         int map_id_num = 0;
-        for (Json map_id : map_ids) {
-            text << "#define " << map_id.string_value() << string((max_length - map_id.string_value().length() + 1), ' ')
+        for (string map_id : map_ids) {
+            text << "#define " << map_id << string((max_length - map_id.length() + 1), ' ')
                  << "(" << map_id_num++ << " | (" << group_num << " << 8))\n";
         }
         text << "\n";
@@ -424,18 +463,29 @@ string generate_map_constants_text(string groups_filepath, Json groups_data) {
     return text.str();
 }
 
-void process_groups(string groups_filepath) {
-    string err;
-    Json groups_data = Json::parse(read_text_file(groups_filepath), err);
+vector<string> get_map_names(const Json &groups_data) {
+    vector<string> map_names;
 
-    if (groups_data == Json())
-        FATAL_ERROR("%s\n", err.c_str());
+    for (auto &group : groups_data["group_order"].array_items())
+    for (auto &map_name : groups_data[group.string_value()].array_items())
+        map_names.push_back(map_name.string_value());
+
+    return map_names;
+}
+
+string get_map_filepath(string groups_filepath, string map_name) {
+    string file_dir = get_directory_name(groups_filepath);
+    char s = file_dir.back();
+
+    return file_dir + map_name + s + "map.json";
+}
 
+void write_groups_files(string groups_filepath, const Json &groups_data, const unordered_map<string, JsonRef> &maps_data) {
     string groups_text = generate_groups_text(groups_data);
     string connections_text = generate_connections_text(groups_data);
     string headers_text = generate_headers_text(groups_data);
     string events_text = generate_events_text(groups_data);
-    string map_header_text = generate_map_constants_text(groups_filepath, groups_data);
+    string map_header_text = generate_map_constants_text(groups_data, maps_data);
 
     string file_dir = get_directory_name(groups_filepath);
     char s = file_dir.back();
@@ -447,6 +497,20 @@ void process_groups(string groups_filepath) {
     write_text_file(file_dir + ".." + s + ".." + s + "include" + s + "constants" + s + "map_groups.h", map_header_text);
 }
 
+void process_groups(string groups_filepath) {
+    Json groups_data = parse_json_file(groups_filepath);
+    vector<string> map_names = get_map_names(groups_data);
+    vector<JsonDoc> map_docs(map_names.size());
+    unordered_map<string, JsonRef> maps_data;
+
+    for (size_t i = 0; i < map_names.size(); i++) {
+        parse_map_file(get_map_filepath(groups_filepath, map_names[i]), map_docs[i]);
+        maps_data[map_names[i]] = map_docs[i].root();
+    }
+
+    write_groups_files(groups_filepath, groups_data, maps_data);
+}
+
 string generate_layout_headers_text(Json layouts_data) {
     ostringstream text;
 
@@ -503,13 +567,7 @@ string generate_layouts_constants_text(Json layouts_data) {
     return text.str();
 }
 
-void process_layouts(string layouts_filepath) {
-    string err;
-    Json layouts_data = Json::parse(read_text_file(layouts_filepath), err);
-
-    if (layouts_data == Json())
-        FATAL_ERROR("%s\n", err.c_str());
-
+void write_layouts_files(string layouts_filepath, const Json &layouts_data) {
     string layout_headers_text = generate_layout_headers_text(layouts_data);
     string layouts_table_text = generate_layouts_table_text(layouts_data);
     string layouts_constants_text = generate_layouts_constants_text(layouts_data);
@@ -522,6 +580,73 @@ void process_layouts(string layouts_filepath) {
     write_text_file(file_dir + ".." + s + ".." + s + "include" + s + "constants" + s + "layouts.h", layouts_constants_text);
 }
 
+void process_layouts(string layouts_filepath) {
+    Json layouts_data = parse_json_file(layouts_filepath);
+
+    write_layouts_files(layouts_filepath, layouts_data);
+}
+
+// Does the work of the layouts and groups modes plus the map mode for every
+// map in one go, so the shared JSON files are only parsed once. Maps are
+// parsed and written on a pool of threads.
+void process_world(string groups_filepath, string layouts_filepath, string version) {
+    Json groups_data = parse_json_file(groups_filepath);
+    Json layouts_data = parse_json_file(layouts_filepath);
+
+    unordered_map<string, Json> layouts_by_id;
+    unordered_map<string, int> layout_counts;
+
+    for (auto &layout : layouts_data["layouts"].array_items()) {
+        string id = layout["id"].string_value();
+        layouts_by_id[id] = layout;
+        layout_counts[id]++;
+    }
+
+    vector<string> map_names = get_map_names(groups_data);
+    vector<JsonDoc> map_docs(map_names.size());
+    atomic<size_t> next_map(0);
+
+    auto process_maps = [&]() {
+        for (size_t i = next_map++; i < map_names.size(); i = next_map++) {
+            string map_filepath = get_map_filepath(groups_filepath, map_names[i]);
+            parse_map_file(map_filepath, map_docs[i]);
+            JsonRef map_data = map_docs[i].root();
+            string layout_id = map_data["layout"].string_value();
+
+            if (layout_counts.count(layout_id) == 0 || layout_counts.at(layout_id) != 1)
+                FATAL_ERROR("Failed to find matching layout for %s.\n", layout_id.c_str());
+
+            string header_text = generate_map_header_text(map_data, layouts_by_id.at(layout_id), version);
+            string events_text = generate_map_events_text(map_data);
+            string connections_text = generate_map_connections_text(map_data);
+
+            string files_dir = get_directory_name(map_filepath);
+            write_text_file(files_dir + "header.inc", header_text);
+            write_text_file(files_dir + "events.inc", events_text);
+            write_text_file(files_dir + "connections.inc", connections_text);
+        }
+    };
+
+    unsigned num_threads = thread::hardware_concurrency();
+    vector<thread> threads;
+
+    for (unsigned i = 1; i < num_threads; i++)
+        threads.emplace_back(process_maps);
+
+    process_maps();
+
+    for (thread &t : threads)
+        t.join();
+
+    unordered_map<string, JsonRef> maps_data;
+
+    for (size_t i = 0; i < map_names.size(); i++)
+        maps_data[map_names[i]] = map_docs[i].root();
+
+    write_groups_files(groups_filepath, groups_data, maps_data);
+    write_layouts_files(layouts_filepath, layouts_data);
+}
+
 int main(int argc, char *argv[]) {
     if (argc < 3)
         FATAL_ERROR("USAGE: mapjson <mode> <game-version> [options]\n");
@@ -533,8 +658,8 @@ int main(int argc, char *argv[]) {
 
     char *mode_arg = argv[1];
     string mode(mode_arg);
-    if (mode != "layouts" && mode != "map" && mode != "groups")
-        FATAL_ERROR("ERROR: <mode> must be 'layouts', 'map', or 'groups'.\n");
+    if (mode != "layouts" && mode != "map" && mode != "groups" && mode != "world")
+        FATAL_ERROR("ERROR: <mode> must be 'layouts', 'map', 'groups', or 'world'.\n");
 
     if (mode == "map") {
         if (argc != 5)
@@ -561,6 +686,15 @@ int main(int argc, char *argv[]) {
 
         process_layouts(filepath);
     }
+    else if (mode == "world") {
+        if (argc != 5)
+            FATAL_ERROR("USAGE: mapjson world <game-version> <groups_file> <layouts_file>\n");
+
+        string groups_filepath(argv[3]);
+        string layouts_filepath(argv[4]);
+
+        process_world(groups_filepath, layouts_filepath, version);
+    }
 
     return 0;
 }
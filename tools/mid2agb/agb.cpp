@@ -21,11 +21,14 @@
 #include <cstdio>
 #include <cstdarg>
 #include <cstring>
+#include <string>
 #include <vector>
+#include <algorithm>
 #include "agb.h"
 #include "main.h"
 #include "midi.h"
 #include "tables.h"
+#include "error.h"
 
 int g_agbTrack;
 
@@ -41,6 +44,25 @@ static int s_extendedCommand;
 static int s_memaccOp;
 static int s_memaccParam1;
 static int s_memaccParam2;
+static int s_byteCount;
+
+static std::string FormatOperands(const char *format, std::va_list args)
+{
+    std::va_list argsCopy;
+    va_copy(argsCopy, args);
+    int length = std::vsnprintf(nullptr, 0, format, argsCopy);
+    va_end(argsCopy);
+
+    std::string operands(length, '\0');
+    std::vsnprintf(&operands[0], length + 1, format, args);
+    return operands;
+}
+
+// Counts the bytes in the operands of a .byte directive.
+static int CountBytes(const std::string& operands)
+{
+    return 1 + std::count(operands.begin(), operands.end(), ',');
+}
 
 void PrintAgbHeader()
 {
@@ -81,6 +103,7 @@ void PrintWait(int wait)
     if (wait > 0)
     {
         std::fprintf(g_outputFile, "\t.byte\tW%02d\n", wait);
+        s_byteCount++;
         s_velocityChanged = true;
         s_noteChanged = true;
         s_keepLastOpName = true;
@@ -99,17 +122,22 @@ void PrintOp(int wait, std::string name, const char *format, ...)
         {
             std::fprintf(g_outputFile, "%s, ", name.c_str());
             s_lastOpName = name;
+            s_byteCount++;
         }
         else
         {
             std::fprintf(g_outputFile, "        ");
         }
-        std::vfprintf(g_outputFile, format, args);
+
+        std::string operands = FormatOperands(format, args);
+        std::fputs(operands.c_str(), g_outputFile);
+        s_byteCount += CountBytes(operands);
     }
     else
     {
         std::fputs(name.c_str(), g_outputFile);
         s_lastOpName = name;
+        s_byteCount++;
     }
 
     std::fprintf(g_outputFile, "\n");
@@ -123,9 +151,9 @@ void PrintByte(const char *format, ...)
 {
     std::va_list args;
     va_start(args, format);
-    std::fprintf(g_outputFile, "\t.byte\t");
-    std::vfprintf(g_outputFile, format, args);
-    std::fprintf(g_outputFile, "\n");
+    std::string operands = FormatOperands(format, args);
+    std::fprintf(g_outputFile, "\t.byte\t%s\n", operands.c_str());
+    s_byteCount += CountBytes(operands);
     s_velocityChanged = true;
     s_noteChanged = true;
     s_keepLastOpName = true;
@@ -139,6 +167,7 @@ void PrintWord(const char *format, ...)
     std::fprintf(g_outputFile, "\t .word\t");
     std::vfprintf(g_outputFile, format, args);
     std::fprintf(g_outputFile, "\n");
+    s_byteCount += 4;
     va_end(args);
 }
 
@@ -421,6 +450,7 @@ void PrintAgbTrack(std::vector<Event>& events)
 
     int wholeNoteCount = 0;
     int loopEndBlockNum = 0;
+    unsigned patternEnd = 0;
 
     ResetTrackVars();
 
@@ -448,7 +478,7 @@ void PrintAgbTrack(std::vector<Event>& events)
     {
         const Event& event = events[i];
 
-        if (IsPatternBoundary(event.type))
+        if (IsPatternBoundary(event.type) && i >= patternEnd)
         {
             if (s_inPattern)
                 PrintByte("PEND");
@@ -490,6 +520,7 @@ void PrintAgbTrack(std::vector<Event>& events)
                 std::fprintf(g_outputFile, "%s_%u_%03lu:\n", g_asmLabel.c_str(), g_agbTrack, (unsigned long)(event.param2 & 0x7FFFFFFF));
                 ResetTrackVars();
                 s_inPattern = true;
+                patternEnd = i + event.patternLength;
             }
             PrintWait(event.time);
             break;
@@ -497,8 +528,23 @@ void PrintAgbTrack(std::vector<Event>& events)
             PrintByte("PATT");
             PrintWord("%s_%u_%03lu", g_asmLabel.c_str(), g_agbTrack, event.param2);
 
-            while (!IsPatternBoundary(events[i + 1].type))
-                i++;
+            if (event.patternLength > 0)
+            {
+                unsigned end = i + event.patternLength;
+
+                while (i + 1 < end)
+                {
+                    i++;
+
+                    if (events[i].type == EventType::WholeNoteMark)
+                        wholeNoteCount++;
+                }
+            }
+            else
+            {
+                while (!IsPatternBoundary(events[i + 1].type))
+                    i++;
+            }
 
             ResetTrackVars();
             break;
@@ -524,6 +570,36 @@ void PrintAgbTrack(std::vector<Event>& events)
     PrintByte("FINE");
 }
 
+// Returns the number of bytes PrintAgbTrack would output for the track
+// without writing it.
+int MeasureAgbTrack(std::vector<Event>& events)
+{
+    FILE *outputFile = g_outputFile;
+    int blockNum = s_blockNum;
+    int extendedCommand = s_extendedCommand;
+    int memaccOp = s_memaccOp;
+    int memaccParam1 = s_memaccParam1;
+    int memaccParam2 = s_memaccParam2;
+
+    g_outputFile = std::tmpfile();
+
+    if (g_outputFile == nullptr)
+        RaiseError("failed to create temporary file");
+
+    s_byteCount = 0;
+    PrintAgbTrack(events);
+
+    std::fclose(g_outputFile);
+    g_outputFile = outputFile;
+    s_blockNum = blockNum;
+    s_extendedCommand = extendedCommand;
+    s_memaccOp = memaccOp;
+    s_memaccParam1 = memaccParam1;
+    s_memaccParam2 = memaccParam2;
+
+    return s_byteCount;
+}
+
 void PrintAgbFooter()
 {
     int trackCount = g_agbTrack - 1;
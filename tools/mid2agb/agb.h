@@ -27,6 +27,7 @@
 void PrintAgbHeader();
 void PrintAgbTrack(std::vector<Event>& events);
 void PrintAgbFooter();
+int MeasureAgbTrack(std::vector<Event>& events);
 
 extern int g_agbTrack;
 
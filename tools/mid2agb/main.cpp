@@ -29,6 +29,7 @@
 #include "error.h"
 #include "midi.h"
 #include "agb.h"
+#include "asset_cache.h"
 
 FILE* g_inputFile = nullptr;
 FILE* g_outputFile = nullptr;
@@ -41,6 +42,7 @@ int g_reverb = -1;
 int g_clocksPerBeat = 1;
 bool g_exactGateTime = false;
 bool g_compressionEnabled = true;
+bool g_phraseCompression = false;
 
 [[noreturn]] static void PrintUsage()
 {
@@ -58,6 +60,7 @@ bool g_compressionEnabled = true;
         "            -X  48 clocks/beat (default:24 clocks/beat)\n"
         "            -E  exact gate-time\n"
         "            -N  no compression\n"
+        "            -O  also compress phrases longer than a whole note\n"
     );
     std::exit(1);
 }
@@ -129,6 +132,8 @@ static const char *GetArgument(int argc, char **argv, int& index)
 
 int main(int argc, char** argv)
 {
+    AssetCacheInit(argv[0]);
+
     std::string inputFilename;
     std::string outputFilename;
 
@@ -160,6 +165,9 @@ int main(int argc, char** argv)
             case 'N':
                 g_compressionEnabled = false;
                 break;
+            case 'O':
+                g_phraseCompression = true;
+                break;
             case 'P':
                 arg = GetArgument(argc, argv, i);
                 if (arg == nullptr)
@@ -211,6 +219,32 @@ int main(int argc, char** argv)
     if (g_asmLabel.empty())
         g_asmLabel = BaseName(outputFilename);
 
+    AssetCacheKey cacheKey;
+
+    if (AssetCacheBegin(&cacheKey, argc, argv))
+    {
+        AssetCacheAddInput(&cacheKey, inputFilename.c_str());
+
+        std::size_t size;
+        unsigned char *data = AssetCacheFetch(&cacheKey, &size);
+
+        if (data != nullptr)
+        {
+            g_outputFile = std::fopen(outputFilename.c_str(), "wb");
+
+            if (g_outputFile == nullptr)
+                RaiseError("failed to open \"%s\" for writing", outputFilename.c_str());
+
+            if (size != 0 && std::fwrite(data, size, 1, g_outputFile) != 1)
+                RaiseError("failed to write \"%s\"", outputFilename.c_str());
+
+            std::fclose(g_outputFile);
+            std::free(data);
+            AssetCacheEnd(&cacheKey);
+            return 0;
+        }
+    }
+
     g_inputFile = std::fopen(inputFilename.c_str(), "rb");
 
     if (g_inputFile == nullptr)
@@ -229,5 +263,8 @@ int main(int argc, char** argv)
     std::fclose(g_inputFile);
     std::fclose(g_outputFile);
 
+    AssetCacheStoreFile(&cacheKey, outputFilename.c_str());
+    AssetCacheEnd(&cacheKey);
+
     return 0;
 }
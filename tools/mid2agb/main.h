@@ -35,5 +35,6 @@ extern int g_reverb;
 extern int g_clocksPerBeat;
 extern bool g_exactGateTime;
 extern bool g_compressionEnabled;
+extern bool g_phraseCompression;
 
 #endif // MAIN_H
@@ -24,6 +24,7 @@
 #include <vector>
 #include <algorithm>
 #include <memory>
+#include <unordered_map>
 #include "midi.h"
 #include "main.h"
 #include "error.h"
@@ -873,42 +874,313 @@ bool IsCompressionMatch(std::vector<Event>& events, int index1, int index2)
     return IsPatternBoundary(events[index2].type);
 }
 
-void CompressWholeNote(std::vector<Event>& events, int index)
+struct WholeNote
 {
-    for (int j = index + 1; events[j].type != EventType::EndOfTrack; j++)
+    int index;
+    int length;
+    int score;
+    std::uint32_t hash;
+    int next; // next earlier distinct whole note in the same bucket, or -1
+};
+
+static std::uint32_t HashWholeNote(std::vector<Event>& events, int index, int& length)
+{
+    // FNV-1a over the fields IsCompressionMatch compares. The mark's param2
+    // is its whole note number, which is left out.
+    std::uint32_t hash = 2166136261u;
+
+    auto add = [&hash](std::uint32_t value)
+    {
+        hash = (hash ^ value) * 16777619u;
+    };
+
+    add(events[index].note | (events[index].param1 << 8));
+    add(events[index].time);
+
+    int i;
+
+    for (i = index + 1; !IsPatternBoundary(events[i].type); i++)
     {
-        while (events[j].type != EventType::WholeNoteMark)
+        add((std::uint32_t)events[i].type | (events[i].note << 8) | (events[i].param1 << 16));
+        add(events[i].time);
+        add(events[i].param2);
+    }
+
+    length = i - index;
+
+    return hash ^ (hash >> 16);
+}
+
+// Finds the whole notes that repeat an earlier one and turns them into
+// patterns. The whole notes are put in a hash table by their contents, so
+// each one is only compared with the earlier ones in its bucket instead of
+// with every whole note after it.
+void Compress(std::vector<Event>& events)
+{
+    std::vector<WholeNote> wholeNotes;
+
+    for (int i = 0; events[i].type != EventType::EndOfTrack; i++)
+    {
+        if (events[i].type != EventType::WholeNoteMark)
+            continue;
+
+        WholeNote wholeNote;
+        wholeNote.index = i;
+        wholeNote.hash = HashWholeNote(events, i, wholeNote.length);
+
+        // An empty whole note never scores high enough to be a pattern.
+        if (wholeNote.length > 1)
+            wholeNotes.push_back(wholeNote);
+    }
+
+    unsigned bucketCount = 16;
+
+    while (bucketCount < wholeNotes.size() * 2)
+        bucketCount *= 2;
+
+    std::vector<int> buckets(bucketCount, -1);
+
+    for (WholeNote& wholeNote : wholeNotes)
+    {
+        int& bucket = buckets[wholeNote.hash & (bucketCount - 1)];
+        WholeNote *match = nullptr;
+
+        for (int j = bucket; j >= 0; j = wholeNotes[j].next)
         {
-            j++;
+            WholeNote& candidate = wholeNotes[j];
 
-            if (events[j].type == EventType::EndOfTrack)
-                return;
+            if (candidate.hash == wholeNote.hash
+                && candidate.length == wholeNote.length
+                && IsCompressionMatch(events, candidate.index, wholeNote.index))
+            {
+                match = &candidate;
+                break;
+            }
         }
 
-        if (IsCompressionMatch(events, index, j))
+        if (match == nullptr)
         {
-            events[j].type = EventType::Pattern;
-            events[j].param2 = events[index].param2 & 0x7FFFFFFF;
-            events[index].param2 |= 0x80000000;
+            wholeNote.score = CalculateCompressionScore(events, wholeNote.index);
+            wholeNote.next = bucket;
+            bucket = &wholeNote - wholeNotes.data();
+        }
+        else if (match->score >= 6)
+        {
+            // Only the first whole note with given contents is ever used as
+            // a pattern, and the score depends only on the contents.
+            events[wholeNote.index].type = EventType::Pattern;
+            events[wholeNote.index].param2 = events[match->index].param2 & 0x7FFFFFFF;
+            events[match->index].param2 |= 0x80000000;
         }
     }
 }
 
-void Compress(std::vector<Event>& events)
+// A run of events from one pattern boundary up to the next.
+struct PhraseUnit
 {
-    for (int i = 0; events[i].type != EventType::EndOfTrack; i++)
+    int index;
+    int end;
+    int symbol;
+    int score;
+    bool claimed;
+};
+
+static bool IsPhraseUnitMatch(std::vector<Event>& events, const PhraseUnit& unit1, const PhraseUnit& unit2)
+{
+    if (unit1.end - unit1.index != unit2.end - unit2.index)
+        return false;
+
+    const Event& head1 = events[unit1.index];
+    const Event& head2 = events[unit2.index];
+
+    // A whole note mark's param2 is its number, which is left out.
+    if (head1.type != head2.type
+        || head1.note != head2.note
+        || head1.param1 != head2.param1
+        || head1.time != head2.time
+        || (head1.type != EventType::WholeNoteMark && head1.param2 != head2.param2))
+        return false;
+
+    for (int i = 1; i < unit1.end - unit1.index; i++)
+        if (events[unit1.index + i] != events[unit2.index + i])
+            return false;
+
+    return true;
+}
+
+// Splits the track into units and gives units with the same contents the
+// same symbol. Units that can't be part of a pattern get a negative symbol
+// of their own.
+static std::vector<PhraseUnit> GetPhraseUnits(std::vector<Event>& events)
+{
+    std::vector<PhraseUnit> units;
+    std::vector<int> representatives;
+
+    int i = 0;
+
+    while (!IsPatternBoundary(events[i].type))
+        i++;
+
+    while (events[i].type != EventType::EndOfTrack)
     {
-        while (events[i].type != EventType::WholeNoteMark)
-        {
+        PhraseUnit unit;
+        unit.index = i;
+        unit.claimed = false;
+
+        do
             i++;
+        while (!IsPatternBoundary(events[i].type));
 
-            if (events[i].type == EventType::EndOfTrack)
-                return;
+        unit.end = i;
+        unit.score = CalculateCompressionScore(events, unit.index);
+
+        EventType type = events[unit.index].type;
+
+        if (type == EventType::WholeNoteMark || type == EventType::EndOfTie)
+        {
+            unit.symbol = -1;
+
+            for (int representative : representatives)
+            {
+                if (IsPhraseUnitMatch(events, units[representative], unit))
+                {
+                    unit.symbol = units[representative].symbol;
+                    break;
+                }
+            }
+
+            if (unit.symbol < 0)
+            {
+                unit.symbol = representatives.size();
+                representatives.push_back(units.size());
+            }
+        }
+        else
+        {
+            unit.symbol = -1 - (int)units.size();
+        }
+
+        units.push_back(unit);
+    }
+
+    return units;
+}
+
+// Finds repeated runs of whole notes and turns them into patterns. Unlike
+// Compress, a pattern can be any number of whole notes long. Patterns are
+// picked greedily by how many bytes they save, estimated with
+// CalculateCompressionScore: each copy after the first costs a PATT and its
+// pointer instead of its contents, and the first copy gains a PEND.
+void CompressPhrases(std::vector<Event>& events)
+{
+    std::vector<PhraseUnit> units = GetPhraseUnits(events);
+    int unitCount = units.size();
+
+    for (;;)
+    {
+        // The starts of the runs of each length, keyed by a hash of the
+        // symbols in the run.
+        std::vector<std::unordered_map<std::uint64_t, std::vector<int>>> runs;
+
+        for (int start = 0; start < unitCount; start++)
+        {
+            if (units[start].claimed || events[units[start].index].type != EventType::WholeNoteMark)
+                continue;
+
+            std::uint64_t hash = 14695981039346656037ull;
+
+            for (int end = start; end < unitCount && !units[end].claimed && units[end].symbol >= 0; end++)
+            {
+                unsigned length = end - start + 1;
+
+                if (runs.size() < length)
+                    runs.resize(length);
+
+                hash = (hash ^ units[end].symbol) * 1099511628211ull;
+                runs[length - 1][hash].push_back(start);
+            }
+        }
+
+        int bestSavings = 0;
+        int bestLength = 0;
+        std::vector<int> bestStarts;
+
+        for (unsigned i = 0; i < runs.size(); i++)
+        {
+            int length = i + 1;
+
+            for (auto& run : runs[i])
+            {
+                std::vector<int>& starts = run.second;
+
+                if (starts.size() < 2)
+                    continue;
+
+                // Pick copies that don't overlap, and check that each one
+                // really matches the first instead of only hashing the same.
+                std::vector<int> copies;
+                int first = starts[0];
+                int nextFree = 0;
+
+                for (int start : starts)
+                {
+                    if (start < nextFree)
+                        continue;
+
+                    bool match = true;
+
+                    for (int k = 0; k < length && match; k++)
+                        match = units[start + k].symbol == units[first + k].symbol;
+
+                    if (match)
+                    {
+                        copies.push_back(start);
+                        nextFree = start + length;
+                    }
+                }
+
+                int score = 0;
+
+                for (int k = 0; k < length; k++)
+                    score += units[first + k].score;
+
+                int savings = (int)(copies.size() - 1) * (score - 5) - 1;
+
+                if (savings > bestSavings
+                    || (savings == bestSavings && savings > 0
+                        && (first < bestStarts[0] || (first == bestStarts[0] && length > bestLength))))
+                {
+                    bestSavings = savings;
+                    bestLength = length;
+                    bestStarts = copies;
+                }
+            }
         }
 
-        if (CalculateCompressionScore(events, i) >= 6)
+        if (bestSavings <= 0)
+            break;
+
+        Event& mark = events[units[bestStarts[0]].index];
+        int patternLength = 0;
+
+        if (bestLength > 1)
+            patternLength = units[bestStarts[0] + bestLength - 1].end - units[bestStarts[0]].index;
+
+        mark.param2 |= 0x80000000;
+        mark.patternLength = patternLength;
+
+        for (unsigned i = 0; i < bestStarts.size(); i++)
         {
-            CompressWholeNote(events, i);
+            for (int k = 0; k < bestLength; k++)
+                units[bestStarts[i] + k].claimed = true;
+
+            if (i > 0)
+            {
+                Event& pattern = events[units[bestStarts[i]].index];
+                pattern.type = EventType::Pattern;
+                pattern.param2 = mark.param2 & 0x7FFFFFFF;
+                pattern.patternLength = patternLength;
+            }
         }
     }
 }
@@ -922,6 +1194,9 @@ void ReadMidiTracks()
 
     g_agbTrack = 1;
 
+    int wholeNoteBytes = 0;
+    int phraseBytes = 0;
+
     for (int midiTrack = 0; midiTrack < g_midiTrackCount; midiTrack++)
     {
         trackHeaderStart += ReadMidiTrackHeader(trackHeaderStart);
@@ -952,8 +1227,30 @@ void ReadMidiTracks()
                 events = SplitTime(*events);
                 CalculateWaits(*events);
 
-                if (g_compressionEnabled)
+                if (g_compressionEnabled && g_phraseCompression)
+                {
+                    // The estimate CompressPhrases goes by can be off, so
+                    // keep whichever way comes out smaller.
+                    std::vector<Event> wholeNoteEvents = *events;
+                    Compress(wholeNoteEvents);
+                    int wholeNoteSize = MeasureAgbTrack(wholeNoteEvents);
+
+                    CompressPhrases(*events);
+                    int phraseSize = MeasureAgbTrack(*events);
+
+                    if (phraseSize >= wholeNoteSize)
+                    {
+                        *events = wholeNoteEvents;
+                        phraseSize = wholeNoteSize;
+                    }
+
+                    wholeNoteBytes += wholeNoteSize;
+                    phraseBytes += phraseSize;
+                }
+                else if (g_compressionEnabled)
+                {
                     Compress(*events);
+                }
 
                 PrintAgbTrack(*events);
 
@@ -961,4 +1258,8 @@ void ReadMidiTracks()
             }
         }
     }
+
+    if (g_compressionEnabled && g_phraseCompression)
+        std::printf("%s: %d bytes of track data, %d with whole note patterns only (%d saved)\n",
+            g_asmLabel.c_str(), phraseBytes, wholeNoteBytes, wholeNoteBytes - phraseBytes);
 }
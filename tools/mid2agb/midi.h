@@ -58,6 +58,11 @@ struct Event
     std::uint8_t param1;
     std::int32_t param2;
 
+    // For a whole note that starts a pattern, or a PATT that refers to one,
+    // the number of events in the pattern when it spans more than one
+    // whole note. 0 means the pattern ends at the next boundary.
+    std::int32_t patternLength;
+
     bool operator==(const Event& other)
     {
         return (time == other.time
@@ -20,6 +20,8 @@
 
 #include <cstdio>
 #include <cstdarg>
+#include <cstdlib>
+#include <cstring>
 #include <stdexcept>
 #include <string>
 #include <memory>
@@ -28,6 +30,8 @@
 #include "char_util.h"
 #include "utf8.h"
 #include "string_parser.h"
+#include "output.h"
+#include "asset_cache.h"
 
 CFile::CFile(std::string filename) : m_filename(filename)
 {
@@ -56,6 +60,7 @@ CFile::CFile(std::string filename) : m_filename(filename)
 
     m_pos = 0;
     m_lineNum = 1;
+    m_pendingStart = 0;
 }
 
 CFile::CFile(CFile&& other) : m_filename(std::move(other.m_filename))
@@ -64,6 +69,7 @@ CFile::CFile(CFile&& other) : m_filename(std::move(other.m_filename))
     m_pos = other.m_pos;
     m_size = other.m_size;
     m_lineNum = other.m_lineNum;
+    m_pendingStart = other.m_pendingStart;
 
     other.m_buffer = nullptr;
 }
@@ -73,32 +79,49 @@ CFile::~CFile()
     delete[] m_buffer;
 }
 
+// Returns whether the character needs to be looked at on its own outside of a
+// string or character literal. Runs of other characters are passed over.
+static inline bool IsSpecialChar(char c)
+{
+    return c == '_' || c == 'I' || c == '"' || c == '\'' || c == '\n';
+}
+
+// Everything that isn't converted is copied through unchanged, so instead of
+// writing it as it's scanned, the unwritten part of the input is tracked as a
+// single pending span that is flushed whenever a conversion starts.
 void CFile::Preproc()
 {
     char stringChar = 0;
 
+    m_pendingStart = m_pos;
+
     while (m_pos < m_size)
     {
         if (stringChar)
         {
             if (m_buffer[m_pos] == stringChar)
             {
-                std::putchar(stringChar);
                 m_pos++;
                 stringChar = 0;
             }
             else if (m_buffer[m_pos] == '\\' && m_buffer[m_pos + 1] == stringChar)
             {
-                std::putchar('\\');
-                std::putchar(stringChar);
                 m_pos += 2;
             }
             else
             {
-                if (m_buffer[m_pos] == '\n')
-                    m_lineNum++;
-                std::putchar(m_buffer[m_pos]);
-                m_pos++;
+                long spanStart = m_pos;
+
+                while (m_pos < m_size && m_buffer[m_pos] != stringChar && m_buffer[m_pos] != '\\')
+                {
+                    if (m_buffer[m_pos] == '\n')
+                        m_lineNum++;
+                    m_pos++;
+                }
+
+                // A backslash not followed by the quote is an ordinary character.
+                if (spanStart == m_pos)
+                    m_pos++;
             }
         }
         else
@@ -111,16 +134,28 @@ void CFile::Preproc()
 
             char c = m_buffer[m_pos++];
 
-            std::putchar(c);
-
             if (c == '\n')
                 m_lineNum++;
             else if (c == '"')
                 stringChar = '"';
             else if (c == '\'')
                 stringChar = '\'';
+            else
+                while (m_pos < m_size && !IsSpecialChar(m_buffer[m_pos]))
+                    m_pos++;
         }
     }
+
+    FlushPending();
+}
+
+// Writes the input that was passed over since the last conversion.
+void CFile::FlushPending()
+{
+    if (m_pos > m_pendingStart)
+        WriteOutput(&m_buffer[m_pendingStart], m_pos - m_pendingStart);
+
+    m_pendingStart = m_pos;
 }
 
 bool CFile::ConsumeHorizontalWhitespace()
@@ -170,6 +205,8 @@ void CFile::TryConvertString()
     if (m_buffer[m_pos] != '_' || (m_pos > 0 && IsIdentifierChar(m_buffer[m_pos - 1])))
         return;
 
+    FlushPending();
+
     m_pos++;
 
     if (m_buffer[m_pos] == '_')
@@ -191,7 +228,7 @@ void CFile::TryConvertString()
 
     SkipWhitespace();
 
-    std::printf("{ ");
+    WriteOutput("{ ");
 
     while (1)
     {
@@ -212,8 +249,15 @@ void CFile::TryConvertString()
                 RaiseError(e.what());
             }
 
+            std::string output;
+
             for (int i = 0; i < length; i++)
-                printf("0x%02X, ", s[i]);
+            {
+                AppendHexByte(output, s[i]);
+                output += ", ";
+            }
+
+            WriteOutput(output);
         }
         else if (m_buffer[m_pos] == ')')
         {
@@ -232,9 +276,11 @@ void CFile::TryConvertString()
     }
 
     if (noTerminator)
-        std::printf(" }");
+        WriteOutput(" }");
     else
-        std::printf("0xFF }");
+        WriteOutput("0xFF }");
+
+    m_pendingStart = m_pos;
 }
 
 bool CFile::CheckIdentifier(const std::string& ident)
@@ -250,6 +296,9 @@ bool CFile::CheckIdentifier(const std::string& ident)
 
 std::unique_ptr<unsigned char[]> CFile::ReadWholeFile(const std::string& path, int& size)
 {
+    if (g_assetCacheKey != nullptr)
+        AssetCacheAddDependency(g_assetCacheKey, path.c_str());
+
     FILE* fp = std::fopen(path.c_str(), "rb");
 
     if (fp == nullptr)
@@ -290,6 +339,209 @@ int ExtractData(const std::unique_ptr<unsigned char[]>& buffer, int offset, int
     }
 }
 
+// Formats the elements of an INCBIN file as a comma-separated list, with a
+// "u" suffix on unsigned elements.
+std::string FormatIncbinData(const std::unique_ptr<unsigned char[]>& buffer, int fileSize, int size, bool isSigned)
+{
+    int count = fileSize / size;
+    int offset = 0;
+    std::string output;
+
+    // The longest element is "-2147483648," or "4294967295u,".
+    output.reserve(count * (isSigned ? 4 : 5) + 64);
+
+    for (int i = 0; i < count; i++)
+    {
+        int data = ExtractData(buffer, offset, size);
+        offset += size;
+
+        if (isSigned)
+        {
+            AppendSigned(output, data);
+            output += ',';
+        }
+        else
+        {
+            AppendUnsigned(output, data);
+            output.append("u,", 2);
+        }
+    }
+
+    return output;
+}
+
+// Reads a token of the simple declarations that TryConvertIncbinToAsm accepts:
+// an identifier, a decimal number or a single punctuation character.
+static std::string ReadDeclarationToken(const std::string& s, std::size_t& pos)
+{
+    while (pos < s.length() && (s[pos] == ' ' || s[pos] == '\t'))
+        pos++;
+
+    std::size_t start = pos;
+
+    if (pos >= s.length())
+        return std::string();
+
+    if (IsIdentifierChar(s[pos]))
+    {
+        while (pos < s.length() && IsIdentifierChar(s[pos]))
+            pos++;
+    }
+    else
+    {
+        pos++;
+    }
+
+    return s.substr(start, pos - start);
+}
+
+// With --incbin-asm, a definition that is alone at the start of its line, like
+//     const u16 gFoo[] = INCBIN_U16("foo.gbapal");
+// is replaced with a declaration of the array with its real size and a
+// top-level asm statement that .incbins the file. The data then goes straight
+// to the assembler instead of through the compiler as initializer text.
+// Anything else (struct members, several files, attributes) returns false
+// without consuming any input and is expanded as usual. So are static arrays:
+// the compiler drops the unused ones, which it can't do for an asm block.
+bool CFile::TryConvertIncbinToAsm(const std::string& ident, int size)
+{
+    long lineStart = m_pos;
+
+    while (lineStart > 0 && m_buffer[lineStart - 1] != '\n')
+        lineStart--;
+
+    // Part of the line was already converted and written.
+    if (lineStart < m_pendingStart)
+        return false;
+
+    std::string declaration(&m_buffer[lineStart], m_pos - lineStart);
+    std::size_t declPos = 0;
+    std::string token = ReadDeclarationToken(declaration, declPos);
+
+    if (token != "const")
+        return false;
+
+    std::string type = ReadDeclarationToken(declaration, declPos);
+    int typeSize = 0;
+
+    if (type == "u8" || type == "s8")
+        typeSize = 1;
+    else if (type == "u16" || type == "s16")
+        typeSize = 2;
+    else if (type == "u32" || type == "s32")
+        typeSize = 4;
+
+    if (typeSize != size)
+        return false;
+
+    std::string name = ReadDeclarationToken(declaration, declPos);
+
+    if (name.empty() || !IsIdentifierStartingChar(name[0]))
+        return false;
+
+    if (ReadDeclarationToken(declaration, declPos) != "[")
+        return false;
+
+    token = ReadDeclarationToken(declaration, declPos);
+
+    long declaredCount = -1;
+
+    if (!token.empty() && IsAsciiDigit(token[0]))
+    {
+        declaredCount = std::strtol(token.c_str(), nullptr, 10);
+        token = ReadDeclarationToken(declaration, declPos);
+    }
+
+    if (token != "]"
+     || ReadDeclarationToken(declaration, declPos) != "="
+     || !ReadDeclarationToken(declaration, declPos).empty())
+        return false;
+
+    // Expect exactly ("PATH"); with nothing but horizontal whitespace between.
+    long pos = m_pos + ident.length();
+
+    while (m_buffer[pos] == ' ' || m_buffer[pos] == '\t')
+        pos++;
+
+    if (m_buffer[pos++] != '(')
+        return false;
+
+    while (m_buffer[pos] == ' ' || m_buffer[pos] == '\t')
+        pos++;
+
+    if (m_buffer[pos++] != '"')
+        return false;
+
+    long pathStart = pos;
+
+    while (pos < m_size && m_buffer[pos] != '"')
+    {
+        if (m_buffer[pos] == '\\' || m_buffer[pos] == '\n' || m_buffer[pos] == '\r' || m_buffer[pos] == 0)
+            return false;
+        pos++;
+    }
+
+    if (pos >= m_size)
+        return false;
+
+    std::string path(&m_buffer[pathStart], pos - pathStart);
+
+    pos++;
+
+    while (m_buffer[pos] == ' ' || m_buffer[pos] == '\t')
+        pos++;
+
+    if (m_buffer[pos++] != ')')
+        return false;
+
+    while (m_buffer[pos] == ' ' || m_buffer[pos] == '\t')
+        pos++;
+
+    if (m_buffer[pos++] != ';')
+        return false;
+
+    if (g_assetCacheKey != nullptr)
+        AssetCacheAddDependency(g_assetCacheKey, path.c_str());
+
+    FILE* fp = std::fopen(path.c_str(), "rb");
+
+    if (fp == nullptr)
+        RaiseError("Failed to open \"%s\" for reading.\n", path.c_str());
+
+    std::fseek(fp, 0, SEEK_END);
+    long fileSize = std::ftell(fp);
+    std::fclose(fp);
+
+    if ((fileSize % size) != 0)
+        RaiseError("Size %d doesn't evenly divide file size %ld.\n", size, fileSize);
+
+    long count = fileSize / size;
+
+    // A declared size that doesn't match would need zero padding or an error.
+    if (declaredCount != -1 && declaredCount != count)
+        return false;
+
+    // The text before the declaration on this line was already passed over.
+    long declarationEnd = m_pos;
+
+    m_pos = lineStart;
+    FlushPending();
+    m_pos = declarationEnd;
+
+    std::string output = "extern const " + type + " " + name + "[" + std::to_string(count) + "]; ";
+
+    // Arrays are word-aligned, as the compiler would do for them.
+    output += "asm(\".section .rodata\\n\\t.balign 4\\n\\t.global " + name + "\\n";
+    output += name + ":\\n\\t.incbin \\\"" + path + "\\\"\\n\\t.previous\");";
+
+    WriteOutput(output);
+
+    m_pos = pos;
+    m_pendingStart = m_pos;
+
+    return true;
+}
+
 void CFile::TryConvertIncbin()
 {
     std::string idents[6] = { "INCBIN_S8", "INCBIN_U8", "INCBIN_S16", "INCBIN_U16", "INCBIN_S32", "INCBIN_U32" };
@@ -310,6 +562,11 @@ void CFile::TryConvertIncbin()
     int size = 1 << (incbinType / 2);
     bool isSigned = ((incbinType % 2) == 0);
 
+    if (g_incbinAsm && TryConvertIncbinToAsm(idents[incbinType], size))
+        return;
+
+    FlushPending();
+
     long oldPos = m_pos;
     long oldLineNum = m_lineNum;
 
@@ -326,7 +583,7 @@ void CFile::TryConvertIncbin()
 
     m_pos++;
 
-    std::printf("{");
+    WriteOutput("{");
 
     while (true)
     {
@@ -368,19 +625,7 @@ void CFile::TryConvertIncbin()
         if ((fileSize % size) != 0)
             RaiseError("Size %d doesn't evenly divide file size %d.\n", size, fileSize);
 
-        int count = fileSize / size;
-        int offset = 0;
-
-        for (int i = 0; i < count; i++)
-        {
-            int data = ExtractData(buffer, offset, size);
-            offset += size;
-
-            if (isSigned)
-                std::printf("%d,", data);
-            else
-                std::printf("%uu,", data);
-        }
+        WriteOutput(FormatIncbinData(buffer, fileSize, size, isSigned));
 
         SkipWhitespace();
 
@@ -395,7 +640,9 @@ void CFile::TryConvertIncbin()
 
     m_pos++;
 
-    std::printf("}");
+    WriteOutput("}");
+
+    m_pendingStart = m_pos;
 }
 
 // Reports a diagnostic message.
@@ -41,8 +41,10 @@ private:
     long m_pos;
     long m_size;
     long m_lineNum;
+    long m_pendingStart;
     std::string m_filename;
 
+    void FlushPending();
     bool ConsumeHorizontalWhitespace();
     bool ConsumeNewline();
     void SkipWhitespace();
@@ -50,6 +52,7 @@ private:
     std::unique_ptr<unsigned char[]> ReadWholeFile(const std::string& path, int& size);
     bool CheckIdentifier(const std::string& ident);
     void TryConvertIncbin();
+    bool TryConvertIncbinToAsm(const std::string& ident, int size);
     void ReportDiagnostic(const char* type, const char* format, std::va_list args);
     void RaiseError(const char* format, ...);
     void RaiseWarning(const char* format, ...);
@@ -0,0 +1,63 @@
+#include <cstdio>
+#include <string>
+#include <vector>
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+#include "preproc.h"
+#include "cache_file.h"
+
+// Reads a whole cache file. Returns false if it doesn't exist or can't be read,
+// in which case the caller should regenerate the data.
+bool ReadCacheFile(const std::string& filename, std::vector<unsigned char>& data)
+{
+    FILE *fp = std::fopen(filename.c_str(), "rb");
+
+    if (fp == NULL)
+        return false;
+
+    std::fseek(fp, 0, SEEK_END);
+    long size = std::ftell(fp);
+    std::rewind(fp);
+
+    if (size < 0)
+    {
+        std::fclose(fp);
+        return false;
+    }
+
+    data.resize(size);
+
+    bool ok = size == 0 || std::fread(data.data(), size, 1, fp) == 1;
+
+    std::fclose(fp);
+
+    return ok;
+}
+
+// Several preproc processes may race to create the same cache file, so it is
+// written under a temporary name and moved into place.
+void WriteCacheFile(const std::string& filename, const void* data, std::size_t size)
+{
+    std::string tmpFilename = filename + ".tmp" + std::to_string((long long)getpid());
+    FILE *fp = std::fopen(tmpFilename.c_str(), "wb");
+
+    if (fp == NULL)
+        FATAL_ERROR("Failed to open \"%s\" for writing.\n", tmpFilename.c_str());
+
+    if (size != 0 && std::fwrite(data, size, 1, fp) != 1)
+        FATAL_ERROR("Failed to write \"%s\".\n", tmpFilename.c_str());
+
+    std::fclose(fp);
+
+    if (std::rename(tmpFilename.c_str(), filename.c_str()) != 0)
+    {
+        // Windows won't rename over an existing file.
+        std::remove(filename.c_str());
+        if (std::rename(tmpFilename.c_str(), filename.c_str()) != 0)
+            std::remove(tmpFilename.c_str());
+    }
+}
@@ -0,0 +1,10 @@
+#ifndef CACHE_FILE_H
+#define CACHE_FILE_H
+
+#include <string>
+#include <vector>
+
+bool ReadCacheFile(const std::string& filename, std::vector<unsigned char>& data);
+void WriteCacheFile(const std::string& filename, const void* data, std::size_t size);
+
+#endif // CACHE_FILE_H
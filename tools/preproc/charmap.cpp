@@ -21,10 +21,13 @@
 #include <cstdio>
 #include <cstdint>
 #include <cstdarg>
+#include <cstring>
 #include "preproc.h"
 #include "charmap.h"
 #include "char_util.h"
 #include "utf8.h"
+#include "hash.h"
+#include "cache_file.h"
 
 enum LhsType
 {
@@ -369,7 +372,227 @@ void CharmapReader::SkipWhitespace()
         m_pos++;
 }
 
-Charmap::Charmap(std::string filename)
+// The binary cache holds the parsed charmap so that it can be loaded with a
+// single read instead of being parsed again. It is tied to the charmap it was
+// made from by a hash of the charmap's contents.
+//
+// Format (all integers are little-endian u32 unless noted):
+//   "PPCM" magic, version, u64 source hash
+//   char count, then for each: code, sequence
+//   escape count, then for each: code, sequence
+//   constant count, then for each: name, sequence
+// where strings are stored as a length followed by that many bytes.
+
+static const char kCacheMagic[4] = { 'P', 'P', 'C', 'M' };
+static const std::uint32_t kCacheVersion = 1;
+
+static std::uint64_t HashFile(std::string filename)
+{
+    FILE *fp = std::fopen(filename.c_str(), "rb");
+
+    if (fp == NULL)
+        FATAL_ERROR("Failed to open \"%s\" for reading.\n", filename.c_str());
+
+    std::fseek(fp, 0, SEEK_END);
+    long size = std::ftell(fp);
+    std::rewind(fp);
+
+    std::vector<unsigned char> buffer(size);
+
+    if (size > 0 && std::fread(buffer.data(), size, 1, fp) != 1)
+        FATAL_ERROR("Failed to read \"%s\".\n", filename.c_str());
+
+    std::fclose(fp);
+
+    return HashBytes(buffer.data(), buffer.size());
+}
+
+class CacheReader
+{
+public:
+    CacheReader(const std::vector<unsigned char>& buffer) : m_buffer(buffer), m_pos(0), m_ok(true) {}
+
+    bool Ok() { return m_ok; }
+
+    std::uint32_t ReadU32()
+    {
+        if (m_pos + 4 > m_buffer.size())
+        {
+            m_ok = false;
+            return 0;
+        }
+
+        std::uint32_t value = m_buffer[m_pos]
+                            | (m_buffer[m_pos + 1] << 8)
+                            | (m_buffer[m_pos + 2] << 16)
+                            | ((std::uint32_t)m_buffer[m_pos + 3] << 24);
+        m_pos += 4;
+        return value;
+    }
+
+    std::string ReadString()
+    {
+        std::uint32_t length = ReadU32();
+
+        if (!m_ok || length > m_buffer.size() - m_pos)
+        {
+            m_ok = false;
+            return std::string();
+        }
+
+        std::string s(reinterpret_cast<const char*>(&m_buffer[m_pos]), length);
+        m_pos += length;
+        return s;
+    }
+
+private:
+    const std::vector<unsigned char>& m_buffer;
+    std::size_t m_pos;
+    bool m_ok;
+};
+
+static void WriteU32(std::vector<unsigned char>& buffer, std::uint32_t value)
+{
+    buffer.push_back(value & 0xFF);
+    buffer.push_back((value >> 8) & 0xFF);
+    buffer.push_back((value >> 16) & 0xFF);
+    buffer.push_back((value >> 24) & 0xFF);
+}
+
+static void WriteString(std::vector<unsigned char>& buffer, const std::string& s)
+{
+    WriteU32(buffer, s.length());
+    buffer.insert(buffer.end(), s.begin(), s.end());
+}
+
+// Returns false if the cache is missing, malformed or out of date.
+bool Charmap::LoadCache(std::string cacheFilename, std::uint64_t sourceHash)
+{
+    std::vector<unsigned char> buffer;
+
+    if (!ReadCacheFile(cacheFilename, buffer) || buffer.size() < 4 || std::memcmp(buffer.data(), kCacheMagic, 4) != 0)
+        return false;
+
+    CacheReader reader(buffer);
+    reader.ReadU32();
+
+    if (reader.ReadU32() != kCacheVersion)
+        return false;
+
+    std::uint64_t hash = reader.ReadU32();
+    hash |= (std::uint64_t)reader.ReadU32() << 32;
+
+    if (!reader.Ok() || hash != sourceHash)
+        return false;
+
+    std::uint32_t count = reader.ReadU32();
+
+    for (std::uint32_t i = 0; i < count && reader.Ok(); i++)
+    {
+        std::int32_t code = reader.ReadU32();
+        m_chars[code] = reader.ReadString();
+    }
+
+    count = reader.ReadU32();
+
+    for (std::uint32_t i = 0; i < count && reader.Ok(); i++)
+    {
+        std::uint32_t code = reader.ReadU32();
+        std::string sequence = reader.ReadString();
+
+        if (code >= 128)
+        {
+            Clear();
+            return false;
+        }
+
+        m_escapes[code] = sequence;
+    }
+
+    count = reader.ReadU32();
+
+    for (std::uint32_t i = 0; i < count && reader.Ok(); i++)
+    {
+        std::string name = reader.ReadString();
+        m_constants[name] = reader.ReadString();
+    }
+
+    if (!reader.Ok())
+    {
+        Clear();
+        return false;
+    }
+
+    return true;
+}
+
+// Forgets a partly loaded cache, so the charmap can be parsed from scratch.
+void Charmap::Clear()
+{
+    m_chars.clear();
+    for (int i = 0; i < 128; i++)
+        m_escapes[i].clear();
+    m_constants.clear();
+}
+
+void Charmap::SaveCache(std::string cacheFilename, std::uint64_t sourceHash)
+{
+    std::vector<unsigned char> buffer(kCacheMagic, kCacheMagic + 4);
+
+    WriteU32(buffer, kCacheVersion);
+    WriteU32(buffer, sourceHash & 0xFFFFFFFF);
+    WriteU32(buffer, sourceHash >> 32);
+
+    WriteU32(buffer, m_chars.size());
+    for (const auto& pair : m_chars)
+    {
+        WriteU32(buffer, pair.first);
+        WriteString(buffer, pair.second);
+    }
+
+    std::uint32_t escapeCount = 0;
+    for (int i = 0; i < 128; i++)
+        if (m_escapes[i].length() != 0)
+            escapeCount++;
+
+    WriteU32(buffer, escapeCount);
+    for (int i = 0; i < 128; i++)
+    {
+        if (m_escapes[i].length() != 0)
+        {
+            WriteU32(buffer, i);
+            WriteString(buffer, m_escapes[i]);
+        }
+    }
+
+    WriteU32(buffer, m_constants.size());
+    for (const auto& pair : m_constants)
+    {
+        WriteString(buffer, pair.first);
+        WriteString(buffer, pair.second);
+    }
+
+    WriteCacheFile(cacheFilename, buffer.data(), buffer.size());
+}
+
+Charmap::Charmap(std::string filename, std::string cacheFilename)
+{
+    if (cacheFilename.empty())
+    {
+        Parse(filename);
+        return;
+    }
+
+    std::uint64_t sourceHash = HashFile(filename);
+
+    if (!LoadCache(cacheFilename, sourceHash))
+    {
+        Parse(filename);
+        SaveCache(cacheFilename, sourceHash);
+    }
+}
+
+void Charmap::Parse(std::string filename)
 {
     CharmapReader reader(filename);
 
@@ -29,7 +29,7 @@
 class Charmap
 {
 public:
-    Charmap(std::string filename);
+    Charmap(std::string filename, std::string cacheFilename = std::string());
 
     std::string Char(std::int32_t code)
     {
@@ -56,6 +56,11 @@ public:
         return it->second;
     }
 private:
+    void Parse(std::string filename);
+    bool LoadCache(std::string cacheFilename, std::uint64_t sourceHash);
+    void Clear();
+    void SaveCache(std::string cacheFilename, std::uint64_t sourceHash);
+
     std::map<std::int32_t, std::string> m_chars;
     std::string m_escapes[128];
     std::map<std::string, std::string> m_constants;
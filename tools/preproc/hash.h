@@ -0,0 +1,22 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <cstddef>
+#include <cstdint>
+
+// 64-bit FNV-1a. Used to tell whether cached data is still valid, not for
+// anything that needs to resist deliberate collisions.
+inline std::uint64_t HashBytes(const unsigned char* data, std::size_t size)
+{
+    std::uint64_t hash = 0xCBF29CE484222325ULL;
+
+    for (std::size_t i = 0; i < size; i++)
+    {
+        hash ^= data[i];
+        hash *= 0x100000001B3ULL;
+    }
+
+    return hash;
+}
+
+#endif // HASH_H
@@ -0,0 +1,64 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <cstdio>
+#include <cstdint>
+#include <string>
+
+// Helpers for writing preprocessed output. Everything still goes through
+// stdout's stdio buffer, so these can be freely mixed with printf and puts,
+// but they avoid a library call and format string parse per character.
+
+inline void WriteOutput(const char* s, std::size_t length)
+{
+    std::fwrite(s, 1, length, stdout);
+}
+
+inline void WriteOutput(const char* s)
+{
+    WriteOutput(s, std::char_traits<char>::length(s));
+}
+
+inline void WriteOutput(const std::string& s)
+{
+    WriteOutput(s.data(), s.length());
+}
+
+// Appends "0xHH" for the byte, with uppercase hex digits.
+inline void AppendHexByte(std::string& out, unsigned char byte)
+{
+    static const char digits[] = "0123456789ABCDEF";
+    char s[4] = { '0', 'x', digits[byte >> 4], digits[byte & 0xF] };
+
+    out.append(s, 4);
+}
+
+// Appends the decimal representation of the value.
+inline void AppendUnsigned(std::string& out, std::uint32_t value)
+{
+    char s[10];
+    int length = 0;
+
+    do
+    {
+        s[9 - length++] = '0' + value % 10;
+        value /= 10;
+    } while (value != 0);
+
+    out.append(&s[10 - length], length);
+}
+
+inline void AppendSigned(std::string& out, std::int32_t value)
+{
+    if (value < 0)
+    {
+        out += '-';
+        AppendUnsigned(out, -static_cast<std::uint32_t>(value));
+    }
+    else
+    {
+        AppendUnsigned(out, value);
+    }
+}
+
+#endif // OUTPUT_H
@@ -18,28 +18,49 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 // THE SOFTWARE.
 
+#include <cstdlib>
+#include <cstring>
 #include <string>
 #include <stack>
+#include <vector>
+#ifdef _WIN32
+#include <io.h>
+#define dup _dup
+#define dup2 _dup2
+#define fileno _fileno
+#define close _close
+#else
+#include <unistd.h>
+#endif
 #include "preproc.h"
 #include "asm_file.h"
 #include "c_file.h"
 #include "charmap.h"
+#include "output.h"
+#include "asset_cache.h"
 
 Charmap* g_charmap;
+AssetCacheKey* g_assetCacheKey;
+bool g_incbinAsm;
 
 void PrintAsmBytes(unsigned char *s, int length)
 {
     if (length > 0)
     {
-        std::printf("\t.byte ");
+        std::string output("\t.byte ");
+
+        output.reserve(8 + length * 6);
+
         for (int i = 0; i < length; i++)
         {
-            std::printf("0x%02X", s[i]);
+            AppendHexByte(output, s[i]);
 
             if (i < length - 1)
-                std::printf(", ");
+                output.append(", ", 2);
         }
-        std::putchar('\n');
+
+        output += '\n';
+        WriteOutput(output);
     }
 }
 
@@ -66,9 +87,16 @@ void PreprocAsmFile(std::string filename)
         switch (directive)
         {
         case Directive::Include:
-            stack.push(AsmFile(stack.top().ReadPath()));
+        {
+            std::string path = stack.top().ReadPath();
+
+            if (g_assetCacheKey != nullptr)
+                AssetCacheAddDependency(g_assetCacheKey, path.c_str());
+
+            stack.push(AsmFile(path));
             stack.top().OutputLocation();
             break;
+        }
         case Directive::String:
         {
             unsigned char s[kMaxStringLength];
@@ -109,9 +137,9 @@ void PreprocCFile(std::string filename)
     cFile.Preproc();
 }
 
-char* GetFileExtension(char* filename)
+const char* GetFileExtension(const char* filename)
 {
-    char* extension = filename;
+    const char* extension = filename;
 
     while (*extension != 0)
         extension++;
@@ -130,27 +158,211 @@ char* GetFileExtension(char* filename)
     return extension;
 }
 
+void PreprocFile(std::string filename)
+{
+    const char* extension = GetFileExtension(filename.c_str());
+
+    if (!extension)
+        FATAL_ERROR("\"%s\" has no file extension.\n", filename.c_str());
+
+    if ((extension[0] == 's') && extension[1] == 0)
+        PreprocAsmFile(filename);
+    else if ((extension[0] == 'c' || extension[0] == 'i') && extension[1] == 0)
+        PreprocCFile(filename);
+    else
+        FATAL_ERROR("\"%s\" has an unknown file extension of \"%s\".\n", filename.c_str(), extension);
+}
+
+// While output is captured for the asset cache, stdout goes to this
+// temporary file.
+static FILE* s_capture;
+static int s_savedStdout = -1;
+
+static void StartCapture()
+{
+    std::fflush(stdout);
+    s_capture = std::tmpfile();
+
+    if (s_capture == nullptr || (s_savedStdout = dup(fileno(stdout))) < 0 || dup2(fileno(s_capture), fileno(stdout)) < 0)
+        FATAL_ERROR("Failed to capture output for the asset cache.\n");
+}
+
+// Points stdout back where it was and passes the captured output on.
+static void EndCapture(std::vector<unsigned char>& output)
+{
+    std::fflush(stdout);
+    dup2(s_savedStdout, fileno(stdout));
+    close(s_savedStdout);
+
+    unsigned char buffer[65536];
+    std::size_t count;
+
+    std::rewind(s_capture);
+
+    while ((count = std::fread(buffer, 1, sizeof(buffer), s_capture)) != 0)
+        output.insert(output.end(), buffer, buffer + count);
+
+    std::fclose(s_capture);
+    s_capture = nullptr;
+
+    WriteOutput(reinterpret_cast<char*>(output.data()), output.size());
+    std::fflush(stdout);
+}
+
+// If preproc exits with an error, the output so far still goes to stdout,
+// like it would without the cache.
+static void EndCaptureAtExit()
+{
+    std::vector<unsigned char> output;
+
+    if (s_capture != nullptr)
+        EndCapture(output);
+}
+
+// Preprocesses a file through the asset cache. The key covers the command
+// line, the charmap and the source file. Files the source pulls in are
+// recorded as the entry's dependencies while it's preprocessed. Output goes
+// to outFilename, or to stdout if it's null, in which case it's captured in
+// a temporary file on the way so it can be stored.
+void PreprocFileCached(std::vector<char*>& args, const char* charmapFilename, std::string srcFilename, const char* outFilename)
+{
+    AssetCacheKey key;
+
+    if (!AssetCacheBegin(&key, static_cast<int>(args.size()), args.data()))
+    {
+        PreprocFile(srcFilename);
+        return;
+    }
+
+    AssetCacheAddInput(&key, charmapFilename);
+    AssetCacheAddInput(&key, srcFilename.c_str());
+
+    std::size_t size;
+    unsigned char* data = AssetCacheFetch(&key, &size);
+
+    if (data != nullptr)
+    {
+        WriteOutput(reinterpret_cast<char*>(data), size);
+        std::free(data);
+        AssetCacheEnd(&key);
+        return;
+    }
+
+    if (outFilename == nullptr)
+    {
+        StartCapture();
+        std::atexit(EndCaptureAtExit);
+    }
+
+    g_assetCacheKey = &key;
+    PreprocFile(srcFilename);
+    g_assetCacheKey = nullptr;
+
+    if (outFilename == nullptr)
+    {
+        std::vector<unsigned char> output;
+
+        EndCapture(output);
+        AssetCacheStore(&key, output.data(), output.size());
+    }
+    else
+    {
+        std::fflush(stdout);
+        AssetCacheStoreFile(&key, outFilename);
+    }
+
+    AssetCacheEnd(&key);
+}
+
+// Reads "SRC_FILE OUT_FILE" pairs from stdin, one per line, and preprocesses
+// each of them with the already loaded charmap.
+void PreprocBatch(std::vector<char*>& args, const char* charmapFilename)
+{
+    char line[2 * kMaxPath + 2];
+    long lineNum = 0;
+
+    while (std::fgets(line, sizeof(line), stdin) != nullptr)
+    {
+        char srcFilename[kMaxPath];
+        char outFilename[kMaxPath];
+        char extra;
+
+        lineNum++;
+
+        if (std::strchr(line, '\n') == nullptr && !std::feof(stdin))
+            FATAL_ERROR("batch job %ld: line is too long\n", lineNum);
+
+        int count = std::sscanf(line, "%255s %255s %c", srcFilename, outFilename, &extra);
+
+        if (count <= 0)
+            continue;
+
+        if (count != 2)
+            FATAL_ERROR("batch job %ld: expected \"SRC_FILE OUT_FILE\"\n", lineNum);
+
+        if (std::freopen(outFilename, "w", stdout) == nullptr)
+            FATAL_ERROR("Failed to open \"%s\" for writing.\n", outFilename);
+
+        // The job's file names are part of its cache key.
+        args.push_back(srcFilename);
+        args.push_back(outFilename);
+        PreprocFileCached(args, charmapFilename, srcFilename, outFilename);
+        args.resize(args.size() - 2);
+
+        std::fflush(stdout);
+    }
+}
+
 int main(int argc, char **argv)
 {
-    if (argc != 3)
+    AssetCacheInit(argv[0]);
+
+    const char *usage = "Usage: %s [OPTIONS] SRC_FILE CHARMAP_FILE\n"
+                        "       %s [OPTIONS] --batch CHARMAP_FILE < JOBS\n"
+                        "Options:\n"
+                        "  --charmap-cache CACHE_FILE  cache the parsed charmap in CACHE_FILE\n"
+                        "  --incbin-asm                emit simple INCBIN arrays as .incbin directives\n";
+    std::string cacheFilename;
+    bool batch = false;
+    int i;
+
+    for (i = 1; i < argc && argv[i][0] == '-' && argv[i][1] == '-'; i++)
     {
-        std::fprintf(stderr, "Usage: %s SRC_FILE CHARMAP_FILE", argv[0]);
-        return 1;
+        std::string option(argv[i]);
+
+        if (option == "--batch")
+        {
+            batch = true;
+        }
+        else if (option == "--charmap-cache" && i + 1 < argc)
+        {
+            cacheFilename = argv[++i];
+        }
+        else if (option == "--incbin-asm")
+        {
+            g_incbinAsm = true;
+        }
+        else
+        {
+            std::fprintf(stderr, usage, argv[0], argv[0]);
+            return 1;
+        }
     }
 
-    g_charmap = new Charmap(argv[2]);
+    if (argc - i != (batch ? 1 : 2))
+    {
+        std::fprintf(stderr, usage, argv[0], argv[0]);
+        return 1;
+    }
 
-    char* extension = GetFileExtension(argv[1]);
+    g_charmap = new Charmap(argv[argc - 1], cacheFilename);
 
-    if (!extension)
-        FATAL_ERROR("\"%s\" has no file extension.\n", argv[1]);
+    std::vector<char*> args(argv, argv + argc);
 
-    if ((extension[0] == 's') && extension[1] == 0)
-        PreprocAsmFile(argv[1]);
-    else if ((extension[0] == 'c' || extension[0] == 'i') && extension[1] == 0)
-        PreprocCFile(argv[1]);
+    if (batch)
+        PreprocBatch(args, argv[argc - 1]);
     else
-        FATAL_ERROR("\"%s\" has an unknown file extension of \"%s\".\n", argv[1], extension);
+        PreprocFileCached(args, argv[argc - 1], argv[i], nullptr);
 
     return 0;
 }
@@ -49,6 +49,10 @@ const int kMaxPath = 256;
 const int kMaxStringLength = 1024;
 const unsigned long kMaxCharmapSequenceLength = 16;
 
+struct AssetCacheKey;
+
 extern Charmap* g_charmap;
+extern AssetCacheKey* g_assetCacheKey;
+extern bool g_incbinAsm;
 
 #endif // PREPROC_H
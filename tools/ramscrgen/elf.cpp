@@ -1,272 +1,170 @@
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <cstdint>
 #include <map>
 #include <vector>
 #include <string>
 #include "ramscrgen.h"
+#include "elf_reader.h"
 #include "elf.h"
 
-#define SHN_COMMON 0xFFF2
+// Every object and archive is read into memory once and its COMMON symbols
+// are collected the first time they're asked for. Archives are indexed by
+// member name when they're loaded, so looking up a member doesn't scan the
+// archive again.
 
-static std::string s_elfPath;
-static std::string s_archiveFilePath;
-static std::string s_archiveObjectPath;
-
-static FILE *s_file;
-
-static std::uint32_t s_sectionHeaderOffset;
-static int s_sectionHeaderEntrySize;
-static int s_sectionCount;
-static int s_shstrtabIndex;
-
-static std::uint32_t s_symtabOffset;
-static std::uint32_t s_strtabOffset;
-
-static std::uint32_t s_symbolCount;
-static std::uint32_t s_elfFileOffset;
-
-struct Symbol
+struct ArchiveMember
 {
-    std::uint32_t nameOffset;
-    std::uint32_t size;
+    std::size_t offset;
+    std::size_t size;
 };
 
-static void Seek(long offset)
+struct Archive
 {
-    if (std::fseek(s_file, s_elfFileOffset + offset, SEEK_SET) != 0)
-        FATAL_ERROR("error: failed to seek to %ld in \"%s\"", offset, s_elfPath.c_str());
-}
+    std::vector<unsigned char> data;
+    std::map<std::string, ArchiveMember> members;
+};
 
-static void Skip(long offset)
-{
-    if (std::fseek(s_file, offset, SEEK_CUR) != 0)
-        FATAL_ERROR("error: failed to skip %ld bytes in \"%s\"", offset, s_elfPath.c_str());
-}
+static std::map<std::string, Archive> s_archives;
+static std::map<std::string, std::map<std::string, std::uint32_t>> s_commonSymbols;
 
-static std::uint32_t ReadInt8()
+static std::vector<unsigned char> ReadWholeFile(const std::string& path)
 {
-    int c = std::fgetc(s_file);
+    FILE *file = std::fopen(path.c_str(), "rb");
 
-    if (c < 0)
-        FATAL_ERROR("error: unexpected EOF when reading ELF file \"%s\"\n", s_elfPath.c_str());
+    if (file == NULL)
+        FATAL_ERROR("error: failed to open \"%s\" for reading\n", path.c_str());
 
-    return c;
-}
+    std::vector<unsigned char> data;
+    unsigned char buffer[65536];
+    std::size_t count;
 
-static std::uint32_t ReadInt16()
-{
-    std::uint32_t val = 0;
-    val |= ReadInt8();
-    val |= ReadInt8() << 8;
-    return val;
-}
+    while ((count = std::fread(buffer, 1, sizeof(buffer), file)) != 0)
+        data.insert(data.end(), buffer, buffer + count);
 
-static std::uint32_t ReadInt32()
-{
-    std::uint32_t val = 0;
-    val |= ReadInt8();
-    val |= ReadInt8() << 8;
-    val |= ReadInt8() << 16;
-    val |= ReadInt8() << 24;
-    return val;
-}
+    if (std::ferror(file))
+        FATAL_ERROR("error: failed to read \"%s\"\n", path.c_str());
 
-static std::string ReadString()
-{
-    std::string s;
-    char c;
-
-    while ((c = ReadInt8()) != 0)
-        s += c;
+    std::fclose(file);
 
-    return s;
+    return data;
 }
 
-static void VerifyElfIdent()
+static std::map<std::string, std::uint32_t> ReadCommonSymbols(const unsigned char *data, std::size_t size, const std::string& path)
 {
-    char expectedMagic[4] = { 0x7F, 'E', 'L', 'F' };
-    char magic[4];
-
-    if (std::fread(magic, 4, 1, s_file) != 1)
-        FATAL_ERROR("error: failed to read ELF magic from \"%s\"\n", s_elfPath.c_str());
+    std::vector<ElfSectionHeader> sections;
+    std::vector<ElfSymbolEntry> symbols;
+    std::map<std::string, std::uint32_t> commonSymbols;
 
-    if (std::memcmp(magic, expectedMagic, 4) != 0)
-        FATAL_ERROR("error: ELF magic did not match in \"%s\"\n", s_elfPath.c_str());
+    ReadElfTables(data, size, path, sections, symbols);
 
-    if (std::fgetc(s_file) != 1)
-        FATAL_ERROR("error: \"%s\" not 32-bit ELF\n", s_elfPath.c_str());
+    for (const ElfSymbolEntry& symbol : symbols)
+    {
+        if (symbol.sectionIndex == SHN_COMMON)
+            commonSymbols[symbol.name] = symbol.size;
+    }
 
-    if (std::fgetc(s_file) != 1)
-        FATAL_ERROR("error: \"%s\" not little-endian ELF\n", s_elfPath.c_str());
+    return commonSymbols;
 }
 
-static void VerifyAr()
+static Archive& LoadArchive(const std::string& path)
 {
-    char expectedMagic[8] = {'!', '<', 'a', 'r', 'c', 'h', '>', '\n'};
-    char magic[8];
+    auto it = s_archives.find(path);
 
-    if (std::fread(magic, 8, 1, s_file) != 1)
-        FATAL_ERROR("error: failed to read AR magic from \"%s\"\n", s_archiveFilePath.c_str());
+    if (it != s_archives.end())
+        return it->second;
 
-    if (std::memcmp(magic, expectedMagic, 8) != 0)
-        FATAL_ERROR("error: AR magic did not match in \"%s\"\n", s_archiveFilePath.c_str());
-}
+    Archive& archive = s_archives[path];
+    archive.data = ReadWholeFile(path);
 
-static void ReadElfHeader()
-{
-    Seek(0x20);
-    s_sectionHeaderOffset = ReadInt32();
-    Seek(0x2E);
-    s_sectionHeaderEntrySize = ReadInt16();
-    s_sectionCount = ReadInt16();
-    s_shstrtabIndex = ReadInt16();
-}
-
-static void FindArObj()
-{
-    char file_ident[17] = {0};
-    char filesize_s[11] = {0};
-    char expectedEndMagic[2] = { 0x60, 0x0a };
-    char end_magic[2];
-    std::size_t filesize;
-
-    Seek(8);
-    while (!std::feof(s_file)) {
-        if (std::fread(file_ident, 16, 1, s_file) != 1)
-            FATAL_ERROR("error: failed to read file ident in \"%s\"\n", s_archiveFilePath.c_str());
-        Skip(32);
-        if (std::fread(filesize_s, 10, 1, s_file) != 1)
-            FATAL_ERROR("error: failed to read filesize in \"%s\"\n", s_archiveFilePath.c_str());
-        if (std::fread(end_magic, 2, 1, s_file) != 1)
-            FATAL_ERROR("error: failed to read end sentinel in \"%s\"\n", s_archiveFilePath.c_str());
-        if (std::memcmp(end_magic, expectedEndMagic, 2) != 0)
-            FATAL_ERROR("error: corrupted archive header in \"%s\" at \"%s\"\n", s_archiveFilePath.c_str(), file_ident);
-
-        char * ptr = std::strchr(file_ident, '/');
-        if (ptr != nullptr)
-            *ptr = 0;
-        filesize = std::strtoul(filesize_s, nullptr, 10);
-        if (std::strncmp(s_archiveObjectPath.c_str(), file_ident, 16) == 0) {
-            s_elfFileOffset = std::ftell(s_file);
-            return;
-        }
-        Skip(filesize);
-    }
-
-    FATAL_ERROR("error: could not find object \"%s\" in archive \"%s\"\n", s_archiveObjectPath.c_str(), s_archiveFilePath.c_str());
-}
+    const std::vector<unsigned char>& data = archive.data;
+    char expectedMagic[8] = {'!', '<', 'a', 'r', 'c', 'h', '>', '\n'};
 
-static std::string GetSectionName(std::uint32_t shstrtabOffset, int index)
-{
-    Seek(s_sectionHeaderOffset + s_sectionHeaderEntrySize * index);
-    std::uint32_t nameOffset = ReadInt32();
-    Seek(shstrtabOffset + nameOffset);
-    return ReadString();
-}
+    if (data.size() < 8)
+        FATAL_ERROR("error: failed to read AR magic from \"%s\"\n", path.c_str());
 
-static void FindTableOffsets()
-{
-    s_symtabOffset = 0;
-    s_strtabOffset = 0;
+    if (std::memcmp(data.data(), expectedMagic, 8) != 0)
+        FATAL_ERROR("error: AR magic did not match in \"%s\"\n", path.c_str());
 
-    Seek(s_sectionHeaderOffset + s_sectionHeaderEntrySize * s_shstrtabIndex + 0x10);
-    std::uint32_t shstrtabOffset = ReadInt32();
+    std::size_t pos = 8;
 
-    for (int i = 0; i < s_sectionCount; i++)
+    while (pos < data.size())
     {
-        std::string name = GetSectionName(shstrtabOffset, i);
-
-        if (name == ".symtab")
-        {
-            if (s_symtabOffset)
-                FATAL_ERROR("error: mutiple .symtab sections found in \"%s\"\n", s_elfPath.c_str());
-            Seek(s_sectionHeaderOffset + s_sectionHeaderEntrySize * i + 0x10);
-            s_symtabOffset = ReadInt32();
-            std::uint32_t size = ReadInt32();
-            s_symbolCount = size / 16;
-        }
-        else if (name == ".strtab")
-        {
-            if (s_strtabOffset)
-                FATAL_ERROR("error: mutiple .strtab sections found in \"%s\"\n", s_elfPath.c_str());
-            Seek(s_sectionHeaderOffset + s_sectionHeaderEntrySize * i + 0x10);
-            s_strtabOffset = ReadInt32();
-        }
-    }
+        // Each member has a 60-byte header: a 16-byte name, 32 bytes of
+        // metadata we don't need, a 10-byte size and a 2-byte end marker.
+        if (data.size() - pos < 60)
+            FATAL_ERROR("error: failed to read file ident in \"%s\"\n", path.c_str());
 
-    if (!s_symtabOffset)
-        FATAL_ERROR("error: couldn't find .symtab section in \"%s\"\n", s_elfPath.c_str());
+        char fileIdent[17] = {0};
+        char fileSize[11] = {0};
 
-    if (!s_strtabOffset)
-        FATAL_ERROR("error: couldn't find .strtab section in \"%s\"\n", s_elfPath.c_str());
-}
+        std::memcpy(fileIdent, &data[pos], 16);
+        std::memcpy(fileSize, &data[pos + 48], 10);
 
-static std::map<std::string, std::uint32_t> GetCommonSymbols_Shared()
-{
-    VerifyElfIdent();
-    ReadElfHeader();
-    FindTableOffsets();
+        if (data[pos + 58] != 0x60 || data[pos + 59] != 0x0A)
+            FATAL_ERROR("error: corrupted archive header in \"%s\" at \"%s\"\n", path.c_str(), fileIdent);
 
-    std::map<std::string, std::uint32_t> commonSymbols;
+        char *ptr = std::strchr(fileIdent, '/');
+        if (ptr != nullptr)
+            *ptr = 0;
 
-    std::vector<Symbol> commonSymbolVec;
+        ArchiveMember member;
+        member.offset = pos + 60;
+        member.size = std::strtoul(fileSize, nullptr, 10);
 
-    Seek(s_symtabOffset);
+        if (member.size > data.size() - member.offset)
+            member.size = data.size() - member.offset;
 
-    for (std::uint32_t i = 0; i < s_symbolCount; i++)
-    {
-        Symbol sym;
-        sym.nameOffset = ReadInt32();
-        Skip(4);
-        sym.size = ReadInt32();
-        Skip(2);
-        std::uint16_t sectionIndex = ReadInt16();
-        if (sectionIndex == SHN_COMMON)
-            commonSymbolVec.push_back(sym);
-    }
+        // The first member with a name wins, as the linker would pick.
+        archive.members.insert(std::make_pair(std::string(fileIdent), member));
 
-    for (const Symbol& sym : commonSymbolVec)
-    {
-        Seek(s_strtabOffset + sym.nameOffset);
-        std::string name = ReadString();
-        commonSymbols[name] = sym.size;
+        // Members are padded to an even offset.
+        pos = member.offset + member.size + (member.size & 1);
     }
 
-    return commonSymbols;
+    return archive;
 }
 
-std::map<std::string, std::uint32_t> GetCommonSymbolsFromLib(std::string sourcePath, std::string libpath)
+static std::map<std::string, std::uint32_t> GetCommonSymbolsFromLib(std::string sourcePath, std::string libpath)
 {
     std::size_t colonPos = libpath.find(':');
     if (colonPos == std::string::npos)
-        FATAL_ERROR("error: missing colon separator in libfile \"%s\"\n", s_elfPath.c_str());
+        FATAL_ERROR("error: missing colon separator in libfile \"%s\"\n", libpath.c_str());
 
-    s_archiveObjectPath = libpath.substr(colonPos + 1);
-    s_archiveFilePath = sourcePath + "/" + libpath.substr(1, colonPos - 1);
-    s_elfPath = sourcePath + "/" + libpath.substr(1);
+    std::string archiveObjectPath = libpath.substr(colonPos + 1);
+    std::string archiveFilePath = sourcePath + "/" + libpath.substr(1, colonPos - 1);
+    std::string elfPath = sourcePath + "/" + libpath.substr(1);
 
-    s_file = std::fopen(s_archiveFilePath.c_str(), "rb");
+    Archive& archive = LoadArchive(archiveFilePath);
+    auto member = archive.members.find(archiveObjectPath.substr(0, 16));
 
-    if (s_file == NULL)
-        FATAL_ERROR("error: failed to open \"%s\" for reading\n", s_archiveFilePath.c_str());
+    if (member == archive.members.end())
+        FATAL_ERROR("error: could not find object \"%s\" in archive \"%s\"\n", archiveObjectPath.c_str(), archiveFilePath.c_str());
 
-    VerifyAr();
-    FindArObj();
-    return GetCommonSymbols_Shared();
+    return ReadCommonSymbols(archive.data.data() + member->second.offset, member->second.size, elfPath);
 }
 
 std::map<std::string, std::uint32_t> GetCommonSymbols(std::string sourcePath, std::string path)
 {
-    s_elfFileOffset = 0;
-    if (path[0] == '*')
-        return GetCommonSymbolsFromLib(sourcePath, path);
+    std::string key = sourcePath + "/" + path;
+    auto cached = s_commonSymbols.find(key);
 
-    s_elfPath = sourcePath + "/" + path;
-    s_file = std::fopen(s_elfPath.c_str(), "rb");
+    if (cached != s_commonSymbols.end())
+        return cached->second;
 
-    if (s_file == NULL)
-        FATAL_ERROR("error: failed to open \"%s\" for reading\n", path.c_str());
+    std::map<std::string, std::uint32_t> commonSymbols;
 
-    return GetCommonSymbols_Shared();
+    if (path[0] == '*')
+    {
+        commonSymbols = GetCommonSymbolsFromLib(sourcePath, path);
+    }
+    else
+    {
+        std::vector<unsigned char> data = ReadWholeFile(key);
+        commonSymbols = ReadCommonSymbols(data.data(), data.size(), key);
+    }
+
+    s_commonSymbols[key] = commonSymbols;
+    return commonSymbols;
 }
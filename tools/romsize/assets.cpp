@@ -0,0 +1,338 @@
+#include <cctype>
+#include <cstring>
+#include <vector>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "romsize.h"
+#include "assets.h"
+
+const char *GetAssetClassName(AssetClass assetClass)
+{
+    switch (assetClass)
+    {
+    case AssetClass::Code:
+        return "code";
+    case AssetClass::Graphics:
+        return "graphics";
+    case AssetClass::Sound:
+        return "sound";
+    case AssetClass::Maps:
+        return "maps";
+    case AssetClass::Text:
+        return "text";
+    default:
+        return "other";
+    }
+}
+
+static bool StartsWith(const std::string& s, const char *prefix)
+{
+    return s.compare(0, std::strlen(prefix), prefix) == 0;
+}
+
+static bool Contains(const std::string& s, const char *part)
+{
+    return s.find(part) != std::string::npos;
+}
+
+AssetClass ClassifyAssetPath(const std::string& path)
+{
+    if (StartsWith(path, "sound/"))
+        return AssetClass::Sound;
+
+    // Tilesets are mostly graphics, except for the metatiles that maps are
+    // built from.
+    if (StartsWith(path, "data/tilesets/") && Contains(path, "metatile"))
+        return AssetClass::Maps;
+
+    if (StartsWith(path, "graphics/") || StartsWith(path, "data/tilesets/"))
+        return AssetClass::Graphics;
+
+    if (StartsWith(path, "data/maps/") || StartsWith(path, "data/layouts/"))
+        return AssetClass::Maps;
+
+    return AssetClass::Other;
+}
+
+AssetClass ClassifyInputSection(const std::string& sectionName, const std::string& file, bool executable)
+{
+    if (executable || StartsWith(sectionName, ".text"))
+        return AssetClass::Code;
+
+    std::string name = file.substr(file.find_last_of('/') == std::string::npos ? 0 : file.find_last_of('/') + 1);
+
+    if (StartsWith(file, "sound/"))
+        return AssetClass::Sound;
+
+    if (Contains(file, "data/maps") || Contains(file, "data/map_events") || Contains(file, "data/layouts")
+     || Contains(file, "data/tilesets"))
+        return AssetClass::Maps;
+
+    if (Contains(name, "text") || Contains(name, "string"))
+        return AssetClass::Text;
+
+    if (Contains(file, "graphics"))
+        return AssetClass::Graphics;
+
+    return AssetClass::Other;
+}
+
+static bool IsIdentifierChar(char c)
+{
+    return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+}
+
+// Finds "NAME[...] = INCBIN_XX("path"" in C source.
+static void ScanCFile(const std::string& text, std::map<std::string, std::string>& incbins)
+{
+    std::size_t pos = 0;
+
+    while ((pos = text.find("INCBIN_", pos)) != std::string::npos)
+    {
+        std::size_t start = pos;
+        std::size_t i = pos + 7;
+
+        pos = i;
+
+        while (i < text.size() && IsIdentifierChar(text[i]))
+            i++;
+
+        while (i < text.size() && std::isspace(static_cast<unsigned char>(text[i])))
+            i++;
+
+        if (i >= text.size() || text[i] != '(')
+            continue;
+
+        i++;
+
+        while (i < text.size() && std::isspace(static_cast<unsigned char>(text[i])))
+            i++;
+
+        if (i >= text.size() || text[i] != '"')
+            continue;
+
+        std::size_t pathEnd = text.find('"', i + 1);
+
+        if (pathEnd == std::string::npos)
+            break;
+
+        std::string path = text.substr(i + 1, pathEnd - i - 1);
+
+        // Walks back over "NAME[...] = ". An INCBIN that's only an element
+        // of an array has no symbol of its own.
+        std::size_t j = start;
+
+        while (j > 0 && std::isspace(static_cast<unsigned char>(text[j - 1])))
+            j--;
+
+        if (j == 0 || text[j - 1] != '=')
+            continue;
+
+        j--;
+
+        while (j > 0 && std::isspace(static_cast<unsigned char>(text[j - 1])))
+            j--;
+
+        while (j > 0 && text[j - 1] == ']')
+        {
+            std::size_t open = text.rfind('[', j - 1);
+
+            if (open == std::string::npos)
+                break;
+
+            j = open;
+
+            while (j > 0 && std::isspace(static_cast<unsigned char>(text[j - 1])))
+                j--;
+        }
+
+        std::size_t nameEnd = j;
+
+        while (j > 0 && IsIdentifierChar(text[j - 1]))
+            j--;
+
+        if (j != nameEnd)
+            incbins[text.substr(j, nameEnd - j)] = path;
+    }
+}
+
+// Finds a label directly followed by '.incbin "path"' in assembly.
+static void ScanAsmFile(const std::string& text, std::map<std::string, std::string>& incbins)
+{
+    std::size_t lineStart = 0;
+    std::string label;
+
+    while (lineStart < text.size())
+    {
+        std::size_t lineEnd = text.find('\n', lineStart);
+
+        if (lineEnd == std::string::npos)
+            lineEnd = text.size();
+
+        std::size_t i = lineStart;
+
+        while (i < lineEnd && std::isspace(static_cast<unsigned char>(text[i])))
+            i++;
+
+        std::size_t nameEnd = i;
+
+        while (nameEnd < lineEnd && IsIdentifierChar(text[nameEnd]))
+            nameEnd++;
+
+        if (nameEnd > i && nameEnd < lineEnd && text[nameEnd] == ':')
+        {
+            label = text.substr(i, nameEnd - i);
+        }
+        else if (text.compare(i, 7, ".incbin") == 0)
+        {
+            std::size_t quote = text.find('"', i);
+            std::size_t endQuote = quote == std::string::npos ? quote : text.find('"', quote + 1);
+
+            if (!label.empty() && endQuote != std::string::npos && endQuote < lineEnd)
+                incbins[label] = text.substr(quote + 1, endQuote - quote - 1);
+
+            label.clear();
+        }
+        else if (i < lineEnd && text[i] != '@' && text.compare(i, 2, "//") != 0)
+        {
+            // Anything else separates the label from later data.
+            label.clear();
+        }
+
+        lineStart = lineEnd + 1;
+    }
+}
+
+static void ScanDirectory(const std::string& dir, std::map<std::string, std::string>& incbins)
+{
+    DIR *d = opendir(dir.c_str());
+
+    if (d == nullptr)
+        return;
+
+    std::vector<std::string> entries;
+    struct dirent *entry;
+
+    while ((entry = readdir(d)) != nullptr)
+    {
+        if (entry->d_name[0] != '.')
+            entries.push_back(entry->d_name);
+    }
+
+    closedir(d);
+
+    for (const std::string& name : entries)
+    {
+        std::string path = dir + "/" + name;
+        struct stat st;
+
+        if (stat(path.c_str(), &st) != 0)
+            continue;
+
+        if (S_ISDIR(st.st_mode))
+        {
+            ScanDirectory(path, incbins);
+            continue;
+        }
+
+        std::size_t dot = name.find_last_of('.');
+        std::string extension = dot == std::string::npos ? "" : name.substr(dot);
+        bool isC = extension == ".c" || extension == ".h";
+        bool isAsm = extension == ".s" || extension == ".inc";
+
+        if (!isC && !isAsm)
+            continue;
+
+        std::vector<unsigned char> data = ReadWholeFile(path);
+        std::string text(data.begin(), data.end());
+
+        if (isC)
+            ScanCFile(text, incbins);
+        else
+            ScanAsmFile(text, incbins);
+    }
+}
+
+std::map<std::string, std::string> ScanIncbins(const std::string& sourceDir)
+{
+    std::map<std::string, std::string> incbins;
+    const char *dirs[] = { "src", "data", "sound", "gflib", "asm" };
+
+    for (const char *dir : dirs)
+        ScanDirectory(sourceDir + "/" + dir, incbins);
+
+    return incbins;
+}
+
+std::uint32_t EstimateLZSize(const unsigned char *data, std::uint32_t size)
+{
+    const int kHashBits = 14;
+    const std::uint32_t kWindow = 0x1000;
+    const std::uint32_t kMinDistance = 2; // VRAM can't take a distance of 1
+    const std::uint32_t kMaxLength = 18;
+    const int kMaxChain = 64;
+
+    std::vector<std::int32_t> head(1 << kHashBits, -1);
+    std::vector<std::int32_t> prev(size, -1);
+    std::uint32_t compressedSize = 4;
+    int blocks = 0;
+    std::uint32_t pos = 0;
+
+    auto hash = [&](std::uint32_t p) {
+        return ((data[p] << 10) ^ (data[p + 1] << 5) ^ data[p + 2]) & ((1 << kHashBits) - 1);
+    };
+
+    auto insert = [&](std::uint32_t p) {
+        if (p + 3 <= size)
+        {
+            std::uint32_t h = hash(p);
+            prev[p] = head[h];
+            head[h] = p;
+        }
+    };
+
+    while (pos < size)
+    {
+        std::uint32_t bestLength = 0;
+
+        if (pos + 3 <= size)
+        {
+            std::int32_t candidate = head[hash(pos)];
+
+            for (int chain = 0; candidate >= 0 && chain < kMaxChain; chain++)
+            {
+                std::uint32_t distance = pos - candidate;
+
+                if (distance > kWindow)
+                    break;
+
+                if (distance >= kMinDistance)
+                {
+                    std::uint32_t length = 0;
+
+                    while (length < kMaxLength && pos + length < size && data[candidate + length] == data[pos + length])
+                        length++;
+
+                    if (length > bestLength)
+                        bestLength = length;
+                }
+
+                candidate = prev[candidate];
+            }
+        }
+
+        if (blocks++ % 8 == 0)
+            compressedSize++;
+
+        std::uint32_t length = bestLength >= 3 ? bestLength : 1;
+
+        compressedSize += bestLength >= 3 ? 2 : 1;
+
+        for (std::uint32_t i = 0; i < length; i++)
+            insert(pos + i);
+
+        pos += length;
+    }
+
+    return (compressedSize + 3) & ~3u;
+}
@@ -0,0 +1,36 @@
+#ifndef ASSETS_H
+#define ASSETS_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+// The kinds of data that the ROM's space is split into.
+enum class AssetClass
+{
+    Code,
+    Graphics,
+    Sound,
+    Maps,
+    Text,
+    Other,
+};
+
+const char *GetAssetClassName(AssetClass assetClass);
+
+// Classifies an INCBIN'd file by its path.
+AssetClass ClassifyAssetPath(const std::string& path);
+
+// Classifies an input section by its name and the object it came from.
+AssetClass ClassifyInputSection(const std::string& sectionName, const std::string& file, bool executable);
+
+// Finds the files that symbols INCBIN, in C sources as
+// "gFoo[] = INCBIN_U32("path")" and in assembly as a label followed by
+// '.incbin "path"'. Returns a map from symbol to path.
+std::map<std::string, std::string> ScanIncbins(const std::string& sourceDir);
+
+// Returns the size the data would have compressed with the BIOS's LZ77
+// format, using a greedy parse like gbagfx's.
+std::uint32_t EstimateLZSize(const unsigned char *data, std::uint32_t size);
+
+#endif // ASSETS_H
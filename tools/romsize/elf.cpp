@@ -0,0 +1,71 @@
+#include "romsize.h"
+#include "elf_reader.h"
+#include "elf.h"
+
+void ReadElfFile(const std::string& path, ElfFile& elf)
+{
+    std::vector<ElfSectionHeader> headers;
+    std::vector<ElfSymbolEntry> entries;
+
+    elf.data = ReadWholeFile(path);
+    ReadElfTables(elf.data.data(), elf.data.size(), path, headers, entries);
+
+    // Maps ELF section indices to indices into elf.sections, which only has
+    // the allocated ones.
+    std::vector<int> sectionIndices(headers.size(), -1);
+
+    for (std::size_t i = 0; i < headers.size(); i++)
+    {
+        const ElfSectionHeader& header = headers[i];
+
+        if (!(header.flags & SHF_ALLOC))
+            continue;
+
+        ElfSection section;
+        section.name = header.name;
+        section.address = header.address;
+        section.size = header.size;
+        section.fileOffset = header.fileOffset;
+        section.hasData = header.type != SHT_NOBITS;
+        section.executable = (header.flags & SHF_EXECINSTR) != 0;
+
+        sectionIndices[i] = elf.sections.size();
+        elf.sections.push_back(section);
+    }
+
+    for (const ElfSymbolEntry& entry : entries)
+    {
+        if (entry.size == 0 || (entry.type != STT_OBJECT && entry.type != STT_FUNC))
+            continue;
+
+        ElfSymbol symbol;
+        symbol.name = entry.name;
+        symbol.address = entry.value;
+        symbol.size = entry.size;
+        symbol.isFunction = entry.type == STT_FUNC;
+        symbol.section = -1;
+
+        // Thumb functions have the low bit of their address set.
+        if (symbol.isFunction)
+            symbol.address &= ~1u;
+
+        if (entry.sectionIndex < SHN_LORESERVE && entry.sectionIndex < headers.size())
+            symbol.section = sectionIndices[entry.sectionIndex];
+
+        elf.symbols.push_back(symbol);
+    }
+}
+
+const unsigned char *ElfFile::GetSymbolData(const ElfSymbol& symbol) const
+{
+    if (symbol.section < 0)
+        return nullptr;
+
+    const ElfSection& section = sections[symbol.section];
+
+    if (!section.hasData || symbol.address < section.address || symbol.size > section.size
+     || symbol.address - section.address > section.size - symbol.size)
+        return nullptr;
+
+    return data.data() + section.fileOffset + (symbol.address - section.address);
+}
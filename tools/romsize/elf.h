@@ -0,0 +1,42 @@
+#ifndef ELF_H
+#define ELF_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct ElfSection
+{
+    std::string name;
+    std::uint32_t address;
+    std::uint32_t size;
+    std::uint32_t fileOffset;
+    bool hasData;    // false for NOBITS sections like .bss
+    bool executable;
+};
+
+struct ElfSymbol
+{
+    std::string name;
+    std::uint32_t address;
+    std::uint32_t size;
+    bool isFunction;
+    int section;     // index into ElfFile::sections, or -1
+};
+
+// The allocated sections and sized symbols of a 32-bit little-endian ELF
+// file, with its contents kept so symbols' bytes can be read.
+struct ElfFile
+{
+    std::vector<unsigned char> data;
+    std::vector<ElfSection> sections;
+    std::vector<ElfSymbol> symbols;
+
+    // Returns a pointer to a symbol's bytes, or nullptr if they aren't in
+    // the file.
+    const unsigned char *GetSymbolData(const ElfSymbol& symbol) const;
+};
+
+void ReadElfFile(const std::string& path, ElfFile& elf);
+
+#endif // ELF_H
@@ -0,0 +1,439 @@
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+#include "romsize.h"
+#include "elf.h"
+#include "map_file.h"
+#include "assets.h"
+
+Region GetRegion(std::uint32_t address)
+{
+    switch (address >> 24)
+    {
+    case 0x02:
+        return Region::Ewram;
+    case 0x03:
+        return Region::Iwram;
+    case 0x08:
+    case 0x09:
+        return Region::Rom;
+    default:
+        return Region::Other;
+    }
+}
+
+const char *GetRegionName(Region region)
+{
+    switch (region)
+    {
+    case Region::Rom:
+        return "ROM";
+    case Region::Ewram:
+        return "EWRAM";
+    case Region::Iwram:
+        return "IWRAM";
+    default:
+        return "other";
+    }
+}
+
+std::uint32_t GetRegionCapacity(Region region)
+{
+    switch (region)
+    {
+    case Region::Rom:
+        return 0x2000000;
+    case Region::Ewram:
+        return 0x40000;
+    case Region::Iwram:
+        return 0x8000;
+    default:
+        return 0;
+    }
+}
+
+std::vector<unsigned char> ReadWholeFile(const std::string& path)
+{
+    FILE *file = std::fopen(path.c_str(), "rb");
+
+    if (file == NULL)
+        FATAL_ERROR("error: failed to open \"%s\" for reading\n", path.c_str());
+
+    std::vector<unsigned char> data;
+    unsigned char buffer[65536];
+    std::size_t count;
+
+    while ((count = std::fread(buffer, 1, sizeof(buffer), file)) != 0)
+        data.insert(data.end(), buffer, buffer + count);
+
+    if (std::ferror(file))
+        FATAL_ERROR("error: failed to read \"%s\"\n", path.c_str());
+
+    std::fclose(file);
+
+    return data;
+}
+
+// The totals that are saved as a baseline and compared against it, keyed
+// by kind and name, like "file src/main.o".
+typedef std::map<std::string, long> Totals;
+
+static Totals ReadBaseline(const std::string& path)
+{
+    std::vector<unsigned char> data = ReadWholeFile(path);
+    std::string text(data.begin(), data.end());
+    Totals totals;
+    std::size_t lineStart = 0;
+
+    while (lineStart < text.size())
+    {
+        std::size_t lineEnd = text.find('\n', lineStart);
+
+        if (lineEnd == std::string::npos)
+            lineEnd = text.size();
+
+        std::string line = text.substr(lineStart, lineEnd - lineStart);
+        std::size_t tab = line.find_last_of('\t');
+
+        if (tab != std::string::npos)
+            totals[line.substr(0, tab)] = std::strtol(line.c_str() + tab + 1, nullptr, 10);
+
+        lineStart = lineEnd + 1;
+    }
+
+    return totals;
+}
+
+static void WriteBaseline(const std::string& path, const Totals& totals)
+{
+    FILE *file = std::fopen(path.c_str(), "wb");
+
+    if (file == NULL)
+        FATAL_ERROR("error: failed to open \"%s\" for writing\n", path.c_str());
+
+    for (const auto& total : totals)
+        std::fprintf(file, "%s\t%ld\n", total.first.c_str(), total.second);
+
+    std::fclose(file);
+}
+
+static void PrintDeltas(const Totals& baseline, const Totals& totals, int count)
+{
+    struct Delta
+    {
+        std::string key;
+        long before;
+        long after;
+    };
+
+    std::vector<Delta> deltas;
+
+    for (const auto& total : totals)
+    {
+        auto it = baseline.find(total.first);
+        long before = it == baseline.end() ? 0 : it->second;
+
+        if (before != total.second)
+            deltas.push_back(Delta{ total.first, before, total.second });
+    }
+
+    for (const auto& total : baseline)
+    {
+        if (totals.count(total.first) == 0)
+            deltas.push_back(Delta{ total.first, total.second, 0 });
+    }
+
+    // The region totals come first, then the largest changes.
+    std::stable_sort(deltas.begin(), deltas.end(), [](const Delta& a, const Delta& b) {
+        bool aIsRegion = a.key.compare(0, 7, "region ") == 0;
+        bool bIsRegion = b.key.compare(0, 7, "region ") == 0;
+
+        if (aIsRegion != bIsRegion)
+            return aIsRegion;
+
+        return std::labs(a.after - a.before) > std::labs(b.after - b.before);
+    });
+
+    std::printf("\nChanges since baseline:\n");
+
+    if (deltas.empty())
+        std::printf("  none\n");
+
+    for (std::size_t i = 0; i < deltas.size() && (int)i < count; i++)
+        std::printf("  %+9ld  %9ld -> %9ld  %s\n", deltas[i].after - deltas[i].before,
+            deltas[i].before, deltas[i].after, deltas[i].key.c_str());
+
+    if (deltas.size() > (std::size_t)count)
+        std::printf("  ... and %zu more\n", deltas.size() - count);
+}
+
+template <typename T>
+static std::vector<std::pair<std::string, T>> Largest(const std::map<std::string, T>& items, int count, long (*size)(const T&))
+{
+    std::vector<std::pair<std::string, T>> sorted(items.begin(), items.end());
+
+    std::stable_sort(sorted.begin(), sorted.end(), [size](const std::pair<std::string, T>& a, const std::pair<std::string, T>& b) {
+        return size(a.second) > size(b.second);
+    });
+
+    if (sorted.size() > (std::size_t)count)
+        sorted.resize(count);
+
+    return sorted;
+}
+
+struct FileSizes
+{
+    long bytes[4];
+};
+
+static long FileTotal(const FileSizes& sizes)
+{
+    return sizes.bytes[0] + sizes.bytes[1] + sizes.bytes[2] + sizes.bytes[3];
+}
+
+struct UncompressedAsset
+{
+    std::string symbol;
+    std::string path;
+    std::uint32_t size;
+    std::uint32_t lzSize;
+};
+
+static bool IsCompressedPath(const std::string& path)
+{
+    const char *extensions[] = { ".lz", ".rl", ".huff" };
+
+    for (const char *extension : extensions)
+    {
+        std::size_t length = std::strlen(extension);
+
+        if (path.size() >= length && path.compare(path.size() - length, length, extension) == 0)
+            return true;
+    }
+
+    return false;
+}
+
+static void Usage(const char *program)
+{
+    std::fprintf(stderr,
+        "Usage: %s ELF_FILE MAP_FILE [options]\n"
+        "Reports how the ROM, EWRAM and IWRAM are used.\n"
+        "  -n COUNT        show the COUNT largest entries of each list (default 20)\n"
+        "  -s SOURCE_DIR   where to look for INCBINs (default .)\n"
+        "  -b BASELINE     show how the totals changed since BASELINE\n"
+        "  -w BASELINE     save the totals to BASELINE\n",
+        program);
+    std::exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    std::string elfPath;
+    std::string mapPath;
+    std::string sourceDir = ".";
+    std::string baselinePath;
+    std::string newBaselinePath;
+    int count = 20;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+
+        if ((arg == "-n" || arg == "-s" || arg == "-b" || arg == "-w") && i + 1 >= argc)
+            FATAL_ERROR("error: missing value after \"%s\"\n", arg.c_str());
+
+        if (arg == "-n")
+            count = std::atoi(argv[++i]);
+        else if (arg == "-s")
+            sourceDir = argv[++i];
+        else if (arg == "-b")
+            baselinePath = argv[++i];
+        else if (arg == "-w")
+            newBaselinePath = argv[++i];
+        else if (arg[0] == '-')
+            Usage(argv[0]);
+        else if (elfPath.empty())
+            elfPath = arg;
+        else if (mapPath.empty())
+            mapPath = arg;
+        else
+            Usage(argv[0]);
+    }
+
+    if (mapPath.empty() || count < 1)
+        Usage(argv[0]);
+
+    ElfFile elf;
+    ReadElfFile(elfPath, elf);
+
+    std::vector<InputSection> inputSections = ReadMapFile(mapPath);
+    std::map<std::string, std::string> incbins = ScanIncbins(sourceDir);
+    Totals totals;
+
+    // Regions and output sections.
+    long regionSizes[4] = {};
+
+    std::printf("Sections:\n");
+
+    for (const ElfSection& section : elf.sections)
+    {
+        Region region = GetRegion(section.address);
+
+        if (section.size == 0)
+            continue;
+
+        regionSizes[static_cast<int>(region)] += section.size;
+        totals[std::string("section ") + section.name] = section.size;
+        std::printf("  %-20s 0x%08X %9u  %s\n", section.name.c_str(), section.address, section.size, GetRegionName(region));
+    }
+
+    std::printf("\nRegions:\n");
+
+    for (Region region : { Region::Rom, Region::Ewram, Region::Iwram })
+    {
+        long used = regionSizes[static_cast<int>(region)];
+        std::uint32_t capacity = GetRegionCapacity(region);
+
+        totals[std::string("region ") + GetRegionName(region)] = used;
+        std::printf("  %-6s %9ld of %9u bytes used (%5.1f%%), %ld free\n", GetRegionName(region),
+            used, capacity, 100.0 * used / capacity, capacity - used);
+    }
+
+    // Sizes by source file, and the ROM split by kind of data. Input
+    // sections are classified by name and object, and then the INCBIN'd
+    // data in them is moved to the class of the file it came from.
+    std::map<std::string, FileSizes> fileSizes;
+    long classSizes[6] = {};
+
+    auto findElfSection = [&](std::uint32_t address) -> const ElfSection * {
+        for (const ElfSection& section : elf.sections)
+        {
+            if (address >= section.address && address - section.address < section.size)
+                return &section;
+        }
+        return nullptr;
+    };
+
+    for (const InputSection& input : inputSections)
+    {
+        Region region = GetRegion(input.address);
+        FileSizes& sizes = fileSizes[input.file];
+
+        sizes.bytes[static_cast<int>(region)] += input.size;
+
+        if (region == Region::Rom)
+        {
+            const ElfSection *section = findElfSection(input.address);
+            AssetClass assetClass = ClassifyInputSection(input.name, input.file, section && section->executable);
+
+            classSizes[static_cast<int>(assetClass)] += input.size;
+        }
+    }
+
+    std::vector<UncompressedAsset> uncompressedAssets;
+
+    for (const ElfSymbol& symbol : elf.symbols)
+    {
+        auto incbin = incbins.find(symbol.name);
+
+        if (incbin == incbins.end() || GetRegion(symbol.address) != Region::Rom)
+            continue;
+
+        const InputSection *input = FindInputSection(inputSections, symbol.address);
+
+        if (input != nullptr)
+        {
+            const ElfSection *section = findElfSection(symbol.address);
+            AssetClass oldClass = ClassifyInputSection(input->name, input->file, section && section->executable);
+
+            classSizes[static_cast<int>(oldClass)] -= symbol.size;
+            classSizes[static_cast<int>(ClassifyAssetPath(incbin->second))] += symbol.size;
+        }
+
+        const unsigned char *data = elf.GetSymbolData(symbol);
+
+        if (data != nullptr && !IsCompressedPath(incbin->second))
+            uncompressedAssets.push_back(UncompressedAsset{ symbol.name, incbin->second, symbol.size, EstimateLZSize(data, symbol.size) });
+    }
+
+    long romSize = regionSizes[static_cast<int>(Region::Rom)];
+
+    std::printf("\nROM by kind of data:\n");
+
+    for (int i = 0; i < 6; i++)
+    {
+        const char *name = GetAssetClassName(static_cast<AssetClass>(i));
+
+        totals[std::string("class ") + name] = classSizes[i];
+        std::printf("  %-10s %9ld  (%5.1f%%)\n", name, classSizes[i], romSize ? 100.0 * classSizes[i] / romSize : 0.0);
+    }
+
+    for (const auto& file : fileSizes)
+        totals["file " + file.first] = FileTotal(file.second);
+
+    std::printf("\nLargest source files:\n  %9s %9s %9s  file\n", "ROM", "EWRAM", "IWRAM");
+
+    for (const auto& file : Largest<FileSizes>(fileSizes, count, FileTotal))
+        std::printf("  %9ld %9ld %9ld  %s\n", file.second.bytes[static_cast<int>(Region::Rom)],
+            file.second.bytes[static_cast<int>(Region::Ewram)], file.second.bytes[static_cast<int>(Region::Iwram)],
+            file.first.c_str());
+
+    // Symbols, largest first.
+    std::vector<const ElfSymbol *> symbols;
+
+    for (const ElfSymbol& symbol : elf.symbols)
+        symbols.push_back(&symbol);
+
+    std::stable_sort(symbols.begin(), symbols.end(), [](const ElfSymbol *a, const ElfSymbol *b) {
+        return a->size > b->size;
+    });
+
+    std::printf("\nLargest symbols:\n");
+
+    for (std::size_t i = 0; i < symbols.size() && (int)i < count; i++)
+    {
+        const ElfSymbol *symbol = symbols[i];
+        auto incbin = incbins.find(symbol->name);
+        const char *kind = symbol->isFunction ? "code" : incbin != incbins.end() ? GetAssetClassName(ClassifyAssetPath(incbin->second)) : "data";
+
+        std::printf("  %9u  %-5s %-8s %s\n", symbol->size, GetRegionName(GetRegion(symbol->address)), kind, symbol->name.c_str());
+    }
+
+    // INCBINs stored uncompressed, by how much LZ77 would save.
+    std::stable_sort(uncompressedAssets.begin(), uncompressedAssets.end(), [](const UncompressedAsset& a, const UncompressedAsset& b) {
+        return (long)a.size - (long)a.lzSize > (long)b.size - (long)b.lzSize;
+    });
+
+    std::printf("\nUncompressed INCBINs that LZ77 would shrink the most:\n  %9s %9s %9s  symbol (file)\n", "size", "as .lz", "saved");
+
+    long totalSavings = 0;
+
+    for (std::size_t i = 0; i < uncompressedAssets.size(); i++)
+    {
+        const UncompressedAsset& asset = uncompressedAssets[i];
+        long saved = (long)asset.size - (long)asset.lzSize;
+
+        if (saved <= 0)
+            break;
+
+        totalSavings += saved;
+
+        if ((int)i < count)
+            std::printf("  %9u %9u %9ld  %s (%s)\n", asset.size, asset.lzSize, saved, asset.symbol.c_str(), asset.path.c_str());
+    }
+
+    std::printf("  %ld bytes in all. The code that loads an asset has to decompress it, so not every\n"
+                "  asset can be switched, e.g. data that's DMA'd straight from ROM.\n", totalSavings);
+
+    if (!baselinePath.empty())
+        PrintDeltas(ReadBaseline(baselinePath), totals, count);
+
+    if (!newBaselinePath.empty())
+        WriteBaseline(newBaselinePath, totals);
+
+    return 0;
+}
@@ -0,0 +1,136 @@
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include "romsize.h"
+#include "map_file.h"
+
+static bool ParseHex(const std::string& s, std::uint32_t& value)
+{
+    if (s.size() < 3 || s[0] != '0' || s[1] != 'x')
+        return false;
+
+    char *end;
+    unsigned long long n = std::strtoull(s.c_str() + 2, &end, 16);
+
+    if (*end != 0)
+        return false;
+
+    value = static_cast<std::uint32_t>(n);
+    return true;
+}
+
+static std::vector<std::string> SplitWords(const std::string& line)
+{
+    std::istringstream stream(line);
+    std::vector<std::string> words;
+    std::string word;
+
+    while (stream >> word)
+        words.push_back(word);
+
+    return words;
+}
+
+std::vector<InputSection> ReadMapFile(const std::string& path)
+{
+    std::vector<unsigned char> data = ReadWholeFile(path);
+    std::string text(data.begin(), data.end());
+    std::istringstream stream(text);
+    std::string line;
+    std::vector<InputSection> sections;
+    bool inMemoryMap = false;
+
+    // A name too long for its column is on a line of its own, and the
+    // address, size and file follow on the next line.
+    std::string pendingName;
+
+    while (std::getline(stream, line))
+    {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+
+        if (!inMemoryMap)
+        {
+            inMemoryMap = line.compare(0, 28, "Linker script and memory map") == 0;
+            continue;
+        }
+
+        // Input sections are indented by one space. Output sections aren't
+        // indented, and symbols and assignments are indented further.
+        if (line.size() < 2 || line[0] != ' ' || line[1] == ' ')
+        {
+            std::vector<std::string> words = SplitWords(line);
+
+            if (!pendingName.empty() && words.size() >= 3)
+            {
+                std::uint32_t address;
+                std::uint32_t size;
+
+                if (ParseHex(words[0], address) && ParseHex(words[1], size) && size != 0)
+                {
+                    std::string file = line.substr(line.find(words[2]));
+                    sections.push_back(InputSection{ pendingName, file, address, size });
+                }
+            }
+
+            pendingName.clear();
+            continue;
+        }
+
+        std::vector<std::string> words = SplitWords(line);
+
+        pendingName.clear();
+
+        // Skip linker script patterns like " *(.text)".
+        if (words.empty() || words[0].compare(0, 2, "*(") == 0)
+            continue;
+
+        if (words.size() == 1)
+        {
+            pendingName = words[0];
+            continue;
+        }
+
+        std::uint32_t address;
+        std::uint32_t size;
+
+        if (words.size() < 3 || !ParseHex(words[1], address) || !ParseHex(words[2], size) || size == 0)
+            continue;
+
+        std::string file = words[0] == "*fill*" ? "*fill*" : "";
+
+        if (file.empty())
+        {
+            if (words.size() < 4)
+                continue;
+
+            // Paths can have spaces in them, so take the rest of the line.
+            file = line.substr(line.find(words[3], line.find(words[2]) + words[2].size()));
+        }
+
+        sections.push_back(InputSection{ words[0], file, address, size });
+    }
+
+    std::stable_sort(sections.begin(), sections.end(), [](const InputSection& a, const InputSection& b) {
+        return a.address < b.address;
+    });
+
+    return sections;
+}
+
+const InputSection *FindInputSection(const std::vector<InputSection>& sections, std::uint32_t address)
+{
+    auto it = std::upper_bound(sections.begin(), sections.end(), address, [](std::uint32_t address, const InputSection& section) {
+        return address < section.address;
+    });
+
+    if (it == sections.begin())
+        return nullptr;
+
+    --it;
+
+    if (address - it->address >= it->size)
+        return nullptr;
+
+    return &*it;
+}
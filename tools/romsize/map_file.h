@@ -0,0 +1,25 @@
+#ifndef MAP_FILE_H
+#define MAP_FILE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// One input section placed by the linker, like ".rodata" from "src/main.o".
+// Padding the linker added is listed with the file "*fill*".
+struct InputSection
+{
+    std::string name;
+    std::string file;
+    std::uint32_t address;
+    std::uint32_t size;
+};
+
+// Reads the input sections from the memory map part of a GNU ld map file,
+// sorted by address.
+std::vector<InputSection> ReadMapFile(const std::string& path);
+
+// Returns the input section that contains address, or nullptr.
+const InputSection *FindInputSection(const std::vector<InputSection>& sections, std::uint32_t address);
+
+#endif // MAP_FILE_H
@@ -0,0 +1,45 @@
+#ifndef ROMSIZE_H
+#define ROMSIZE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#ifdef _MSC_VER
+
+#define FATAL_ERROR(format, ...)               \
+do                                             \
+{                                              \
+    std::fprintf(stderr, format, __VA_ARGS__); \
+    std::exit(1);                              \
+} while (0)
+
+#else
+
+#define FATAL_ERROR(format, ...)                 \
+do                                               \
+{                                                \
+    std::fprintf(stderr, format, ##__VA_ARGS__); \
+    std::exit(1);                                \
+} while (0)
+
+#endif // _MSC_VER
+
+// The GBA's memory regions, with the space each one has.
+enum class Region
+{
+    Rom,
+    Ewram,
+    Iwram,
+    Other,
+};
+
+Region GetRegion(std::uint32_t address);
+const char *GetRegionName(Region region);
+std::uint32_t GetRegionCapacity(Region region);
+
+std::vector<unsigned char> ReadWholeFile(const std::string& path);
+
+#endif // ROMSIZE_H
@@ -0,0 +1,206 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+#include "scaninc.h"
+#include "source_file.h"
+#include "dep_cache.h"
+
+static const char *const CACHE_MAGIC = "SCANINC_CACHE 1";
+
+static bool StatFile(const std::string& path, long long& mtime, long long& size)
+{
+    struct stat st;
+
+    if (stat(path.c_str(), &st) != 0)
+        return false;
+
+    mtime = st.st_mtime;
+    size = st.st_size;
+    return true;
+}
+
+// A missing or malformed cache is not an error; we just rescan everything.
+void DependencyCache::Load(const std::string& path)
+{
+    FILE *fp = std::fopen(path.c_str(), "rb");
+
+    if (fp == NULL)
+        return;
+
+    std::fseek(fp, 0, SEEK_END);
+    long size = std::ftell(fp);
+    std::rewind(fp);
+
+    std::string buffer(size, '\0');
+
+    if (size <= 0 || std::fread(&buffer[0], size, 1, fp) != 1)
+    {
+        std::fclose(fp);
+        return;
+    }
+
+    std::fclose(fp);
+
+    // Entries parsed before a bad line can't be trusted either: the entry
+    // the line belonged to may be missing some of its directives.
+    if (!Parse(buffer))
+        m_entries.clear();
+}
+
+bool DependencyCache::Parse(const std::string& buffer)
+{
+    std::size_t pos = 0;
+    CacheEntry *entry = nullptr;
+    bool first = true;
+
+    while (pos < buffer.size())
+    {
+        std::size_t end = buffer.find('\n', pos);
+
+        // Every line ends in a newline, so this is a truncated file.
+        if (end == std::string::npos)
+            return false;
+
+        const char *line = buffer.c_str() + pos;
+        std::size_t length = end - pos;
+
+        pos = end + 1;
+
+        if (first)
+        {
+            if (buffer.compare(0, length, CACHE_MAGIC) != 0)
+                return false;
+            first = false;
+            continue;
+        }
+
+        if (length < 2 || line[1] != ' ')
+            return false;
+
+        if (line[0] == 'F')
+        {
+            char *cursor;
+            long long mtime = std::strtoll(line + 2, &cursor, 10);
+            long long size = std::strtoll(cursor, &cursor, 10);
+
+            if (*cursor != ' ' || cursor >= line + length)
+                return false;
+
+            cursor++;
+            entry = &m_entries[std::string(cursor, line + length - cursor)];
+            entry->mtime = mtime;
+            entry->size = size;
+        }
+        else if (entry != nullptr && line[0] == 'I')
+        {
+            entry->includes.emplace_hint(entry->includes.end(), line + 2, length - 2);
+        }
+        else if (entry != nullptr && line[0] == 'B')
+        {
+            entry->incbins.emplace_hint(entry->incbins.end(), line + 2, length - 2);
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void DependencyCache::Save(const std::string& path)
+{
+    if (!m_dirty)
+        return;
+
+    // Write to a temporary file and rename it over the old cache so that
+    // concurrent scaninc processes never see a partially written cache.
+    std::string tmpPath = path + ".tmp" + std::to_string((long long)getpid());
+    FILE *fp = std::fopen(tmpPath.c_str(), "wb");
+
+    if (fp == NULL)
+        FATAL_ERROR("Failed to open \"%s\" for writing.\n", tmpPath.c_str());
+
+    long long now = std::time(nullptr);
+
+    std::fprintf(fp, "%s\n", CACHE_MAGIC);
+
+    for (const auto& pair : m_entries)
+    {
+        const CacheEntry& entry = pair.second;
+
+        // A file modified in the same second as it was scanned could be
+        // modified again without changing its mtime, so don't trust it.
+        if (entry.mtime + 1 >= now)
+            continue;
+
+        std::fprintf(fp, "F %lld %lld %s\n", entry.mtime, entry.size, pair.first.c_str());
+        for (const std::string& include : entry.includes)
+            std::fprintf(fp, "I %s\n", include.c_str());
+        for (const std::string& incbin : entry.incbins)
+            std::fprintf(fp, "B %s\n", incbin.c_str());
+    }
+
+    std::fclose(fp);
+
+    if (std::rename(tmpPath.c_str(), path.c_str()) != 0)
+    {
+        // Windows won't rename over an existing file.
+        std::remove(path.c_str());
+        if (std::rename(tmpPath.c_str(), path.c_str()) != 0)
+            std::remove(tmpPath.c_str());
+    }
+}
+
+// Returns the includes and incbins of the file, only scanning it if it
+// changed since the cached entry was made.
+const CacheEntry& DependencyCache::Lookup(const std::string& path)
+{
+    auto it = m_entries.find(path);
+
+    if (m_checked.count(path) != 0)
+        return it->second;
+
+    long long mtime, size;
+
+    if (!StatFile(path, mtime, size))
+        FATAL_ERROR("Failed to open \"%s\" for reading.\n", path.c_str());
+
+    m_checked.insert(path);
+
+    if (it != m_entries.end() && it->second.mtime == mtime && it->second.size == size)
+        return it->second;
+
+    SourceFile file(path);
+    CacheEntry& entry = m_entries[path];
+
+    entry.mtime = mtime;
+    entry.size = size;
+    entry.includes = file.GetIncludes();
+    entry.incbins = file.GetIncbins();
+    m_dirty = true;
+
+    return entry;
+}
+
+bool DependencyCache::FileExists(const std::string& path)
+{
+    auto it = m_exists.find(path);
+
+    if (it != m_exists.end())
+        return it->second;
+
+    struct stat st;
+    bool exists = stat(path.c_str(), &st) == 0 && !S_ISDIR(st.st_mode);
+
+    m_exists[path] = exists;
+    return exists;
+}
@@ -0,0 +1,37 @@
+#ifndef DEP_CACHE_H
+#define DEP_CACHE_H
+
+#include <map>
+#include <set>
+#include <string>
+
+// The directives found in a single file. These are the raw paths written
+// in the source, so they don't depend on the include directories and can
+// be shared between scaninc invocations with different -I options.
+struct CacheEntry
+{
+    long long mtime;
+    long long size;
+    std::set<std::string> includes;
+    std::set<std::string> incbins;
+};
+
+class DependencyCache
+{
+public:
+    DependencyCache() : m_dirty(false) {}
+    void Load(const std::string& path);
+    void Save(const std::string& path);
+    const CacheEntry& Lookup(const std::string& path);
+    bool FileExists(const std::string& path);
+
+private:
+    bool Parse(const std::string& buffer);
+
+    std::map<std::string, CacheEntry> m_entries;
+    std::set<std::string> m_checked;
+    std::map<std::string, bool> m_exists;
+    bool m_dirty;
+};
+
+#endif // DEP_CACHE_H
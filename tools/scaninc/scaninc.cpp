@@ -24,33 +24,98 @@
 #include <queue>
 #include <set>
 #include <string>
+#include <vector>
 #include "scaninc.h"
 #include "source_file.h"
+#include "dep_cache.h"
 
-bool CanOpenFile(std::string path)
+const char *const USAGE = "Usage: scaninc [-I INCLUDE_PATH] [-C CACHE_PATH] [-MF DEP_PATH -MT TARGET] FILE_PATH...\n";
+
+std::set<std::string> ScanDependencies(std::string initialPath, std::vector<std::string> includeDirs, DependencyCache& cache)
+{
+    std::queue<std::string> filesToProcess;
+    std::set<std::string> dependencies;
+
+    filesToProcess.push(initialPath);
+
+    while (!filesToProcess.empty())
+    {
+        std::string filePath = filesToProcess.front();
+        const CacheEntry& file = cache.Lookup(filePath);
+        filesToProcess.pop();
+
+        includeDirs.push_back(GetDir(filePath));
+        for (auto incbin : file.incbins)
+        {
+            dependencies.insert(incbin);
+        }
+        for (auto include : file.includes)
+        {
+            bool exists = false;
+            std::string path("");
+            for (auto includeDir : includeDirs)
+            {
+                path = includeDir + include;
+                if (cache.FileExists(path))
+                {
+                    exists = true;
+                    break;
+                }
+            }
+            if (!exists && GetFileType(filePath) == SourceFileType::Asm)
+            {
+                path = include;
+            }
+            bool inserted = dependencies.insert(path).second;
+            if (inserted && exists)
+            {
+                filesToProcess.push(path);
+            }
+        }
+        includeDirs.pop_back();
+    }
+
+    return dependencies;
+}
+
+// Writes a make rule "TARGET DEP_PATH: FILE DEPENDENCIES" followed by an
+// empty rule for each dependency, so deleting a header doesn't break the
+// build and the dependency file is regenerated when any dependency changes.
+void WriteDependencyFile(std::string depPath, std::string target, std::string inputPath, const std::set<std::string>& dependencies)
 {
-    FILE *fp = std::fopen(path.c_str(), "rb");
+    FILE *fp = std::fopen(depPath.c_str(), "w");
 
     if (fp == NULL)
-        return false;
+        FATAL_ERROR("Failed to open \"%s\" for writing.\n", depPath.c_str());
+
+    std::fprintf(fp, "%s %s: %s", target.c_str(), depPath.c_str(), inputPath.c_str());
+    for (const std::string &path : dependencies)
+    {
+        std::fprintf(fp, " \\\n  %s", path.c_str());
+    }
+    std::fprintf(fp, "\n");
+
+    for (const std::string &path : dependencies)
+    {
+        std::fprintf(fp, "\n%s:\n", path.c_str());
+    }
 
     std::fclose(fp);
-    return true;
 }
 
-const char *const USAGE = "Usage: scaninc [-I INCLUDE_PATH] FILE_PATH\n";
-
 int main(int argc, char **argv)
 {
-    std::queue<std::string> filesToProcess;
-    std::set<std::string> dependencies;
-
     std::vector<std::string> includeDirs;
+    std::vector<std::string> inputPaths;
+    std::string cachePath;
+    std::string depPath;
+    std::string depTarget;
+    DependencyCache cache;
 
     argc--;
     argv++;
 
-    while (argc > 1)
+    while (argc > 0)
     {
         std::string arg(argv[0]);
         if (arg.substr(0, 2) == "-I")
@@ -58,6 +123,8 @@ int main(int argc, char **argv)
             std::string includeDir = arg.substr(2);
             if (includeDir.empty())
             {
+                if (argc < 2)
+                    FATAL_ERROR(USAGE);
                 argc--;
                 argv++;
                 includeDir = std::string(argv[0]);
@@ -68,61 +135,76 @@ int main(int argc, char **argv)
             }
             includeDirs.push_back(includeDir);
         }
-        else
+        else if (arg == "-C")
+        {
+            if (argc < 2)
+                FATAL_ERROR(USAGE);
+            argc--;
+            argv++;
+            cachePath = std::string(argv[0]);
+        }
+        else if (arg == "-MF" || arg == "-MT")
+        {
+            if (argc < 2)
+                FATAL_ERROR(USAGE);
+            argc--;
+            argv++;
+            if (arg == "-MF")
+                depPath = std::string(argv[0]);
+            else
+                depTarget = std::string(argv[0]);
+        }
+        else if (arg.substr(0, 1) == "-")
         {
             FATAL_ERROR(USAGE);
         }
+        else
+        {
+            inputPaths.push_back(arg);
+        }
         argc--;
         argv++;
     }
 
-    if (argc != 1) {
+    if (inputPaths.empty()) {
         FATAL_ERROR(USAGE);
     }
 
-    std::string initialPath(argv[0]);
+    if (depPath.empty() != depTarget.empty() || (!depPath.empty() && inputPaths.size() != 1)) {
+        FATAL_ERROR(USAGE);
+    }
 
-    filesToProcess.push(initialPath);
+    if (!cachePath.empty())
+        cache.Load(cachePath);
 
-    while (!filesToProcess.empty())
+    for (const std::string &inputPath : inputPaths)
     {
-        std::string filePath = filesToProcess.front();
-        SourceFile file(filePath);
-        filesToProcess.pop();
+        std::set<std::string> dependencies = ScanDependencies(inputPath, includeDirs, cache);
 
-        includeDirs.push_back(file.GetSrcDir());
-        for (auto incbin : file.GetIncbins())
+        // A single file keeps the plain one-path-per-line output. With several
+        // files, each one gets a make-style "FILE: DEPENDENCIES" line instead.
+        if (!depPath.empty())
         {
-            dependencies.insert(incbin);
+            WriteDependencyFile(depPath, depTarget, inputPath, dependencies);
         }
-        for (auto include : file.GetIncludes())
+        else if (inputPaths.size() == 1)
         {
-            bool exists = false;
-            std::string path("");
-            for (auto includeDir : includeDirs)
-            {
-                path = includeDir + include;
-                if (CanOpenFile(path))
-                {
-                    exists = true;
-                    break;
-                }
-            }
-            if (!exists && file.FileType() == SourceFileType::Asm)
+            for (const std::string &path : dependencies)
             {
-                path = include;
+                std::printf("%s\n", path.c_str());
             }
-            bool inserted = dependencies.insert(path).second;
-            if (inserted && exists)
+        }
+        else
+        {
+            std::printf("%s:", inputPath.c_str());
+            for (const std::string &path : dependencies)
             {
-                filesToProcess.push(path);
+                std::printf(" %s", path.c_str());
             }
+            std::printf("\n");
         }
-        includeDirs.pop_back();
     }
 
-    for (const std::string &path : dependencies)
-    {
-        std::printf("%s\n", path.c_str());
-    }
+    if (!cachePath.empty())
+        cache.Save(cachePath);
 }